@@ -0,0 +1,491 @@
+#include <string.h>
+#include <mutex>
+#include "block_cache.h"
+#include "gameboy.h"
+#include "rom.h"
+#include "rom_store.h"
+
+// Never destroyed: a Gameboy declared as a global releases its cache after the globals of this file are gone
+static std::mutex &					   s_romCachesMutex = *new std::mutex();
+static std::vector< ROMBlockCache * > & s_romCaches = *new std::vector< ROMBlockCache * >();
+
+static bool IsInvalidOpcode( byte opcode ) {
+	switch ( opcode ) {
+		case 0xd3:
+		case 0xdb:
+		case 0xdd:
+		case 0xe3:
+		case 0xe4:
+		case 0xeb:
+		case 0xec:
+		case 0xed:
+		case 0xf4:
+		case 0xfc:
+		case 0xfd:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Jumps, calls, returns, and instructions that stop the CPU
+static bool EndsBlock( byte opcode ) {
+	switch ( opcode ) {
+		case 0x10: // STOP
+		case 0x18: // JR
+		case 0x20:
+		case 0x28:
+		case 0x30:
+		case 0x38:
+		case 0x76: // HALT
+		case 0xc0: // RET
+		case 0xc8:
+		case 0xc9:
+		case 0xd0:
+		case 0xd8:
+		case 0xd9:
+		case 0xc2: // JP
+		case 0xc3:
+		case 0xca:
+		case 0xd2:
+		case 0xda:
+		case 0xe9:
+		case 0xc4: // CALL
+		case 0xcc:
+		case 0xcd:
+		case 0xd4:
+		case 0xdc:
+		case 0xc7: // RST
+		case 0xcf:
+		case 0xd7:
+		case 0xdf:
+		case 0xe7:
+		case 0xef:
+		case 0xf7:
+		case 0xff:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Memory accessed by an instruction of an idle loop candidate. Writing memory, using the stack or changing the
+// interrupt state makes the loop unsafe
+enum IdleLoopAccess {
+	ACCESS_NONE,
+	ACCESS_UNSAFE,
+	ACCESS_STATIC,
+	ACCESS_BC,
+	ACCESS_DE,
+	ACCESS_HL,
+	ACCESS_C,
+};
+
+static IdleLoopAccess GetIdleLoopAccess( const DecodedInstruction & instruction ) {
+	byte opcode = instruction.opcode;
+	if ( opcode == 0xcb ) {
+		byte cbOpcode = instruction.operands[ 0 ];
+		if ( ( cbOpcode & 7 ) != 6 ) {
+			return ACCESS_NONE;
+		}
+		// Only BIT leaves (HL) alone
+		return cbOpcode >= 0x40 && cbOpcode < 0x80 ? ACCESS_HL : ACCESS_UNSAFE;
+	}
+	switch ( opcode ) {
+		case 0x00:
+		case 0x07:
+		case 0x0f:
+		case 0x17:
+		case 0x1f:
+		case 0x27:
+		case 0x2f:
+		case 0x37:
+		case 0x3f:
+			return ACCESS_NONE;
+		case 0x0a:
+			return ACCESS_BC;
+		case 0x1a:
+			return ACCESS_DE;
+		case 0x2a:
+		case 0x3a:
+			return ACCESS_HL;
+		case 0xf2:
+			return ACCESS_C;
+		case 0xf0:
+		case 0xfa:
+			return ACCESS_STATIC;
+	}
+	if ( ( opcode & 0xc7 ) == 0x04 || ( opcode & 0xc7 ) == 0x05 || ( opcode & 0xc7 ) == 0x06 ) {
+		// INC r, DEC r, LD r, d8. The (HL) forms write memory
+		return ( ( opcode >> 3 ) & 7 ) == 6 ? ACCESS_UNSAFE : ACCESS_NONE;
+	}
+	if ( opcode >= 0x70 && opcode < 0x78 ) {
+		// LD (HL), r and HALT
+		return ACCESS_UNSAFE;
+	}
+	if ( opcode >= 0x40 && opcode < 0xc0 ) {
+		// LD r, r and ALU A, r
+		return ( opcode & 7 ) == 6 ? ACCESS_HL : ACCESS_NONE;
+	}
+	if ( ( opcode & 0xc7 ) == 0xc6 ) {
+		// ALU A, d8
+		return ACCESS_NONE;
+	}
+	return ACCESS_UNSAFE;
+}
+
+// True when the instruction changes no register but A and F
+static bool OnlyWritesAF( const DecodedInstruction & instruction ) {
+	byte opcode = instruction.opcode;
+	if ( opcode == 0xcb ) {
+		byte cbOpcode = instruction.operands[ 0 ];
+		return ( cbOpcode >= 0x40 && cbOpcode < 0x80 ) || ( cbOpcode & 7 ) == 7;
+	}
+	switch ( opcode ) {
+		case 0x00:
+		case 0x07:
+		case 0x0f:
+		case 0x17:
+		case 0x1f:
+		case 0x27:
+		case 0x2f:
+		case 0x37:
+		case 0x3f:
+		case 0x0a:
+		case 0x1a:
+		case 0x3c:
+		case 0x3d:
+		case 0x3e:
+		case 0xf0:
+		case 0xf2:
+		case 0xfa:
+			return true;
+	}
+	return ( opcode >= 0x78 && opcode < 0xc0 ) || ( opcode & 0xc7 ) == 0xc6;
+}
+
+static bool IsIdleLoopCandidate( const CodeBlock * block ) {
+	const DecodedInstruction & last = block->instructions.back();
+	uint16					   target;
+	switch ( last.opcode ) {
+		case 0x18:
+		case 0x20:
+		case 0x28:
+		case 0x30:
+		case 0x38:
+			target = last.pc + 2 + ( int8 )last.operands[ 0 ];
+			break;
+		case 0xc2:
+		case 0xc3:
+		case 0xca:
+		case 0xd2:
+		case 0xda:
+			target = last.operands[ 0 ] | ( ( uint16 )last.operands[ 1 ] << 8 );
+			break;
+		default:
+			return false;
+	}
+	if ( target != block->startPC ) {
+		return false;
+	}
+
+	// Register based reads are checked against the registers at the start of the loop, so they have to come before
+	// anything changing registers other than A and F
+	bool registersUnchanged = true;
+	for ( size_t i = 0; i + 1 < block->instructions.size(); i++ ) {
+		const DecodedInstruction & instruction = block->instructions[ i ];
+		IdleLoopAccess			   access = GetIdleLoopAccess( instruction );
+		if ( access == ACCESS_UNSAFE ) {
+			return false;
+		}
+		if ( access == ACCESS_STATIC ) {
+			uint16 addr = instruction.opcode == 0xf0 ? 0xff00 + instruction.operands[ 0 ]
+													 : instruction.operands[ 0 ] | ( ( uint16 )instruction.operands[ 1 ] << 8 );
+			if ( !BlockCache::IsStableRead( addr ) ) {
+				return false;
+			}
+		} else if ( access != ACCESS_NONE && !registersUnchanged ) {
+			return false;
+		}
+		registersUnchanged = registersUnchanged && OnlyWritesAF( instruction );
+	}
+	return true;
+}
+
+// Decodes instructions starting at PC, never letting one cross regionEnd (end of a ROM bank or of a RAM bank)
+static CodeBlock * DecodeBlock( Gameboy * gb, uint16 PC, uint32 regionEnd ) {
+	CodeBlock * block = new CodeBlock();
+	block->startPC = PC;
+
+	uint32 addr = PC;
+	while ( block->instructions.size() < BlockCache::maxBlockInstructions ) {
+		byte opcode = gb->Read( addr );
+		int	 length = Cpu::s_instructionsSize[ opcode ];
+		if ( IsInvalidOpcode( opcode ) || addr + length > regionEnd ) {
+			break;
+		}
+
+		DecodedInstruction instruction;
+		instruction.handler = Cpu::s_opcodeHandlers[ opcode ];
+		instruction.pc = addr;
+		instruction.opcode = opcode;
+		instruction.operands[ 0 ] = length > 1 ? gb->Read( addr + 1 ) : 0;
+		instruction.operands[ 1 ] = length > 2 ? gb->Read( addr + 2 ) : 0;
+		block->instructions.push_back( instruction );
+
+		addr += length;
+		if ( EndsBlock( opcode ) ) {
+			break;
+		}
+	}
+	block->endPC = addr;
+	block->mayBeIdleLoop = !block->instructions.empty() && IsIdleLoopCandidate( block );
+	return block;
+}
+
+ROMBlockCache * ROMBlockCache::Acquire( const Cartridge * cart ) {
+	std::lock_guard< std::mutex > lock( s_romCachesMutex );
+	for ( ROMBlockCache * cache : s_romCaches ) {
+		if ( cache->image == cart->image ) {
+			cache->refCount++;
+			return cache;
+		}
+	}
+
+	ROMBlockCache * cache = new ROMBlockCache();
+	cache->image = cart->image;
+	ROMImage::Retain( cache->image );
+	cache->romSize = cart->rawMemorySize;
+	cache->refCount = 1;
+	cache->bankCount = ( cart->rawMemorySize + bankSize - 1 ) / bankSize;
+	cache->banks = new std::atomic< std::atomic< CodeBlock * > * >[ cache->bankCount ];
+	for ( int i = 0; i < cache->bankCount; i++ ) {
+		cache->banks[ i ].store( nullptr );
+	}
+	s_romCaches.push_back( cache );
+	return cache;
+}
+
+void ROMBlockCache::Release( ROMBlockCache * cache ) {
+	std::lock_guard< std::mutex > lock( s_romCachesMutex );
+	cache->refCount--;
+	if ( cache->refCount > 0 ) {
+		return;
+	}
+	for ( size_t i = 0; i < s_romCaches.size(); i++ ) {
+		if ( s_romCaches[ i ] == cache ) {
+			s_romCaches.erase( s_romCaches.begin() + i );
+			break;
+		}
+	}
+	ROMImage::Release( cache->image );
+	delete cache;
+}
+
+CodeBlock * ROMBlockCache::Find( int romAddress ) {
+	std::atomic< CodeBlock * > * bank = banks[ romAddress / bankSize ].load( std::memory_order_acquire );
+	if ( bank == nullptr ) {
+		return nullptr;
+	}
+	return bank[ romAddress % bankSize ].load( std::memory_order_acquire );
+}
+
+CodeBlock * ROMBlockCache::Insert( int romAddress, CodeBlock * block ) {
+	std::atomic< std::atomic< CodeBlock * > * > & bankSlot = banks[ romAddress / bankSize ];
+	std::atomic< CodeBlock * > *				   bank = bankSlot.load( std::memory_order_acquire );
+	if ( bank == nullptr ) {
+		std::atomic< CodeBlock * > * newBank = new std::atomic< CodeBlock * >[ bankSize ];
+		for ( int i = 0; i < bankSize; i++ ) {
+			newBank[ i ].store( nullptr, std::memory_order_relaxed );
+		}
+		if ( bankSlot.compare_exchange_strong( bank, newBank, std::memory_order_acq_rel ) ) {
+			bank = newBank;
+		} else {
+			delete[] newBank;
+		}
+	}
+
+	CodeBlock * expected = nullptr;
+	if ( bank[ romAddress % bankSize ].compare_exchange_strong( expected, block, std::memory_order_acq_rel ) ) {
+		return block;
+	}
+	delete block;
+	return expected;
+}
+
+ROMBlockCache::~ROMBlockCache() {
+	for ( int i = 0; i < bankCount; i++ ) {
+		std::atomic< CodeBlock * > * bank = banks[ i ].load();
+		if ( bank == nullptr ) {
+			continue;
+		}
+		for ( int j = 0; j < bankSize; j++ ) {
+			delete bank[ j ].load();
+		}
+		delete[] bank;
+	}
+	delete[] banks;
+}
+
+bool BlockCache::IsStableRead( uint16 addr ) {
+	if ( addr < 0x8000 || ( addr >= 0xc000 && addr < 0xe000 ) || addr >= 0xff80 ) {
+		// ROM, work RAM, high RAM and IE
+		return true;
+	}
+	switch ( addr ) {
+		case 0xff00: // Joypad, updated between frames
+		case 0xff0f: // IF
+		case 0xff41: // STAT
+		case 0xff44: // LY
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool BlockCache::IdleLoopReadsAreStable( const CodeBlock * block, const Cpu & cpu ) {
+	for ( const DecodedInstruction & instruction : block->instructions ) {
+		uint16 addr;
+		switch ( GetIdleLoopAccess( instruction ) ) {
+			case ACCESS_BC:
+				addr = cpu.BC.Get();
+				break;
+			case ACCESS_DE:
+				addr = cpu.DE.Get();
+				break;
+			case ACCESS_HL:
+				addr = cpu.HL.Get();
+				break;
+			case ACCESS_C:
+				addr = 0xff00 + cpu.BC.low.Get();
+				break;
+			default:
+				continue;
+		}
+		if ( !IsStableRead( addr ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+BlockCache::~BlockCache() {
+	FlushRAM();
+	FreeRetiredBlocks();
+	if ( rom != nullptr ) {
+		ROMBlockCache::Release( rom );
+	}
+}
+
+void BlockCache::AttachCartridge( const Cartridge * cart ) {
+	ROMBlockCache * previous = rom;
+	rom = cart != nullptr ? ROMBlockCache::Acquire( cart ) : nullptr;
+	if ( previous != nullptr ) {
+		ROMBlockCache::Release( previous );
+	}
+	FlushRAM();
+}
+
+void BlockCache::FlushRAM() {
+	for ( auto & it : ramBlocks ) {
+		retiredBlocks.push_back( it.second );
+	}
+	ramBlocks.clear();
+	memset( ramCodeBits, 0, sizeof( ramCodeBits ) );
+	generation++;
+}
+
+const CodeBlock * BlockCache::Lookup( Gameboy * gb, uint16 PC ) {
+	return Lookup( gb, PC, PC < 0x8000 && gb->cart != nullptr ? gb->cart->DebugResolvePC( PC ) : -1 );
+}
+
+const CodeBlock * BlockCache::Lookup( Gameboy * gb, uint16 PC, int romAddress ) {
+	FreeRetiredBlocks();
+
+	if ( gb->mem.highRAM[ 0x50 ] == 0 ) {
+		// The BIOS is still mapped over the cartridge
+		return nullptr;
+	}
+
+	CodeBlock * block = nullptr;
+	if ( PC < 0x8000 ) {
+		if ( rom == nullptr || romAddress < 0 || romAddress >= rom->romSize ) {
+			return nullptr;
+		}
+		block = rom->Find( romAddress );
+		if ( block == nullptr ) {
+			block = rom->Insert( romAddress, DecodeBlock( gb, PC, PC < 0x4000 ? 0x4000 : 0x8000 ) );
+		}
+	} else {
+		uint32 ramAddress;
+		uint32 regionEnd;
+		if ( PC >= 0xc000 && PC < 0xd000 ) {
+			ramAddress = PC - 0xc000;
+			regionEnd = 0xd000;
+		} else if ( PC >= 0xd000 && PC < 0xe000 ) {
+			ramAddress = PC - 0xd000 + gb->mem.WorkRAMBankOffset();
+			regionEnd = 0xe000;
+		} else if ( PC >= 0xff80 && PC < 0xffff ) {
+			ramAddress = highRAMCodeOffset + PC - 0xff80;
+			regionEnd = 0xffff;
+		} else {
+			// VRAM, cartridge RAM, echo RAM and IO are rare enough to stay on the plain interpreter
+			return nullptr;
+		}
+
+		auto it = ramBlocks.find( ramAddress );
+		if ( it != ramBlocks.end() ) {
+			block = it->second;
+		} else {
+			block = DecodeBlock( gb, PC, regionEnd );
+			ramBlocks[ ramAddress ] = block;
+			for ( uint32 i = ramAddress; i < ramAddress + ( block->endPC - block->startPC ); i++ ) {
+				ramCodeBits[ i / 64 ] |= 1ull << ( i % 64 );
+			}
+			// Writes to these bytes have to come through the invalidation check again
+			gb->MapWorkRAMPages();
+		}
+	}
+
+	if ( block->instructions.empty() ) {
+		// Could not decode anything here, the interpreter will deal with it
+		return nullptr;
+	}
+	return block;
+}
+
+void BlockCache::InvalidateRAM( uint32 ramAddress ) {
+	for ( auto it = ramBlocks.begin(); it != ramBlocks.end(); ) {
+		uint32 blockStart = it->first;
+		uint32 blockEnd = blockStart + ( it->second->endPC - it->second->startPC );
+		if ( ramAddress >= blockStart && ramAddress < blockEnd ) {
+			// The block may be the one running right now, so it is only freed on the next lookup
+			retiredBlocks.push_back( it->second );
+			it = ramBlocks.erase( it );
+		} else {
+			++it;
+		}
+	}
+	RebuildRAMCodeBits();
+	generation++;
+}
+
+void BlockCache::RebuildRAMCodeBits() {
+	memset( ramCodeBits, 0, sizeof( ramCodeBits ) );
+	for ( auto & it : ramBlocks ) {
+		uint32 blockEnd = it.first + ( it.second->endPC - it.second->startPC );
+		for ( uint32 i = it.first; i < blockEnd; i++ ) {
+			ramCodeBits[ i / 64 ] |= 1ull << ( i % 64 );
+		}
+	}
+}
+
+void BlockCache::FreeRetiredBlocks() {
+	if ( retiredBlocks.empty() ) {
+		return;
+	}
+	for ( CodeBlock * block : retiredBlocks ) {
+		delete block;
+	}
+	retiredBlocks.clear();
+}
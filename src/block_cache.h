@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include "cpu.h"
+
+struct Gameboy;
+class Cartridge;
+struct ROMImage;
+
+// A guest instruction with its operand bytes fetched ahead of time
+struct DecodedInstruction {
+	Cpu::OpcodeHandler handler;
+	uint16			   pc;
+	byte			   opcode;
+	byte			   operands[ 2 ];
+};
+
+// Straight-line guest code, decoded up to the first control flow instruction
+struct CodeBlock {
+	std::vector< DecodedInstruction > instructions;
+	uint16							  startPC = 0;
+	uint16							  endPC = 0; // Address right after the last instruction
+	// Jumps back to its own start without writing memory or reading anything that changes on its own, see IsStableRead
+	bool							  mayBeIdleLoop = false;
+};
+
+// Blocks decoded from one ROM image, keyed by their resolved ROM address (bank * 0x4000 + offset).
+// ROM never changes, so every Gameboy running the same cartridge shares one of these.
+struct ROMBlockCache {
+	static constexpr int bankSize = 0x4000;
+
+	// The image the blocks were decoded from, held until the cache is destroyed. The store gives one image per content,
+	// so caches are shared on it rather than on the hash, which two ROMs can have in common
+	ROMImage * image = nullptr;
+	int		   romSize = 0;
+	int		   refCount = 0;
+	int	   bankCount = 0;
+	// One lazily allocated array of blocks per bank, filled in with compare and swap so instances can share it across threads
+	std::atomic< std::atomic< CodeBlock * > * > * banks = nullptr;
+
+	static ROMBlockCache * Acquire( const Cartridge * cart );
+	static void			   Release( ROMBlockCache * cache );
+
+	CodeBlock * Find( int romAddress );
+	// Returns the block that ended up in the cache, which is not the one passed in if another instance was faster
+	CodeBlock * Insert( int romAddress, CodeBlock * block );
+
+	~ROMBlockCache();
+};
+
+// Per instance decode cache: shared blocks for ROM, private blocks for code running from work RAM and high RAM
+struct BlockCache {
+	// Work RAM is addressed by its offset in Memory::workRAM, high RAM comes right after it
+	static constexpr uint32 highRAMCodeOffset = 0x8000;
+	static constexpr uint32 ramCodeSpace = highRAMCodeOffset + 0x80;
+	static constexpr int	maxBlockInstructions = 64;
+
+	ROMBlockCache *							   rom = nullptr;
+	std::unordered_map< uint32, CodeBlock * > ramBlocks;
+	std::vector< CodeBlock * >				   retiredBlocks;
+	uint64									   ramCodeBits[ ( ramCodeSpace + 63 ) / 64 ] = {};
+	// Bumped whenever the code visible to the CPU may have changed, a running block stops when it sees it move
+	uint32 generation = 0;
+
+	~BlockCache();
+
+	void			  AttachCartridge( const Cartridge * cart );
+	void			  FlushRAM();
+	const CodeBlock * Lookup( Gameboy * gb, uint16 PC );
+	// Same with the ROM offset of PC already resolved by the caller, -1 when PC is not in ROM or no bank is mapped there
+	const CodeBlock * Lookup( Gameboy * gb, uint16 PC, int romAddress );
+
+	bool IsRAMCode( uint32 ramAddress ) const { return ( ramCodeBits[ ramAddress / 64 ] >> ( ramAddress % 64 ) ) & 1; }
+	void InvalidateRAM( uint32 ramAddress );
+
+	// Memory and registers that only the CPU or a scheduled event can change
+	static bool IsStableRead( uint16 addr );
+	// Checks the reads of a mayBeIdleLoop block that depend on registers, with the values they have at its start
+	static bool IdleLoopReadsAreStable( const CodeBlock * block, const Cpu & cpu );
+
+private:
+	void RebuildRAMCodeBits();
+	void FreeRetiredBlocks();
+};
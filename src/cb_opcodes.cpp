@@ -2,7 +2,7 @@
 #include "cpu.h"
 #include "gameboy.h"
 
-static int CBopcodeCyclesCost[ 0x100 ] = {
+static constexpr int CBopcodeCyclesCost[ 0x100 ] = {
 //  0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f
 	2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2, // 0
 	2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2, // 1
@@ -26,10 +26,7 @@ byte Rlc( Cpu * cpu, byte val ) {
 	byte carry = val >> 7;
 	byte rot = ( ( val << 1 ) & 0xff ) | carry;
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( carry == 1 );
+	cpu->SetFlags( rot == 0, false, false, carry == 1 );
 	return rot;
 }
 
@@ -37,10 +34,7 @@ byte Rl( Cpu * cpu, byte val ) {
 	byte carry = val >> 7;
 	byte rot = (( val << 1 ) & 0xff ) | ( cpu->GetC() ? 1 : 0 );
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( carry == 1 );
+	cpu->SetFlags( rot == 0, false, false, carry == 1 );
 	return rot;
 }
 
@@ -48,10 +42,7 @@ byte Rrc( Cpu * cpu, byte val ) {
 	byte carry = val & 1;
 	byte rot = ( val >> 1 ) | ( carry << 7 );
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( carry == 1 );
+	cpu->SetFlags( rot == 0, false, false, carry == 1 );
 	return rot;
 }
 
@@ -59,10 +50,7 @@ byte Rr( Cpu * cpu, byte val ) {
 	byte carry = val & 1;
 	byte rot = ( val >> 1 ) | ( ( cpu->GetC() ? 1 : 0 ) << 7 );
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( carry == 1 );
+	cpu->SetFlags( rot == 0, false, false, carry == 1 );
 	return rot;
 }
 
@@ -70,123 +58,133 @@ byte Sla( Cpu * cpu, byte val ) {
 	byte carry = val >> 7;
 	byte rot = ( val << 1 ) & 0xff;
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( carry == 1 );
+	cpu->SetFlags( rot == 0, false, false, carry == 1 );
 	return rot;
 }
 
 byte Sra( Cpu * cpu, byte val ) {
 	byte rot = ( val & 0x80 ) | ( val >> 1 );
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( ( val & 1 ) == 1 );
+	cpu->SetFlags( rot == 0, false, false, ( val & 1 ) == 1 );
 	return rot;
 }
 
 byte Srl( Cpu * cpu, byte val ) {
 	byte rot = val >> 1;
 
-	cpu->SetZ( rot == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( ( val & 1 ) == 1 );
+	cpu->SetFlags( rot == 0, false, false, ( val & 1 ) == 1 );
 	return rot;
 }
 
 byte Swap( Cpu * cpu, byte val ) {
 	byte swapped = ( ( val << 4 ) & 0xf0 ) | ( val >> 4 );
-	cpu->SetZ( swapped == 0 );
-	cpu->SetN( false );
-	cpu->SetH( false );
-	cpu->SetC( false );
+	cpu->SetFlags( swapped == 0, false, false, false );
 	return swapped;
 }
 
 void Bit( Cpu * cpu, byte val, byte bit ) {
-	cpu->SetZ( ( ( val >> bit ) & 1 ) == 0 );
-	cpu->SetN( false );
-	cpu->SetH( true );
+	cpu->SetFlags( ( ( val >> bit ) & 1 ) == 0, false, true, cpu->GetC() );
 }
 
-int ExecuteCBOPCode( Cpu * cpu, uint16 opcode, Gameboy * gb ) {
-	uint16 opBase = opcode - ( opcode % 8 );
-	uint16 opOffset = opcode % 8;
+// The opcode is a template parameter so every register/operation test below is resolved at compile time,
+// leaving each table entry with only the work of its own instruction
+template < uint16 opcode >
+static int ExecuteCBOpcode( Cpu * cpu, Gameboy * gb ) {
+	constexpr uint16 opBase = opcode - ( opcode % 8 );
+	constexpr uint16 opOffset = opcode % 8;
 
 	byte input = 0;
-	if ( opOffset == 0 ) {
+	if constexpr ( opOffset == 0 ) {
 		input = cpu->BC.high.Get();
-	} else if ( opOffset == 1 ) {
+	} else if constexpr ( opOffset == 1 ) {
 		input = cpu->BC.low.Get();
-	} else if ( opOffset == 2 ) {
+	} else if constexpr ( opOffset == 2 ) {
 		input = cpu->DE.high.Get();
-	} else if ( opOffset == 3 ) {
+	} else if constexpr ( opOffset == 3 ) {
 		input = cpu->DE.low.Get();
-	} else if ( opOffset == 4 ) {
+	} else if constexpr ( opOffset == 4 ) {
 		input = cpu->HL.high.Get();
-	} else if ( opOffset == 5 ) {
+	} else if constexpr ( opOffset == 5 ) {
 		input = cpu->HL.low.Get();
-	} else if ( opOffset == 6 ) {
+	} else if constexpr ( opOffset == 6 ) {
 		input = gb->Read( cpu->HL.Get() );
-	} else if ( opOffset == 7 ) {
+	} else if constexpr ( opOffset == 7 ) {
 		input = cpu->A.Get();
 	}
 
 	byte output = 0;
-	bool hasOutput = true;
-	if ( opBase == 0x00 ) {
+	constexpr bool hasOutput = opBase < 0x40 || opBase >= 0x80;
+	if constexpr ( opBase == 0x00 ) {
 		output = Rlc( cpu, input );
-	} else if ( opBase == 0x08 ) {
+	} else if constexpr ( opBase == 0x08 ) {
 		output = Rrc( cpu, input );
-	} else if ( opBase == 0x10 ) {
+	} else if constexpr ( opBase == 0x10 ) {
 		output = Rl( cpu, input );
-	} else if ( opBase == 0x18 ) {
+	} else if constexpr ( opBase == 0x18 ) {
 		output = Rr( cpu, input );
-	} else if ( opBase == 0x20 ) {
+	} else if constexpr ( opBase == 0x20 ) {
 		output = Sla( cpu, input );
-	} else if ( opBase == 0x28 ) {
+	} else if constexpr ( opBase == 0x28 ) {
 		output = Sra( cpu, input );
-	} else if ( opBase == 0x30 ) {
+	} else if constexpr ( opBase == 0x30 ) {
 		output = Swap( cpu, input );
-	} else if ( opBase == 0x38 ) {
+	} else if constexpr ( opBase == 0x38 ) {
 		output = Srl( cpu, input );
-	} else if ( opBase >= 0x40 && opBase < 0x80 ) {
+	} else if constexpr ( opBase >= 0x40 && opBase < 0x80 ) {
 		// BIT instruction
-		byte bitValue = ( opBase - 0x40 ) / 8;
+		constexpr byte bitValue = ( opBase - 0x40 ) / 8;
 		Bit( cpu, input, bitValue );
-		hasOutput = false;
-	} else if ( opBase >= 0x80 && opBase < 0xc0 ) {
+	} else if constexpr ( opBase >= 0x80 && opBase < 0xc0 ) {
 		// RES instruction
-		byte bitValue = ( opBase - 0x80 ) / 8;
+		constexpr byte bitValue = ( opBase - 0x80 ) / 8;
 		output = BIT_UNSET( input, bitValue );
-	} else if ( opBase >= 0xc0 ) {
-		// RES instruction
-		byte bitValue = ( opBase - 0xc0 ) / 8;
+	} else if constexpr ( opBase >= 0xc0 ) {
+		// SET instruction
+		constexpr byte bitValue = ( opBase - 0xc0 ) / 8;
 		output = BIT_SET( input, bitValue );
 	}
 
-	if ( hasOutput ) {
-		if ( opOffset == 0 ) {
+	if constexpr ( hasOutput ) {
+		if constexpr ( opOffset == 0 ) {
 			cpu->BC.high.Set( output );
-		} else if ( opOffset == 1 ) {
+		} else if constexpr ( opOffset == 1 ) {
 			cpu->BC.low.Set( output );
-		} else if ( opOffset == 2 ) {
+		} else if constexpr ( opOffset == 2 ) {
 			cpu->DE.high.Set( output );
-		} else if ( opOffset == 3 ) {
+		} else if constexpr ( opOffset == 3 ) {
 			cpu->DE.low.Set( output );
-		} else if ( opOffset == 4 ) {
+		} else if constexpr ( opOffset == 4 ) {
 			cpu->HL.high.Set( output );
-		} else if ( opOffset == 5 ) {
+		} else if constexpr ( opOffset == 5 ) {
 			cpu->HL.low.Set( output );
-		} else if ( opOffset == 6 ) {
+		} else if constexpr ( opOffset == 6 ) {
 			gb->Write( cpu->HL.Get(), output );
-		} else if ( opOffset == 7 ) {
+		} else if constexpr ( opOffset == 7 ) {
 			cpu->A.Set( output );
 		}
 	}
 
 	return CBopcodeCyclesCost[ opcode ];
 }
+
+typedef int ( *CBOpcodeHandler )( Cpu * cpu, Gameboy * gb );
+
+#define CB_OPCODE_ROW( row )                                                                                   \
+	&ExecuteCBOpcode< row##0 >, &ExecuteCBOpcode< row##1 >, &ExecuteCBOpcode< row##2 >, &ExecuteCBOpcode< row##3 >, \
+		&ExecuteCBOpcode< row##4 >, &ExecuteCBOpcode< row##5 >, &ExecuteCBOpcode< row##6 >,                        \
+		&ExecuteCBOpcode< row##7 >, &ExecuteCBOpcode< row##8 >, &ExecuteCBOpcode< row##9 >,                        \
+		&ExecuteCBOpcode< row##a >, &ExecuteCBOpcode< row##b >, &ExecuteCBOpcode< row##c >,                        \
+		&ExecuteCBOpcode< row##d >, &ExecuteCBOpcode< row##e >, &ExecuteCBOpcode< row##f >
+
+static CBOpcodeHandler s_cbOpcodeHandlers[ 0x100 ] = {
+	CB_OPCODE_ROW( 0x0 ), CB_OPCODE_ROW( 0x1 ), CB_OPCODE_ROW( 0x2 ), CB_OPCODE_ROW( 0x3 ),
+	CB_OPCODE_ROW( 0x4 ), CB_OPCODE_ROW( 0x5 ), CB_OPCODE_ROW( 0x6 ), CB_OPCODE_ROW( 0x7 ),
+	CB_OPCODE_ROW( 0x8 ), CB_OPCODE_ROW( 0x9 ), CB_OPCODE_ROW( 0xa ), CB_OPCODE_ROW( 0xb ),
+	CB_OPCODE_ROW( 0xc ), CB_OPCODE_ROW( 0xd ), CB_OPCODE_ROW( 0xe ), CB_OPCODE_ROW( 0xf ),
+};
+
+#undef CB_OPCODE_ROW
+
+int ExecuteCBOPCode( Cpu * cpu, uint16 opcode, Gameboy * gb ) {
+	return s_cbOpcodeHandlers[ opcode ]( cpu, gb );
+}
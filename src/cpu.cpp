@@ -3,174 +3,180 @@
 #include "cb_opcodes.h"
 #include "gameboy.h"
 
-static int opcodeCyclesCost[] = {
-//  0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f
-	1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1, // 0
-	0, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1, // 1
-	2, 3, 2, 2, 1, 1, 2, 1, 2, 2, 2, 2, 1, 1, 2, 1, // 2
-	2, 3, 2, 2, 3, 3, 3, 1, 2, 2, 2, 2, 1, 1, 2, 1, // 3
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 4
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 5
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 6
-	2, 2, 2, 2, 2, 2, 0, 2, 1, 1, 1, 1, 1, 1, 2, 1, // 7
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 8
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 9
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // a
-	1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // b
-	2, 3, 3, 4, 3, 4, 2, 4, 2, 4, 3, 0, 3, 6, 2, 4, // c
-	2, 3, 3, 0, 3, 4, 2, 4, 2, 4, 3, 0, 3, 0, 2, 4, // d
-	3, 3, 2, 0, 0, 4, 2, 4, 4, 1, 4, 0, 0, 0, 2, 4, // e
-	3, 3, 2, 1, 0, 4, 2, 4, 3, 2, 4, 1, 0, 0, 2, 4, // f
-};
-
 // Return Cycles used
 int Cpu::ExecuteNextOPCode( Gameboy * gb ) {
 	// All instructions are detailled here : https://www.pastraiser.com/cpu/gameboy/gameboy_opcodes.html
-	byte	opcode = PopPC( gb );
-	int		ticksUsed = opcodeCyclesCost[ opcode ] * 4;
-	additionnalTicks = 0;
+	byte opcode = PopPC( gb );
 	lastInstructionOpCode = opcode;
 
 	if (gb->dumpOPcodesToStdout) {
 		printf("0x%02x 0x%04x\n", opcode, PC - 1);
 	}
 
-	ExecuteInstruction( opcode, gb );
-	return ticksUsed + additionnalTicks;
+	return ExecuteInstruction( opcode, gb );
 }
 
-void Cpu::UpdateTimer( int clock, Gameboy * gb ) {
-	divider += clock;
-	if ( divider >= 255 ) {
-		divider -= 255;
-		if (gb->mem.highRAM[ DIV - 0xFF00 ] == 0xff) {
-			gb->mem.highRAM[ DIV - 0xFF00 ] = 0;
-		} else {
-			gb->mem.highRAM[ DIV - 0xFF00 ]++;
-		}
-	}
-
-	byte			tac = gb->Read( TAC );
+static int TimerThreshold( byte tac ) {
 	byte			frequency = MAX(tac & 3, 3);
 	constexpr int	threshold[ 4 ] = { 1024, 16, 64, 256 };
+	return threshold[ frequency ];
+}
+
+// DIV steps every 255 clocks and TIMA every time clockCounter goes past the threshold, at most once per instruction.
+// Both are plain functions of the clocks elapsed since timerBaseTime, so they are only brought up to date when read
+// or written, and the only event left is TIMA overflowing
+void Cpu::SyncTimer( Gameboy * gb ) {
+	uint64 elapsed = gb->scheduler.now - timerBaseTime;
+	timerBaseTime = gb->scheduler.now;
+
+	uint64 dividerTotal = divider + elapsed;
+	gb->mem.highRAM[ DIV - 0xFF00 ] += ( byte )( dividerTotal / 255 );
+	divider = ( int )( dividerTotal % 255 );
 
-	if ( !BIT_IS_SET( tac, 2 ) )
+	byte tac = gb->mem.highRAM[ TAC - 0xFF00 ];
+	if ( !BIT_IS_SET( tac, 2 ) ) {
 		return;
+	}
+	uint64 threshold = TimerThreshold( tac );
+	uint64 counterTotal = clockCounter + elapsed;
+	uint64 steps = counterTotal > 0 ? ( counterTotal - 1 ) / threshold : 0;
+	gb->mem.highRAM[ TIMA - 0xFF00 ] += ( byte )steps;
+	clockCounter = ( int )( counterTotal - steps * threshold );
+}
+
+void Cpu::ScheduleTimer( Gameboy * gb ) {
+	byte tac = gb->mem.highRAM[ TAC - 0xFF00 ];
+	if ( !BIT_IS_SET( tac, 2 ) ) {
+		gb->scheduler.Cancel( EVENT_TIMER );
+		return;
+	}
+	// End of the instruction during which the step taking TIMA past 0xFF happens
+	uint64 stepsToOverflow = 0x100 - gb->mem.highRAM[ TIMA - 0xFF00 ];
+	gb->scheduler.Schedule( EVENT_TIMER, timerBaseTime + stepsToOverflow * TimerThreshold( tac ) - clockCounter + 1 );
+}
+
+void Cpu::UpdateTimer( Gameboy * gb ) {
+	SyncTimer( gb );
+	gb->mem.highRAM[ TIMA - 0xFF00 ] = gb->mem.highRAM[ TMA - 0xFF00 ];
+	gb->RaiseInterupt( 2 );
+	ScheduleTimer( gb );
+}
 
-	clockCounter += clock;
-	if ( clockCounter > threshold[ frequency ] ) {
-		clockCounter -= threshold[ frequency ];
-		byte tima = gb->Read( TIMA );
-		if ( tima == 0xFF ) {
-			gb->mem.highRAM[ TIMA - 0xFF00 ] = gb->Read( TMA );
-			gb->RaiseInterupt( 2 );
-		} else {
-			gb->mem.highRAM[ TIMA - 0xFF00 ] = tima + 1;
+void Cpu::ComputeFlags() {
+	byte left = flagsLeft;
+	byte right = flagsRight;
+	byte carry = flagsCarry;
+	bool z = false, n = false, h = false, c = false;
+	switch ( flagsOperation ) {
+		case FLAGS_ADD: {
+			int16 total = left + right + carry;
+			z = (byte)total == 0;
+			h = ( right & 0xF ) + ( left & 0xF ) + carry > 0xF;
+			c = total > 0xFF;
+			break;
+		}
+		case FLAGS_SUB: {
+			int16 total = left - right - carry;
+			z = (byte)total == 0;
+			n = true;
+			h = ( int16 )( left & 0xF ) - ( right & 0xF ) - carry < 0;
+			c = total < 0;
+			break;
 		}
+		case FLAGS_AND:
+			// left holds the result
+			z = left == 0;
+			h = true;
+			break;
+		case FLAGS_OR_XOR:
+			z = left == 0;
+			break;
+		case FLAGS_CP:
+			z = ( byte )( right - left ) == 0;
+			n = true;
+			h = ( left & 0x0f ) < ( right & 0x0f );
+			c = left < right;
+			break;
+		case FLAGS_INC:
+			// INC and DEC keep the carry, the flags were materialized before recording them
+			z = ( byte )( left + 1 ) == 0;
+			h = ( left & 0x0f ) + 1 > 0x0f;
+			c = BIT_IS_SET( F.Get(), 4 );
+			break;
+		case FLAGS_DEC:
+			z = ( byte )( left - 1 ) == 0;
+			n = true;
+			h = ( left & 0x0f ) == 0x0;
+			c = BIT_IS_SET( F.Get(), 4 );
+			break;
+		default:
+			return;
 	}
+	SetFlags( z, n, h, c );
 }
 
 void Cpu::Add( Register8 & reg, byte val, bool useCarry ) {
-	byte	valReg = reg.Get();
-	byte	carry = GetC() && useCarry ? 1 : 0;
-	int16	total = valReg + val + carry;
-	reg.Set( (byte)total );
-
-	SetZ( (byte)total == 0 );
-	SetN( false );
-	SetH( ( val & 0xF ) + ( valReg & 0xF ) + carry > 0xF );
-	SetC( total > 0xFF );
+	byte valReg = reg.Get();
+	byte carry = useCarry && GetC() ? 1 : 0;
+	reg.Set( valReg + val + carry );
+	RecordFlags( FLAGS_ADD, valReg, val, carry );
 }
 
 void Cpu::Sub( Register8 & reg, byte val, bool useCarry ) {
-	byte	valReg = reg.Get();
-	byte	carry = GetC() && useCarry ? 1 : 0;
-	int16	total = valReg - val - carry;
-	reg.Set( (byte)total );
-
-	SetZ( (byte)total == 0 );
-	SetN( true );
-	SetH( ( int16 )( valReg & 0xF ) - ( val & 0xF ) - carry < 0 );
-	SetC( total < 0 );
+	byte valReg = reg.Get();
+	byte carry = useCarry && GetC() ? 1 : 0;
+	reg.Set( valReg - val - carry );
+	RecordFlags( FLAGS_SUB, valReg, val, carry );
 }
 
 void Cpu::And( Register8 & reg, byte val ) {
-	byte valReg = reg.Get();
-	byte total = valReg & val;
+	byte total = reg.Get() & val;
 	reg.Set( total );
-
-	SetZ( total == 0 );
-	SetN( false );
-	SetH( true );
-	SetC( false );
+	RecordFlags( FLAGS_AND, total, 0, 0 );
 }
 
 void Cpu::Or( Register8 & reg, byte val ) {
-	byte valReg = reg.Get();
-	byte total = valReg | val;
+	byte total = reg.Get() | val;
 	reg.Set( total );
-
-	SetZ( total == 0 );
-	SetN( false );
-	SetH( false );
-	SetC( false );
+	RecordFlags( FLAGS_OR_XOR, total, 0, 0 );
 }
 
 void Cpu::Xor( Register8 & reg, byte val ) {
-	byte valReg = reg.Get();
-	byte total = valReg ^ val;
+	byte total = reg.Get() ^ val;
 	reg.Set( total );
-
-	SetZ( total == 0 );
-	SetN( false );
-	SetH( false );
-	SetC( false );
+	RecordFlags( FLAGS_OR_XOR, total, 0, 0 );
 }
 
 void Cpu::Cp( Register8 & reg, byte val ) {
-	byte valReg = reg.Get();
-	byte total = val - valReg;
-	SetZ( total == 0 );
-	SetN( true );
-	SetH( ( valReg & 0x0f ) < ( val & 0x0f ) );
-	SetC( valReg < val );
+	RecordFlags( FLAGS_CP, reg.Get(), val, 0 );
 }
 
 void Cpu::Inc( Register8 & reg ) {
 	byte valReg = reg.Get();
-	byte total = valReg + 1;
-	reg.Set( total );
-	SetZ( total == 0 );
-	SetN( false );
-	SetH( ( valReg & 0x0f ) + 1 > 0x0f );
+	reg.Set( valReg + 1 );
+	MaterializeFlags();
+	RecordFlags( FLAGS_INC, valReg, 0, 0 );
 }
 
 void Cpu::Dec( Register8 & reg ) {
 	byte valReg = reg.Get();
-	byte total = valReg - 1;
-	reg.Set( total );
-	SetZ( total == 0 );
-	SetN( true );
-	SetH( ( valReg & 0x0f ) == 0x0 );
+	reg.Set( valReg - 1 );
+	MaterializeFlags();
+	RecordFlags( FLAGS_DEC, valReg, 0, 0 );
 }
 
 void Cpu::Add16( Register16 & reg, uint16 val ) {
 	uint16	valReg = reg.Get();
 	int		total = valReg + val;
 	reg.Set( (uint16)total );
-	SetN( false );
-	SetH( (int)( valReg & 0xfff ) > ( total & 0xfff ) );
-	SetC( total > 0xffff );
+	SetFlags( GetZ(), false, (int)( valReg & 0xfff ) > ( total & 0xfff ), total > 0xffff );
 }
 
 void Cpu::Add16Signed( Register16 & reg, int8 val ) {
 	uint16 valReg = reg.Get();
 	uint16 total = (int)valReg + (int)val;
 	reg.Set( total );
-	SetZ( false );
-	SetN( false );
-	SetH( ( ( valReg ^ val ^ total ) & 0x10 ) == 0x10 );
-	SetC( ( ( valReg ^ val ^ total ) & 0x100 ) == 0x100 );
+	SetFlags( false, false, ( ( valReg ^ val ^ total ) & 0x10 ) == 0x10, ( ( valReg ^ val ^ total ) & 0x100 ) == 0x100 );
 }
 
 void Cpu::Inc16( Register16 & reg ) {
@@ -193,16 +199,14 @@ void Cpu::Ret( Gameboy * gb ) {
 }
 
 byte Cpu::PopPC( Gameboy * gb ) {
-	byte opcode = gb->Read( PC );
+	byte opcode = decodedOperands != nullptr ? *decodedOperands++ : gb->Read( PC );
 	PC++;
 	return opcode;
 }
 
 uint16 Cpu::PopPC16( Gameboy * gb ) {
-	byte val1 = gb->Read( PC );
-	PC++;
-	byte val2 = gb->Read( PC );
-	PC++;
+	byte val1 = PopPC( gb );
+	byte val2 = PopPC( gb );
 	return ( (uint16)val2 << 8 ) | val1;
 }
 
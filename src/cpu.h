@@ -4,37 +4,69 @@
 
 struct Gameboy;
 
-struct Register8 {
-	byte mask = 0xFF;
+// One byte register. Only F has bits that always read 0, the mask is a template parameter so the others store as is
+template < byte mask >
+struct MaskedRegister8 {
+	byte value;
 
-	byte Get() { return value; }
+	byte Get() const { return value; }
 	void Set( uint8 newVal ) {
-		value = newVal & mask;
+		if constexpr ( mask == 0xFF ) {
+			value = newVal;
+		} else {
+			value = newVal & mask;
+		}
 	}
-
-private:
-	byte value = 0x0;
+	// Where the value lives, used by the JIT to address registers directly
+	byte * ValuePtr() { return &value; }
 };
 
-struct Register16 {
-	Register8 high;
-	Register8 low;
+typedef MaskedRegister8< 0xFF > Register8;
+typedef MaskedRegister8< 0xF0 > FlagRegister;
 
-	void Set( uint16 val ) {
-		high.Set( val >> 8 );
-		low.Set( val & 0xFF );
-	}
+// Register pair, the 16 bit view and the two 8 bit halves share storage (little endian hosts only)
+union Register16 {
+	uint16 value;
+	struct {
+		Register8 low;
+		Register8 high;
+	};
 
-	uint16 Get() { return ( (uint16)high.Get() << 8 ) + low.Get(); }
+	uint16 Get() const { return value; }
+	void   Set( uint16 val ) { value = val; }
+};
+static_assert( sizeof( Register16 ) == 2, "Register pairs must be packed" );
+
+// Last flag setting operation, kept by the lazy flags until something reads F
+enum FlagsOperation : byte {
+	FLAGS_NONE,
+	FLAGS_ADD,
+	FLAGS_SUB,
+	FLAGS_AND,
+	FLAGS_OR_XOR,
+	FLAGS_CP,
+	FLAGS_INC,
+	FLAGS_DEC,
 };
 
 struct Cpu {
-	static const char * s_instructionsNames[ 0x100 ];
-	static byte			s_instructionsSize[ 0x100 ];
-	byte				lastInstructionOpCode = 0;
+	typedef int ( Cpu::*OpcodeHandler )( Gameboy * gb );
 
-	Register8	A;
-	Register8	F;
+	static const char *	 s_instructionsNames[ 0x100 ];
+	static byte			 s_instructionsSize[ 0x100 ];
+	static OpcodeHandler s_opcodeHandlers[ 0x100 ];
+	byte				lastInstructionOpCode = 0;
+	// Operand bytes fetched by the block cache, PopPC reads them instead of the bus when set
+	const byte *		decodedOperands = nullptr;
+
+	union {
+		struct {
+			FlagRegister F;
+			Register8	 A;
+		};
+		// Raw pair, F may be behind the lazy flags, GetAF() is up to date
+		uint16 AF;
+	};
 	Register16	BC;
 	Register16	DE;
 	Register16	HL;
@@ -42,11 +74,12 @@ struct Cpu {
 	Register16	SP;
 	uint16		PC;
 
-	int additionnalTicks;
 	int cpuTime;
 	int divider;
 	int speed;
 	int clockCounter;
+	// divider and clockCounter are as of this time on the scheduler clock
+	uint64 timerBaseTime;
 
 	bool interuptsEnabled = true;
 	bool interuptsOn = false;
@@ -55,12 +88,20 @@ struct Cpu {
 
 	bool IsCGB = false;
 
+	// Lazy flags: ALU operations only record their operands, Z N H C are computed when read
+	bool useLazyFlags = true;
+	byte flagsOperation = FLAGS_NONE;
+	byte flagsLeft = 0;
+	byte flagsRight = 0;
+	byte flagsCarry = 0;
+
 	void Reset( bool skipBios, bool isCGB ) {
 		if ( skipBios ) {
 			PC = 0x100;
 		} else {
 			PC = 0x0;
 		}
+		flagsOperation = FLAGS_NONE;
 		if ( isCGB ) {
 			A.Set(0x11);
 			F.Set(0x80);
@@ -72,18 +113,18 @@ struct Cpu {
 		DE.Set( 0xFF56 );
 		HL.Set( 0x000D );
 		SP.Set( 0xFFFE );
-		F.mask = 0xF0;
 
 		IsCGB = isCGB;
 		speed = 1;
 		divider = 0;
-		additionnalTicks = 0;
 		interuptsEnabled = false;
 		interuptsOn = false;
 		isOnHalt = false;
 		speedSwitchRequested = false;
 		clockCounter = 0;
+		timerBaseTime = 0;
 		cpuTime = 0;
+		decodedOperands = nullptr;
 	}
 
 	int		ExecuteNextOPCode( Gameboy * gb );
@@ -104,14 +145,50 @@ struct Cpu {
 	void	Ret( Gameboy * gb );
 	int		ProcessInterupts( Gameboy * gb );
 	void	Halt();
-	void	UpdateTimer( int cycles, Gameboy * gb );
+	// Reloads TIMA from TMA, run by the scheduler when it overflows
+	void	UpdateTimer( Gameboy * gb );
+	// Brings divider and clockCounter up to the scheduler clock
+	void	SyncTimer( Gameboy * gb );
+	void	ScheduleTimer( Gameboy * gb );
 
 	void Add16( Register16 & reg, uint16 val );
 	void Add16Signed( Register16 & reg, int8 val );
 	void Inc16( Register16 & reg );
 	void Dec16( Register16 & reg );
 
+	void RecordFlags( FlagsOperation operation, byte left, byte right, byte carry ) {
+		flagsOperation = operation;
+		flagsLeft = left;
+		flagsRight = right;
+		flagsCarry = carry;
+		if ( !useLazyFlags ) {
+			ComputeFlags();
+		}
+	}
+	void ComputeFlags();
+	void MaterializeFlags() {
+		if ( flagsOperation != FLAGS_NONE ) {
+			ComputeFlags();
+		}
+	}
+
+	uint16 GetAF() { return ( (uint16)A.Get() << 8 ) | GetF(); }
+	byte GetF() {
+		MaterializeFlags();
+		return F.Get();
+	}
+	void SetF( byte val ) {
+		flagsOperation = FLAGS_NONE;
+		F.Set( val );
+	}
+	// Overwrites the four flags at once, whatever was pending is dropped
+	void SetFlags( bool z, bool n, bool h, bool c ) {
+		flagsOperation = FLAGS_NONE;
+		F.Set( ( z ? 0x80 : 0 ) | ( n ? 0x40 : 0 ) | ( h ? 0x20 : 0 ) | ( c ? 0x10 : 0 ) );
+	}
+
 	void SetFlag( uint8 index, bool val ) {
+		MaterializeFlags();
 		if ( val == true ) {
 			F.Set( BIT_SET( F.Get(), index ) );
 		} else {
@@ -124,12 +201,17 @@ struct Cpu {
 	void SetH( bool val ) { SetFlag( 5, val ); }
 	void SetC( bool val ) { SetFlag( 4, val ); }
 
-	bool GetZ() { return BIT_IS_SET( F.Get(), 7 ); }
-	bool GetN() { return BIT_IS_SET( F.Get(), 6 ); }
-	bool GetH() { return BIT_IS_SET( F.Get(), 5 ); }
-	bool GetC() { return BIT_IS_SET( F.Get(), 4 ); }
+	bool GetZ() { return BIT_IS_SET( GetF(), 7 ); }
+	bool GetN() { return BIT_IS_SET( GetF(), 6 ); }
+	bool GetH() { return BIT_IS_SET( GetF(), 5 ); }
+	bool GetC() { return BIT_IS_SET( GetF(), 4 ); }
+
+	// Returns the clocks used by the instruction
+	int ExecuteInstruction( byte opcode, Gameboy * gb ) { return ( this->*s_opcodeHandlers[ opcode ] )( gb ); }
 
-	void ExecuteInstruction( byte opcode, Gameboy * gb );
+	// Specialized once per opcode in opcodes.cpp
+	template < byte opcode >
+	int ExecuteOpcode( Gameboy * gb );
 };
 
 int ExecuteCBOPCode( Cpu * cpu, uint16 opcode, Gameboy * gb );
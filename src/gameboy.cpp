@@ -1,285 +1,327 @@
 #include <stdlib.h>
-#include <algorithm>
 #include <stdio.h>
 #include "gameboy.h"
-#include <imgui/imgui.h>
-#include <imgui/imgui_memory_editor.h>
 
-static MemoryEditor mem_edit;
-
-void Gameboy::RunOneFrame() {
+template < typename Mapper >
+void Gameboy::RunFrame() {
+	if ( jit.reference != nullptr ) {
+		jit.SyncReferenceFrame( this );
+	}
 	cpu.cpuTime = 0;
 	constexpr int maxClocksThisFrame = GBEMU_CLOCK_SPEED / 60;
 
 	while ( cpu.cpuTime < maxClocksThisFrame * cpu.speed && ( shouldRun || shouldStep ) ) {
-		int clocks = 4;
-		if ( !cpu.isOnHalt ) {
-			clocks = cpu.ExecuteNextOPCode( this );
-			totalInstructions++;
+		if ( !cpu.isOnHalt && useBlockCache && !shouldStep && !dumpOPcodesToStdout ) {
+			int romAddress = cpu.PC < 0x8000 && cart != nullptr ? static_cast< Mapper * >( cart )->DebugResolvePC( cpu.PC ) : -1;
+			const CodeBlock * block = blockCache.Lookup( this, cpu.PC, romAddress );
+			if ( block != nullptr ) {
+				bool   watchIdleLoop = skipIdleLoops && block->mayBeIdleLoop && cpu.PC == block->startPC;
+				Cpu	   before;
+				uint64 instructionsBefore = totalInstructions;
+				uint64 deadlineBefore = scheduler.nextDeadline;
+				if ( watchIdleLoop ) {
+					before = cpu;
+				}
+				if ( !useJit || !jit.Run( this, block, maxClocksThisFrame * cpu.speed ) ) {
+					RunBlock( block, maxClocksThisFrame * cpu.speed );
+				}
+				if ( watchIdleLoop ) {
+					SkipIdleLoop( block, before, instructionsBefore, deadlineBefore, maxClocksThisFrame * cpu.speed );
+				}
+				continue;
+			}
 		}
-		cpu.cpuTime += clocks;
-		ppu.Update( clocks, this );
-		cpu.UpdateTimer( clocks, this );
-		cpu.cpuTime += cpu.ProcessInterupts( this );
-		if ( PCBreakpoint == cpu.PC || instructionCountBreakpoint == totalInstructions ) {
-			shouldRun = false;
+
+		if ( cpu.isOnHalt && skipHaltedClocks && !shouldStep ) {
+			SkipHaltedClocks( maxClocksThisFrame * cpu.speed );
 		}
+		StepInstruction();
 		shouldStep = false;
 	}
 }
 
-void Gameboy::Reset() {
-	if ( cart == nullptr ) {
-		return;
+void Gameboy::StepInstruction() {
+	int clocks = 4;
+	if ( !cpu.isOnHalt ) {
+		clocks = cpu.ExecuteNextOPCode( this );
+		totalInstructions++;
 	}
-	totalInstructions = 0;
-	ResetMemory();
-	if ( cart->mode == DMG || (cart->mode == CGB_DMG && Cartridge::forceDMGMode )) {
-		cpu.Reset( skipBios, false);
-	} else {
-		cpu.Reset( skipBios, true);
-	}
-	ppu.Reset();
-
-	apu.reset();
-	soundBuffer.clear();
-	sound.stop();
-	gbemu_assert( sound.start( sample_rate, 2 ) == nullptr );
+	FinishInstruction( clocks );
 }
 
-void Gameboy::LoadCart( const char * path ) {
-	if ( cart != nullptr ) {
-		delete cart;
+void Gameboy::SkipHaltedClocks( int clockBudget ) {
+	if ( cpu.interuptsEnabled || ( mem.highRAM[ 0x0f ] & mem.highRAM[ 0xff ] & 0x1f ) != 0 ) {
+		// The CPU is about to wake up
+		return;
 	}
-	cart = Cartridge::LoadFromFile( path );
-	Reset();
-}
-
-void Gameboy::SerializeSaveState( const char * path ) {
-	FILE * fh = fopen( path, "wb" );
-	if ( fh == nullptr ) {
-		printf( "Could not find save state file %s\n", path );
-		DEBUG_BREAK;
+	if ( PCBreakpoint == cpu.PC || ( instructionCountBreakpoint != 0 && instructionCountBreakpoint == totalInstructions ) ||
+		 scheduler.nextDeadline <= scheduler.now ) {
 		return;
 	}
-	fwrite( &cpu, sizeof( Cpu ), 1, fh );
-	fwrite( &mem, sizeof( Memory ), 1, fh );
-	fwrite( &ppu.scanlineCounter, sizeof( int ), 1, fh );
-
-	fclose( fh );
+	// Only an event can raise an interrupt while halted. Skip the steps that end before the next one, and before the end
+	// of the frame, the step reaching either runs as usual
+	uint64 untilEvent = scheduler.nextDeadline - scheduler.now;
+	uint64 untilBudget = clockBudget - cpu.cpuTime;
+	uint64 steps = MIN( ( untilEvent - 1 ) / 4, ( untilBudget - 1 ) / 4 );
+	int	   clocks = ( int )steps * 4;
+	cpu.cpuTime += clocks;
+	scheduler.now += clocks;
+	skippedHaltClocks += clocks;
 }
 
-void Gameboy::LoadSaveState( const char * path ) {
-	FILE * fh = fopen( path, "rb" );
-	if ( fh == nullptr ) {
-		printf( "Could not find save state file %s\n", path );
-		DEBUG_BREAK;
+void Gameboy::SkipIdleLoop( const CodeBlock * block, Cpu & before, uint64 instructionsBefore, uint64 deadlineBefore,
+							int clockBudget ) {
+	// The pass has to be complete, without interrupt, event or anything pending that could change the next one
+	if ( cpu.PC != block->startPC || totalInstructions - instructionsBefore != block->instructions.size() ) {
+		return;
+	}
+	if ( scheduler.now >= deadlineBefore || scheduler.now >= scheduler.nextDeadline || cpu.cpuTime >= clockBudget || cpu.interuptsEnabled ||
+		 cpu.isOnHalt ) {
+		return;
+	}
+	if ( PCBreakpoint >= 0 || instructionCountBreakpoint != 0 ) {
+		return;
+	}
+	if ( cpu.GetAF() != before.GetAF() || cpu.BC.Get() != before.BC.Get() || cpu.DE.Get() != before.DE.Get() ||
+		 cpu.HL.Get() != before.HL.Get() || cpu.SP.Get() != before.SP.Get() || cpu.interuptsOn != before.interuptsOn ) {
+		return;
+	}
+	if ( !BlockCache::IdleLoopReadsAreStable( block, cpu ) ) {
 		return;
 	}
 
-	fread( &cpu, sizeof( Cpu ), 1, fh );
-	fread( &mem, sizeof( Memory ), 1, fh );
-	fread( &ppu.scanlineCounter, sizeof( int ), 1, fh );
-
-	fclose( fh );
+	// Same as for a halted CPU: the pass reaching the next event or the end of the frame runs as usual
+	int	   passClocks = cpu.cpuTime - before.cpuTime;
+	uint64 untilEvent = scheduler.nextDeadline - scheduler.now;
+	uint64 untilBudget = clockBudget - cpu.cpuTime;
+	uint64 passes = MIN( ( untilEvent - 1 ) / passClocks, ( untilBudget - 1 ) / passClocks );
+	int	   clocks = ( int )passes * passClocks;
+	cpu.cpuTime += clocks;
+	scheduler.now += clocks;
+	totalInstructions += passes * block->instructions.size();
+	skippedIdleLoopClocks += clocks;
 }
 
-void Gameboy::DebugDraw() {
-	static float volume = 50.0f;
-	if ( ImGui::SliderFloat( "Volume", &volume, 0.0f, 100.0f ) ) {
-		if ( volume > 100.0f ) {
-			volume = 100.0f;
+void Gameboy::RunBlock( const CodeBlock * block, int clockBudget, size_t first ) {
+	uint32 generation = blockCache.generation;
+	for ( size_t i = first; i < block->instructions.size(); i++ ) {
+		const DecodedInstruction & instruction = block->instructions[ i ];
+		if ( cpu.PC != instruction.pc ) {
+			// An interrupt was serviced
+			break;
 		}
-		apu.volume( volume / 100 );
-	}
-	ImGui::Text( "Cpu speed: %d\n", cpu.speed );
-	ImGui::Columns( 4, "registers" );
-	ImGui::Separator();
-	ImGui::Text( "A" );
-	ImGui::NextColumn();
-	ImGui::Text( "F" );
-	ImGui::NextColumn();
-	ImGui::Text( "B" );
-	ImGui::NextColumn();
-	ImGui::Text( "C" );
-	ImGui::NextColumn();
-	ImGui::Separator();
-	ImGui::Text( "0x%02x", cpu.A.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.F.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.BC.high.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.BC.low.Get() );
-	ImGui::NextColumn();
-	ImGui::Columns( 2, "registers 16bits" );
-	ImGui::Separator();
-	ImGui::Text( "0x%04x", ( uint16 )( cpu.A.Get() << 8 ) | ( cpu.F.Get() ) );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%04x", cpu.BC.Get() );
-	ImGui::NextColumn();
-	ImGui::Columns( 4, "registers" );
-	ImGui::Separator();
-	ImGui::Text( "D" );
-	ImGui::NextColumn();
-	ImGui::Text( "E" );
-	ImGui::NextColumn();
-	ImGui::Text( "H" );
-	ImGui::NextColumn();
-	ImGui::Text( "L" );
-	ImGui::NextColumn();
-	ImGui::Separator();
-	ImGui::Text( "0x%02x", cpu.DE.high.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.DE.low.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.HL.high.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%02x", cpu.HL.low.Get() );
-	ImGui::NextColumn();
-	ImGui::Columns( 2, "registers 16bits" );
-	ImGui::Separator();
-	ImGui::Text( "0x%04x", cpu.DE.Get() );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%04x", cpu.HL.Get() );
-	ImGui::NextColumn();
-	ImGui::Columns( 2, "PC and SP" );
-	ImGui::Separator();
-	ImGui::Text( "PC" );
-	ImGui::NextColumn();
-	ImGui::Text( "SP" );
-	ImGui::NextColumn();
-	ImGui::Separator();
-	ImGui::Text( "0x%04x", cpu.PC );
-	ImGui::NextColumn();
-	ImGui::Text( "0x%04x", cpu.SP.Get() );
-	ImGui::NextColumn();
-	ImGui::Columns( 4, "flags" );
-	ImGui::Separator();
-	ImGui::Text( "Z" );
-	ImGui::NextColumn();
-	ImGui::Text( "N" );
-	ImGui::NextColumn();
-	ImGui::Text( "H" );
-	ImGui::NextColumn();
-	ImGui::Text( "C" );
-	ImGui::NextColumn();
-	ImGui::Separator();
-	ImGui::Text( "%d", cpu.GetZ() );
-	ImGui::NextColumn();
-	ImGui::Text( "%d", cpu.GetN() );
-	ImGui::NextColumn();
-	ImGui::Text( "%d", cpu.GetH() );
-	ImGui::NextColumn();
-	ImGui::Text( "%d", cpu.GetC() );
-	ImGui::NextColumn();
+		cpu.lastInstructionOpCode = instruction.opcode;
+		cpu.PC++;
+		cpu.decodedOperands = instruction.operands;
+		int clocks = ( cpu.*instruction.handler )( this );
+		cpu.decodedOperands = nullptr;
+		totalInstructions++;
+		FinishInstruction( clocks );
 
-	ImGui::Columns( 1 );
-	ImGui::Separator();
-	ImGui::Text( "Last instruction: %s", Cpu::s_instructionsNames[ cpu.lastInstructionOpCode ] );
-	ImGui::Text( "Next instruction: %s", Cpu::s_instructionsNames[ Read( cpu.PC ) ] );
-	ImGui::Checkbox( "Skip bios", &skipBios );
-	ImGui::SameLine();
-	ImGui::Checkbox( "Print OPCodes", &dumpOPcodesToStdout );
+		if ( cpu.isOnHalt || !shouldRun || cpu.cpuTime >= clockBudget || generation != blockCache.generation ) {
+			break;
+		}
+	}
+}
 
-	ImGui::Text("Total instructions: %lld", totalInstructions);
+void Gameboy::StallCpu( int clocks ) {
+	// In 4 clock steps like a halted CPU, so every event runs in the step it falls in
+	for ( ; clocks > 0; clocks -= 4 ) {
+		cpu.cpuTime += 4;
+		scheduler.now += 4;
+		if ( scheduler.now >= scheduler.nextDeadline ) {
+			RunScheduledEvents( 4 );
+		}
+	}
+}
 
-	static char PCBreakpointStr[ 64 ] = "";
-	ImGui::InputText( "Break at PC: ", PCBreakpointStr, 64, ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase );
-	if ( PCBreakpointStr[ 0 ] != '\0' ) {
-		PCBreakpoint = strtol( PCBreakpointStr, nullptr, 16 );
+void Gameboy::FinishInstruction( int clocks ) {
+	cpu.cpuTime += clocks;
+	scheduler.now += clocks;
+	if ( scheduler.now >= scheduler.nextDeadline ) {
+		RunScheduledEvents( clocks );
 	}
-	static char InstructionBreakpointStr[ 64 ] = "";
-	ImGui::InputText( "Break at instruction Count: ", InstructionBreakpointStr, 64, ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase );
-	if ( InstructionBreakpointStr[ 0 ] != '\0' ) {
-		instructionCountBreakpoint = strtoull( InstructionBreakpointStr, nullptr, 10 );
+	if ( cpu.interuptsEnabled || ( ( cpu.interuptsOn || cpu.isOnHalt ) && ( mem.highRAM[ 0x0f ] & mem.highRAM[ 0xff ] & 0x1f ) != 0 ) ) {
+		cpu.cpuTime += cpu.ProcessInterupts( this );
 	}
-
-	if ( ImGui::Button( "Step" ) ) {
-		shouldStep = true;
+	// 0 is no breakpoint, a machine loaded from a save state can be halted before its first instruction
+	if ( PCBreakpoint == cpu.PC || ( instructionCountBreakpoint != 0 && instructionCountBreakpoint == totalInstructions ) ) {
+		shouldRun = false;
 	}
+}
 
-	static int showRomCode = false;
-	if ( ImGui::Button( showRomCode ? "Hide ROM Code" : "Show ROM Code" ) ) {
-		showRomCode = !showRomCode;
+void Gameboy::RunScheduledEvents( int clocks ) {
+	uint64 instructionStart = scheduler.now - clocks;
+	// Same order as when everything was updated after each instruction: STAT, then LY, then the timer
+	if ( scheduler.deadlines[ EVENT_PPU_STATUS ] <= instructionStart ) {
+		ppu.UpdateStatus( this, instructionStart );
 	}
-	ImGui::SameLine();
-	if ( ImGui::Button( "Generate ROM Code" ) && cart != nullptr ) {
-		cart->GenerateSourceCode();
+	if ( scheduler.deadlines[ EVENT_PPU_LINE ] <= scheduler.now ) {
+		ppu.AdvanceLine( this );
 	}
+	if ( scheduler.deadlines[ EVENT_TIMER ] <= scheduler.now ) {
+		cpu.UpdateTimer( this );
+	}
+}
 
-	static int showMemoryInspector = false;
-	if ( ImGui::TreeNode( "Memory" ) ) {
-		ImGui::TreePop();
-		ImGui::Text( "workRAM bank: %d", mem.workRAMBankIndex );
-		ImGui::Text( "VRAM bank: %d", mem.VRAMBankIndex );
-		ImGui::Text( "Input mask: %d", mem.inputMask );
-		ImGui::Text( "hdma length: %d", mem.hdmaLength );
-		ImGui::Text( "hdma active: %d", mem.hdmaActive );
-		if ( ImGui::Button( showMemoryInspector ? "Hide Memory" : "Show Memory" ) ) {
-			showMemoryInspector = !showMemoryInspector;
-		}
+// Restarts the scheduler clock from the current PPU and timer counters
+void Gameboy::ResetScheduler() {
+	scheduler.Reset();
+	ppu.scanlineBaseTime = 0;
+	ppu.lcdRunning = false;
+	cpu.timerBaseTime = 0;
+	scheduler.Schedule( EVENT_PPU_STATUS, 0 );
+	cpu.ScheduleTimer( this );
+}
+
+void Gameboy::Reset() {
+	if ( cart == nullptr ) {
+		return;
 	}
+	totalInstructions = 0;
+	skippedHaltClocks = 0;
+	skippedIdleLoopClocks = 0;
+	bool isCGB = !( cart->mode == DMG || (cart->mode == CGB_DMG && Cartridge::forceDMGMode ));
+	ResetMemory( isCGB );
+	cpu.Reset( skipBios, isCGB );
+	ppu.Reset();
+	ResetScheduler();
+	blockCache.FlushRAM();
+	UpdateMemoryMap();
+
+	apu.reset();
+	soundBuffer.clear();
+}
+
+void Gameboy::InitSound() {
+	apu.treble_eq( -20.0 );		// lower values muffle it more
+	soundBuffer.bass_freq( 461 );	// higher values simulate smaller speaker
+	// Set sample rate and check for out of memory error
+	apu.output( soundBuffer.center(), soundBuffer.left(), soundBuffer.right() );
+	soundBuffer.clock_rate( 4194304 * APU_OVERCLOCKING );
+	gbemu_assert( soundBuffer.set_sample_rate( sample_rate, soundBufferLength ) == nullptr );
+}
 
-	if ( ImGui::TreeNode( "Pixel Processing Unit" ) ) {
-		ppu.DebugDraw( this );
-		ImGui::TreePop();
+long Gameboy::EndSoundFrame() {
+	bool stereo = apu.end_frame( cpu.cpuTime * APU_OVERCLOCKING );
+	soundBuffer.end_frame( cpu.cpuTime * APU_OVERCLOCKING, stereo );
+	return soundBuffer.samples_avail();
+}
+
+const SimpleTexture & Gameboy::RunAhead() {
+	if ( runAheadFrames <= 0 || cart == nullptr || ppu.workBuffer == nullptr ) {
+		return *ppu.drawingBuffer;
 	}
-	if ( cart != nullptr ) {
-		if ( ImGui::TreeNode( "Cartridge" ) ) {
-			cart->DebugDraw();
-			ImGui::TreePop();
+	TakeSnapshot( runAheadSnapshot );
+	// Neither counted nor heard, the APU still runs so the game reads the same registers
+	uint64 instructions = totalInstructions;
+	uint64 haltClocks = skippedHaltClocks;
+	uint64 idleLoopClocks = skippedIdleLoopClocks;
+	FILE * serial = serialOutput;
+	serialOutput = nullptr;
+	apu.output( nullptr, nullptr, nullptr );
+	// The picture shown starts in the frame before the last at the earliest. A little before on the scheduler clock, which
+	// does not count the clocks taken to dispatch interrupts
+	int	   frameClocks = GBEMU_CLOCK_SPEED / 60 * cpu.speed;
+	uint64 skipOutputUntil = runAheadFrames > 2 ? scheduler.now + ( runAheadFrames - 2 ) * frameClocks - frameClocks / 4 : 0;
+	for ( ;; ) {
+		ppu.BeginRunAhead();
+		ppu.skipOutputUntil = skipOutputUntil;
+		for ( int frame = 1; frame <= runAheadFrames; frame++ ) {
+			RunOneFrame();
+			apu.end_frame( cpu.cpuTime * APU_OVERCLOCKING );
+		}
+		ppu.skipOutputUntil = 0;
+		if ( !ppu.drawingSkipped ) {
+			break;
 		}
+		// The LCD went off before the last frames completed a picture, the one left has skipped lines. Again, drawing all
+		ppu.EndRunAhead();
+		RestoreSnapshot( runAheadSnapshot );
+		skipOutputUntil = 0;
 	}
+	const SimpleTexture & picture = ppu.EndRunAhead();
+	// Before the restore, which points the oscillators back at their outputs
+	apu.output( soundBuffer.center(), soundBuffer.left(), soundBuffer.right() );
+	RestoreSnapshot( runAheadSnapshot );
+	totalInstructions = instructions;
+	skippedHaltClocks = haltClocks;
+	skippedIdleLoopClocks = idleLoopClocks;
+	serialOutput = serial;
+	return picture;
+}
 
-	if ( showRomCode && cart != nullptr ) {
-		ImGui::Begin( "ROM Code" );
-		ImGui::BeginGroup();
+void Gameboy::LoadCart( const char * path ) {
+	// The new cartridge is loaded before the old one goes away, reloading the same ROM keeps its image and decoded blocks
+	Cartridge * previous = cart;
+	cart = Cartridge::LoadFromFile( path );
+	SelectMapper();
+	jit.Flush();
+	blockCache.AttachCartridge( cart );
+	delete previous;
+	Reset();
+}
 
-		ImGui::BeginChild( ImGui::GetID( "ROM CODE DUMP" ) );
-		int remainingLines = 100; // TMP: it is really slow to display a huge list with ImGUI, this is temporary to reduce pressure
-		bool pcFound = false;
-		int PC = cart->DebugResolvePC(cpu.PC);
-		size_t startIndex = 0;
+void Gameboy::SelectMapper() {
+	if ( cart == nullptr || !useMapperSpecialization ) {
+		UseMapper< Cartridge >();
+	} else if ( ROMIsBasicROM( cart->type ) ) {
+		UseMapper< ROM >();
+	} else if ( ROMIsMBC1( cart->type ) ) {
+		UseMapper< MBC1 >();
+	} else if ( ROMIsMBC3( cart->type ) ) {
+		UseMapper< MBC3 >();
+	} else if ( ROMIsMBC5( cart->type ) ) {
+		UseMapper< MBC5 >();
+	} else {
+		UseMapper< Cartridge >();
+	}
+}
 
-		//binary search our address
-		auto it = std::lower_bound(cart->sourceCodeAddresses.begin(), cart->sourceCodeAddresses.end(), PC);
-		if (it == cart->sourceCodeAddresses.end() || *it != PC) {
-			startIndex = 0;
-		} else {
-			std::size_t index = std::distance(cart->sourceCodeAddresses.begin(), it);
-			startIndex = MAX((int64)index - 100, 0);
-		}   
+template < typename Mapper >
+void Gameboy::UseMapper() {
+	runFrame = &Gameboy::RunFrame< Mapper >;
+	writeCartridge = &Gameboy::WriteCartridge< Mapper >;
+	mapCartridgePages = &Gameboy::MapCartridgePages< Mapper >;
+}
 
-		for ( size_t i = startIndex; i < startIndex + 200 && i < cart->sourceCodeLines.size(); i++) {
-			const std::string & line = cart->sourceCodeLines[i];
-			bool colored = false;
-			if ( cart->sourceCodeAddresses[i] == PC ) {
-				colored = true;
-				pcFound = true;
-				ImGui::SetScrollHereY( 0.5f ); // 0.0f:top, 0.5f:center, 1.0f:bottom
-			}
-			if ( colored ) {
-				ImGui::TextColored( ImVec4( 1, 1, 0, 1 ), "%s", line.c_str() );
-			} else {
-				ImGui::Text( "%s", line.c_str() );
-			}
-			if (pcFound && remainingLines-- <= 0) {
-				break;
-			}
+size_t Gameboy::PrintMemoryFootprint( FILE * out ) {
+	size_t gameboySize = sizeof( Gameboy );
+	size_t cartridgeSize = cart != nullptr ? cart->ObjectSize() : 0;
+	size_t frameBuffersSize = ppu.frontBuffer.AllocatedSize() + ppu.backBuffer.AllocatedSize() + ppu.runAheadBuffers[ 0 ].AllocatedSize() +
+							  ppu.runAheadBuffers[ 1 ].AllocatedSize();
+	size_t debugTexturesSize = ppu.backgroundTexture.AllocatedSize() + ppu.tilesetTexture.AllocatedSize();
+	size_t soundSize = 0;
+	for ( Blip_Buffer * buffer : { soundBuffer.center(), soundBuffer.left(), soundBuffer.right() } ) {
+		if ( buffer->buffer_ != nullptr ) {
+			soundSize += ( buffer->buffer_size_ + Blip_Buffer::widest_impulse_ + 2 ) * sizeof( Blip_Buffer::buf_t_ );
 		}
-		ImGui::EndChild();
-		ImGui::EndGroup();
-		ImGui::End();
 	}
+	size_t ramBlocksSize = 0;
+	for ( const auto & it : blockCache.ramBlocks ) {
+		ramBlocksSize += sizeof( CodeBlock ) + it.second->instructions.capacity() * sizeof( DecodedInstruction );
+	}
+	size_t jitSize = ( jit.codeArena != nullptr ? Jit::codeArenaSize : 0 ) + jit.lookupCache.capacity() * sizeof( Jit::LookupCacheEntry );
 
-	if ( showMemoryInspector ) {
-		mem_edit.DrawWindow( "VRAM", mem.VRAM, 0x4000, 0x0 );
-		mem_edit.DrawWindow( "HighRAM", mem.highRAM, 0x100, 0x0 );
-		mem_edit.DrawWindow( "OAM", mem.OAM, 0xa0, 0x0 );
-		mem_edit.DrawWindow( "WorkRAM", mem.workRAM, 0x9000, 0x0 );
-		if ( cart != nullptr ) {
-			mem_edit.DrawWindow( "ROM", cart->GetRawMemory(), cart->rawMemorySize, 0x0 );
-		}
+	size_t runAheadSize = runAheadSnapshot.capacity();
+	size_t tileCacheSize = ppu.tiles.AllocatedSize();
+
+	size_t total = gameboySize + stateArenaSize + cartridgeSize + frameBuffersSize + debugTexturesSize + soundSize + ramBlocksSize + jitSize +
+				   runAheadSize + tileCacheSize;
+	fprintf( out, "Gameboy object      %8zu\n", gameboySize );
+	fprintf( out, "state arena         %8d, VRAM %d, work RAM %d, cartridge RAM %d\n", stateArenaSize, mem.VRAMSize, mem.workRAMSize,
+			 stateArenaSize - mem.VRAMSize - mem.workRAMSize );
+	fprintf( out, "cartridge           %8zu\n", cartridgeSize );
+	fprintf( out, "frame buffers       %8zu\n", frameBuffersSize );
+	fprintf( out, "debug textures      %8zu\n", debugTexturesSize );
+	fprintf( out, "decoded tiles       %8zu\n", tileCacheSize );
+	fprintf( out, "sound buffers       %8zu\n", soundSize );
+	fprintf( out, "RAM code blocks     %8zu\n", ramBlocksSize );
+	fprintf( out, "JIT code arena      %8zu, %d bytes used\n", jitSize, jit.codeArenaUsed );
+	fprintf( out, "run-ahead snapshot  %8zu\n", runAheadSize );
+	fprintf( out, "total per instance  %8zu\n", total );
+	if ( cart != nullptr && cart->image != nullptr ) {
+		fprintf( out, "shared ROM image    %8d, %d cartridges\n", cart->image->size, cart->image->refCount );
 	}
-}
\ No newline at end of file
+	return total;
+}
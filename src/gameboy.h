@@ -3,9 +3,12 @@
 #include "memory.h"
 #include "rom.h"
 #include "ppu.h"
+#include "save_state.h"
+#include "scheduler.h"
+#include "block_cache.h"
+#include "jit.h"
 #include "sound/Gb_Apu.h"
 #include "sound/Multi_Buffer.h"
-#include "sound/Sound_Queue.h"
 
 #define TIMA 0xff05
 #define TMA	 0xff06
@@ -28,8 +31,12 @@ struct CGBPalette {
 
 struct Memory {
 	byte highRAM[ 0x100 ];
-	byte VRAM[ 0x4000 ];
-	byte workRAM[ 0x9000 ];
+	// In Gameboy::stateArena, sized by ResetMemory for the mode: VRAM bank 1 and work RAM banks 2 to 7 only exist on CGB.
+	// Work RAM bank 0 is at 0 and bank n at n * 0x1000
+	byte * VRAM = nullptr;
+	byte * workRAM = nullptr;
+	int	   VRAMSize = 0;
+	int	   workRAMSize = 0;
 	byte OAM[ 0x100 ];
 
 	// Work Ram bank 0-7
@@ -43,48 +50,172 @@ struct Memory {
 
 	CGBPalette bgPalette;
 	CGBPalette spritePalette;
+
+	// Offset in workRAM of the bank mapped at 0xd000
+	uint32 WorkRAMBankOffset() const { return workRAMBankIndex * 0x1000; }
+};
+
+// The address space in 256 byte pages. A page with a host pointer is plain memory, accessed with a single indexed load
+// or store. Null pages go through ReadUnmapped and WriteUnmapped: IO, cartridge registers, the BIOS overlay, unusable
+// areas, and work RAM pages holding decoded code, whose writes have to invalidate it.
+// Not part of Memory, which is saved as is in save states
+struct MemoryMap {
+	const byte * readPages[ 0x100 ] = {};
+	byte *		 writePages[ 0x100 ] = {};
 };
 
 struct Gameboy {
 	Cpu				cpu;
 	Memory			mem;
 	Ppu				ppu;
+	Scheduler		scheduler;
+	MemoryMap		memoryMap;
 	Gb_Apu			apu;
 	Stereo_Buffer	soundBuffer;
-	Sound_Queue		sound;
 
 	Cartridge * cart = nullptr;
+	BlockCache	blockCache;
+	Jit			jit;
 
 	bool	shouldRun = true;
 	bool	shouldStep = false;
 	bool	dumpOPcodesToStdout = false;
 	int		PCBreakpoint = -1;
 	bool	skipBios = true;
+	bool	useBlockCache = true;
+	bool	useJit = false;
+	bool	skipHaltedClocks = true;
+	bool	skipIdleLoops = true;
+	// Run the frame loop and the cartridge register writes compiled for the mapper of the cartridge, instead of going
+	// through the Cartridge interface. Read by LoadCart
+	bool	useMapperSpecialization = true;
+	// OAM DMA and HDMA copy with memcpy between mapped pages instead of a Read and a Write per byte
+	bool	useBulkTransfers = true;
 	uint64	totalInstructions = 0;
+	// Stops when totalInstructions reaches it, 0 for none
 	uint64	instructionCountBreakpoint = 0;
+	// Clocks the CPU spent halted that were jumped over instead of stepped
+	uint64	skippedHaltClocks = 0;
+	// Clocks spent polling in idle loops that were jumped over
+	uint64	skippedIdleLoopClocks = 0;
+	// When set, bytes sent on the serial port are written there
+	FILE *	serialOutput = nullptr;
+	// Milliseconds of samples the APU output buffers hold, read by InitSound. Has to cover what the frontend lets pile up
+	// between two reads: 4096 samples, 2048 stereo pairs, plus one double speed frame
+	int		soundBufferLength = 100;
+	// Frames RunAhead emulates past the real one, 0 to 3. The picture shown is the one they end on, so the input shows
+	// up that many frames sooner
+	int		runAheadFrames = 0;
+	std::vector< byte > runAheadSnapshot;
 
 	static byte DMG_BIOS[ 0x100 ];
 	static byte CGB_BIOS[ 0x901 ];
 
-	void RunOneFrame();
+	// Instantiations for the mapper of the loaded cartridge, picked once by LoadCart. Mapper is one of the final
+	// Cartridge classes, which lets the compiler inline its bank arithmetic, or Cartridge itself for virtual calls
+	void ( Gameboy::*runFrame )() = &Gameboy::RunFrame< Cartridge >;
+	void ( Gameboy::*writeCartridge )( uint16 addr, byte value ) = &Gameboy::WriteCartridge< Cartridge >;
+	void ( Gameboy::*mapCartridgePages )() = &Gameboy::MapCartridgePages< Cartridge >;
+
+	// VRAM, work RAM and the cartridge RAM, one after the other in a single allocation. With MachineRegisters, this is all
+	// of the machine state: memoryMap, blockCache, jit and the PPU buffers are rebuilt from them
+	byte *	stateArena = nullptr;
+	int		stateArenaSize = 0;
+
+	~Gameboy() { delete[] stateArena; }
+
+	void RunOneFrame() { ( this->*runFrame )(); }
+	template < typename Mapper >
+	void RunFrame();
+	// Interprets one instruction, or waits 4 clocks when halted
+	void StepInstruction();
+	// Jumps a halted CPU over the 4 clock steps in which nothing can happen, up to the next event or clockBudget
+	void SkipHaltedClocks( int clockBudget );
+	// Called after one pass through a mayBeIdleLoop block that started with the given state. If the pass left the
+	// registers as they were, every pass until the next event does the same and they are jumped over
+	void SkipIdleLoop( const CodeBlock * block, Cpu & before, uint64 instructionsBefore, uint64 deadlineBefore, int clockBudget );
+	// Runs decoded instructions, from the one at index first, until the block ends, control flow leaves it or
+	// clockBudget is reached
+	void RunBlock( const CodeBlock * block, int clockBudget, size_t first = 0 );
+	// Runs the rest of the machine for clocks during which the CPU is stopped, as during a general purpose DMA
+	void StallCpu( int clocks );
+	// Advances the rest of the machine after an instruction took clocks
+	void FinishInstruction( int clocks );
+	// Runs the PPU and timer events that came due during an instruction of clocks
+	void RunScheduledEvents( int clocks );
+	void InitSound();
+	// Closes the APU frame started by RunOneFrame, returns the number of samples ready to be read from soundBuffer
+	long EndSoundFrame();
+	// Runs runAheadFrames frames silently from the current state, then puts the machine back. Call after EndSoundFrame.
+	// Returns the picture to show, the last one drawn when run-ahead is off
+	const SimpleTexture & RunAhead();
 
 	void Reset();
+	void ResetScheduler();
 	void LoadCart( const char * path );
-
-	void SerializeSaveState( const char * path );
-	void LoadSaveState( const char * path );
+	// Points runFrame, writeCartridge and mapCartridgePages at the instantiations for the type of cart
+	void SelectMapper();
+	template < typename Mapper >
+	void UseMapper();
+
+	// Writes the whole machine in the format described in save_state.h
+	bool SaveState( SaveStateWriter & out );
+	// Restores a state written by SaveState, read in place from data. Returns false, leaving the machine untouched, when
+	// the state is damaged or does not fit the loaded cartridge
+	bool LoadState( const byte * data, size_t size );
+	// Copies the machine into snapshot: MachineRegisters, the APU, then the state arena as is. The capacity of snapshot is
+	// reused, taking them in a loop does not allocate
+	void TakeSnapshot( std::vector< byte > & snapshot );
+	// Puts the machine back as it was when snapshot was taken. False if it comes from another cartridge or mode
+	bool RestoreSnapshot( const std::vector< byte > & snapshot );
+	bool SerializeSaveState( const char * path );
+	bool LoadSaveState( const char * path );
 
 	void DebugDraw();
+	// Prints the bytes this instance allocated, by owner, and returns the total. ROM images and decoded ROM blocks are
+	// shared between instances and listed apart
+	size_t PrintMemoryFootprint( FILE * out );
 
-	void ResetMemory();
+	// Sizes the state arena for the mode and the cartridge, and clears everything but the cartridge RAM to its power up
+	// state. The RAM of a cartridge attached for the first time starts cleared, then it persists across resets
+	void ResetMemory( bool isCGB );
 	// Memory
-	void Write( uint16 addr, byte value );
-	byte Read( uint16 addr );
+	void Write( uint16 addr, byte value ) {
+		byte * page = memoryMap.writePages[ addr >> 8 ];
+		if ( page != nullptr ) {
+			page[ addr & 0xff ] = value;
+		} else {
+			WriteUnmapped( addr, value );
+		}
+	}
+	byte Read( uint16 addr ) {
+		const byte * page = memoryMap.readPages[ addr >> 8 ];
+		if ( page != nullptr ) {
+			return page[ addr & 0xff ];
+		}
+		return ReadUnmapped( addr );
+	}
+	void WriteUnmapped( uint16 addr, byte value );
+	byte ReadUnmapped( uint16 addr );
+	// Rebuilds every page, after a reset or a save state load
+	void UpdateMemoryMap();
+	// Pages affected by a ROM or RAM bank switch in the cartridge
+	void MapCartridgePages() { ( this->*mapCartridgePages )(); }
+	template < typename Mapper >
+	void MapCartridgePages();
+	// Write to a cartridge register, 0x0100 to 0x7fff
+	template < typename Mapper >
+	void WriteCartridge( uint16 addr, byte value );
+	void MapVRAMPages();
+	// Work RAM pages, after a bank switch or when decoded code appeared or went away in them
+	void MapWorkRAMPages();
 	void WriteHighRam( uint16 addr, byte value );
 	byte ReadHighRam( uint16 addr );
 	void HDMATransfer();
 	void DMATransfer( byte value );
 	void DMATransfer_CGB( byte value );
 	void PerformDMATransfer( uint16 length );
+	// Copies length bytes as seen on the bus, a whole run at a time where both sides are mapped pages
+	void CopyThroughBus( uint16 dest, uint16 source, int length );
 	void RaiseInterupt( byte code );
 };
\ No newline at end of file
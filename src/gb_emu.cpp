@@ -21,6 +21,7 @@ GBEMU_UNSUPPORTED_PLATFORM
 #include "gameboy.h"
 #include "cpu.h"
 #include "rom.h"
+#include "rewind.h"
 #include "gui/window.h"
 #include "sound/Gb_Apu.h"
 #include "sound/Multi_Buffer.h"
@@ -28,8 +29,11 @@ GBEMU_UNSUPPORTED_PLATFORM
 
 void DrawUI();
 
-static Window	window;
-static Gameboy	gb;
+static Window				window;
+static Gameboy				gb;
+static TexturedRectangle	screen;
+static Sound_Queue			sound;
+static RewindBuffer		rewindBuffer;
 
 std::vector< std::string > romFSPaths;
 
@@ -110,21 +114,19 @@ int main( int argc, char ** argv ) {
 	glEnable( GL_CULL_FACE );
 	glCullFace( GL_BACK );
 
-	gb.apu.treble_eq( -20.0 );		// lower values muffle it more
-	gb.soundBuffer.bass_freq( 461 );	// higher values simulate smaller speaker
-	// Set sample rate and check for out of memory error
-	gb.apu.output( gb.soundBuffer.center(), gb.soundBuffer.left(), gb.soundBuffer.right() );
-	gb.soundBuffer.clock_rate( 4194304 * APU_OVERCLOCKING );
-	gbemu_assert( gb.soundBuffer.set_sample_rate( sample_rate ) == nullptr );
-
+	gb.InitSound();
 	// Generate a few seconds of sound and play using SDL
+	gbemu_assert( sound.start( sample_rate, 2 ) == nullptr );
 	bool show_demo_window = true;
 
-	gb.ppu.AllocateBuffers( window );
+	gb.ppu.AllocateBuffers();
+	screen.Allocate( 0, 20, GB_SCREEN_WIDTH * 4, GB_SCREEN_HEIGHT * 4, window );
+	// About 10 minutes of the busiest games, hours of most
+	rewindBuffer.Configure( 64 * 1024 * 1024, rewindFramesPerCapture );
 
 	while ( !window.ShouldClose() ) {
 		window.Clear();
-		window.PollEvents( &gb );
+		window.PollEvents( &gb, screen );
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplSDL2_NewFrame( window.glWindow );
 		ImGui::NewFrame();
@@ -135,21 +137,32 @@ int main( int argc, char ** argv ) {
 
 		DrawUI();
 
-		gb.RunOneFrame();
+		bool rewinding = window.rewindHeld && gb.cart != nullptr;
+		if ( rewinding ) {
+			// One snapshot back per frame shown, the frame run from it only draws the picture
+			rewindBuffer.StepBack( gb );
+			gb.RunOneFrame();
+		} else {
+			gb.RunOneFrame();
+			if ( gb.cart != nullptr ) {
+				rewindBuffer.FrameDone( gb );
+			}
+		}
 
 		{
 			int const				buf_size = 4096;
 			static blip_sample_t	buf[ buf_size ];
 
-			bool stereo = gb.apu.end_frame( gb.cpu.cpuTime * APU_OVERCLOCKING );
-			gb.soundBuffer.end_frame( gb.cpu.cpuTime * APU_OVERCLOCKING, stereo );
-			if ( gb.soundBuffer.samples_avail() >= buf_size ) {
+			if ( gb.EndSoundFrame() >= buf_size ) {
 				// Play whatever samples are available
 				long count = gb.soundBuffer.read_samples( buf, buf_size );
-				gb.sound.write( buf, count );
+				if ( !rewinding ) {
+					sound.write( buf, count );
+				}
 			}
 		}
-		gb.ppu.drawingBuffer->Draw();
+		// After the frame and its sound, the picture of a few frames later when running ahead
+		screen.Draw( rewinding ? *gb.ppu.drawingBuffer : gb.RunAhead() );
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData( ImGui::GetDrawData() );
 		SDL_GL_SwapWindow(window.glWindow);
@@ -160,6 +173,8 @@ int main( int argc, char ** argv ) {
 	ImGui::DestroyContext();
 
 	gb.ppu.DestroyBuffers();
+	screen.Destroy();
+	sound.stop();
 	delete gb.cart;
 	window.Destroy();
 	return 0;
@@ -198,6 +213,16 @@ void DrawUI() {
 		if ( ImGui::MenuItem( gb.shouldRun ? "Pause" : "Run" ) ) {
 			gb.shouldRun = !gb.shouldRun;
 		}
+		if ( ImGui::BeginMenu( "Run-ahead" ) ) {
+			// Frames emulated past the real one, the input shows up that much sooner
+			const char * labels[] = { "Off", "1 frame", "2 frames", "3 frames" };
+			for ( int frames = 0; frames <= 3; frames++ ) {
+				if ( ImGui::MenuItem( labels[ frames ], nullptr, gb.runAheadFrames == frames ) ) {
+					gb.runAheadFrames = frames;
+				}
+			}
+			ImGui::EndMenu();
+		}
 		if ( ImGui::MenuItem( "Reset" ) ) {
 			gb.Reset();
 		}
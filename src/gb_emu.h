@@ -48,6 +48,13 @@ constexpr int GB_SCREEN_HEIGHT = 144;
 		DEBUG_BREAK;                                                                                                                                           \
 	}
 
+// For the checks of the per pixel paths, left out of release builds
+#ifdef NDEBUG
+#define gbemu_debug_assert( x )
+#else
+#define gbemu_debug_assert( x ) gbemu_assert( x )
+#endif
+
 constexpr static unsigned int fnvDefaultOffsetBasis = 0x811c9dc5;
 constexpr static unsigned int fnvPrime				 = 0x1000193;
 constexpr static inline auto FnvHash(char const * const s, unsigned val = fnvDefaultOffsetBasis) -> uint64 {
@@ -0,0 +1,684 @@
+// Batch runner for the emulation core: no window, no audio device, no frame pacing.
+// Usage: gb_headless [options] <rom> [frames]
+//        gb_headless --bench-cpu
+//        gb_headless --bench-halt <rom> [frames]
+//        gb_headless --bench-mapper <rom> [frames]
+//        gb_headless --bench-jit <rom> [frames]
+//        gb_headless --bench-dma <rom> [frames]
+//        gb_headless --bench-state <rom> [frames]
+//        gb_headless --bench-rewind <rom> [frames]
+//        gb_headless --bench-run-ahead <rom> [frames]
+//        gb_headless --bench-render <rom> [frames]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#include "gb_emu.h"
+#include "gameboy.h"
+#include "render_kernels.h"
+#include "rewind.h"
+
+static Gameboy gb;
+
+// Register and ALU heavy loop, runs from work RAM so no cartridge is needed
+static const byte s_benchProgram[] = {
+	0x06, 0x00, // LD B, 0
+	0x0e, 0x10, // LD C, 0x10
+	0x78,		// LD A, B
+	0x81,		// ADD A, C
+	0x47,		// LD B, A
+	0x23,		// INC HL
+	0x13,		// INC DE
+	0xa9,		// XOR C
+	0xcb, 0x3f, // SRL A
+	0x57,		// LD D, A
+	0x0d,		// DEC C
+	0x20, 0xf4, // JR NZ, -12
+	0x18, 0xee, // JR -18
+};
+
+// Only the CPU: no PPU, timer or interrupts, to measure instruction dispatch and register access
+static int BenchCpu() {
+	gb.ResetMemory( false );
+	gb.cpu.Reset( true, false );
+	gb.UpdateMemoryMap();
+	for ( int i = 0; i < ( int )sizeof( s_benchProgram ); i++ ) {
+		gb.Write( 0xc000 + i, s_benchProgram[ i ] );
+	}
+	gb.cpu.PC = 0xc000;
+
+	constexpr uint64 instructionCount = 200000000;
+	auto			 start = std::chrono::high_resolution_clock::now();
+	for ( uint64 i = 0; i < instructionCount; i++ ) {
+		gb.cpu.ExecuteNextOPCode( &gb );
+	}
+	auto   end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration< double >( end - start ).count();
+	printf( "cpu micro-benchmark, fetch and execute: %llu instructions in %.3fs, %.2f MIPS\n", instructionCount, seconds,
+			instructionCount / seconds / 1000000.0 );
+
+	// Same loop from decoded blocks, leaving mostly the handlers and their register accesses
+	gb.cpu.PC = 0xc000;
+	uint64 executed = 0;
+	start = std::chrono::high_resolution_clock::now();
+	while ( executed < instructionCount ) {
+		const CodeBlock * block = gb.blockCache.Lookup( &gb, gb.cpu.PC );
+		for ( const DecodedInstruction & instruction : block->instructions ) {
+			if ( gb.cpu.PC != instruction.pc ) {
+				break;
+			}
+			gb.cpu.PC++;
+			gb.cpu.decodedOperands = instruction.operands;
+			( gb.cpu.*instruction.handler )( &gb );
+			executed++;
+		}
+	}
+	gb.cpu.decodedOperands = nullptr;
+	end = std::chrono::high_resolution_clock::now();
+	seconds = std::chrono::duration< double >( end - start ).count();
+	printf( "cpu micro-benchmark, decoded execute: %llu instructions in %.3fs, %.2f MIPS\n", executed, seconds, executed / seconds / 1000000.0 );
+	printf( "sizeof( Cpu ) %d\n", ( int )sizeof( Cpu ) );
+	return EXIT_SUCCESS;
+}
+
+// Runs frameCount frames, draining the APU so the emulated sound work is still measured, and running ahead after each
+// when gb.runAheadFrames is set. Returns the time it took
+static double RunFrames( int frameCount ) {
+	int const				bufSize = 4096;
+	static blip_sample_t	buf[ bufSize ];
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for ( int frame = 0; frame < frameCount; frame++ ) {
+		gb.RunOneFrame();
+		if ( gb.EndSoundFrame() >= bufSize ) {
+			gb.soundBuffer.read_samples( buf, bufSize );
+		}
+		gb.RunAhead();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double >( end - start ).count();
+}
+
+// Of the R, G, B of each pixel, so the 32 bit formats hash the same
+static uint32 PictureHash( const SimpleTexture & picture ) {
+	uint32 frameHash = fnvDefaultOffsetBasis;
+	for ( int y = 0; y < picture.height; y++ ) {
+		for ( int x = 0; x < picture.width; x++ ) {
+			Pixel pixel = picture.GetPixel( x, y );
+			frameHash = ( frameHash ^ pixel.R ) * fnvPrime;
+			frameHash = ( frameHash ^ pixel.G ) * fnvPrime;
+			frameHash = ( frameHash ^ pixel.B ) * fnvPrime;
+		}
+	}
+	return frameHash;
+}
+
+// Hash of the last presented frame, handy to check that a change kept the output identical
+static uint32 FrameHash() { return PictureHash( *gb.ppu.drawingBuffer ); }
+
+// Same ROM from a fresh load stepping every halted clock, then skipping them
+static int BenchHalt( const char * romPath, int frameCount ) {
+	gb.skipHaltedClocks = false;
+	gb.LoadCart( romPath );
+	double steppedSeconds = RunFrames( frameCount );
+	uint32 steppedHash = FrameHash();
+
+	gb.skipHaltedClocks = true;
+	gb.LoadCart( romPath );
+	double skippedSeconds = RunFrames( frameCount );
+	uint32 skippedHash = FrameHash();
+
+	double totalClocks = ( double )gb.scheduler.now;
+	printf( "%s: halt stepped %.1f frames/sec, halt skipped %.1f frames/sec, %.2fx, %.1f%% of the clocks skipped, frame hash %08x %s\n",
+			gb.cart->romName, frameCount / steppedSeconds, frameCount / skippedSeconds, steppedSeconds / skippedSeconds,
+			gb.skippedHaltClocks * 100.0 / totalClocks, skippedHash, steppedHash == skippedHash ? "identical" : "DIFFERENT" );
+	return steppedHash == skippedHash ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Same ROM from a fresh load through the virtual Cartridge interface, then with the loop compiled for its mapper
+static int BenchMapper( const char * romPath, int frameCount ) {
+	gb.useMapperSpecialization = false;
+	gb.LoadCart( romPath );
+	double virtualSeconds = RunFrames( frameCount );
+	uint32 virtualHash = FrameHash();
+
+	gb.useMapperSpecialization = true;
+	gb.LoadCart( romPath );
+	double specializedSeconds = RunFrames( frameCount );
+	uint32 specializedHash = FrameHash();
+
+	printf( "%s: virtual mapper %.1f frames/sec, specialized mapper %.1f frames/sec, %.2fx, frame hash %08x %s\n", gb.cart->romName,
+			frameCount / virtualSeconds, frameCount / specializedSeconds, virtualSeconds / specializedSeconds, specializedHash,
+			virtualHash == specializedHash ? "identical" : "DIFFERENT" );
+	return virtualHash == specializedHash ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Same ROM from a fresh load with the block interpreter, then with hot blocks compiled to native code
+static int BenchJit( const char * romPath, int frameCount ) {
+	if ( !Jit::IsSupported() ) {
+		printf( "The JIT is not available on this platform\n" );
+		return EXIT_FAILURE;
+	}
+	gb.useJit = false;
+	gb.LoadCart( romPath );
+	double interpretedSeconds = RunFrames( frameCount );
+	uint32 interpretedHash = FrameHash();
+
+	gb.useJit = true;
+	gb.LoadCart( romPath );
+	double compiledSeconds = RunFrames( frameCount );
+	uint32 compiledHash = FrameHash();
+
+	printf( "%s: block interpreter %.1f frames/sec, jit %.1f frames/sec, %.2fx, %d bytes of code, frame hash %08x %s\n", gb.cart->romName,
+			frameCount / interpretedSeconds, frameCount / compiledSeconds, interpretedSeconds / compiledSeconds, gb.jit.codeArenaUsed,
+			compiledHash, interpretedHash == compiledHash ? "identical" : "DIFFERENT" );
+	return interpretedHash == compiledHash ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Time of count copies of a 2KB HDMA from ROM bank 1 to VRAM and of an OAM DMA from work RAM
+static void TimeTransfers( int count, double & hdmaSeconds, double & oamSeconds ) {
+	auto start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < count; i++ ) {
+		gb.CopyThroughBus( 0x8000, 0x4000, 0x800 );
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	hdmaSeconds = std::chrono::duration< double >( end - start ).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < count; i++ ) {
+		gb.DMATransfer( 0xc1 );
+	}
+	end = std::chrono::high_resolution_clock::now();
+	oamSeconds = std::chrono::duration< double >( end - start ).count();
+}
+
+// Same ROM from a fresh load copying DMA transfers a byte at a time, then in bulk, then the transfers alone
+static int BenchDma( const char * romPath, int frameCount ) {
+	gb.useBulkTransfers = false;
+	gb.LoadCart( romPath );
+	double byteSeconds = RunFrames( frameCount );
+	uint32 byteHash = FrameHash();
+
+	gb.useBulkTransfers = true;
+	gb.LoadCart( romPath );
+	double bulkSeconds = RunFrames( frameCount );
+	uint32 bulkHash = FrameHash();
+
+	printf( "%s: byte transfers %.1f frames/sec, bulk transfers %.1f frames/sec, %.2fx, frame hash %08x %s\n", gb.cart->romName,
+			frameCount / byteSeconds, frameCount / bulkSeconds, byteSeconds / bulkSeconds, bulkHash,
+			byteHash == bulkHash ? "identical" : "DIFFERENT" );
+
+	constexpr int transferCount = 100000;
+	double		  byteHdmaSeconds, byteOamSeconds, bulkHdmaSeconds, bulkOamSeconds;
+	gb.useBulkTransfers = false;
+	TimeTransfers( transferCount, byteHdmaSeconds, byteOamSeconds );
+	gb.useBulkTransfers = true;
+	TimeTransfers( transferCount, bulkHdmaSeconds, bulkOamSeconds );
+	printf( "2KB HDMA: byte %.1f ns, bulk %.1f ns, %.2fx. OAM DMA: byte %.1f ns, bulk %.1f ns, %.2fx\n",
+			byteHdmaSeconds * 1e9 / transferCount, bulkHdmaSeconds * 1e9 / transferCount, byteHdmaSeconds / bulkHdmaSeconds,
+			byteOamSeconds * 1e9 / transferCount, bulkOamSeconds * 1e9 / transferCount, byteOamSeconds / bulkOamSeconds );
+	return byteHash == bulkHash ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static double SecondsSince( std::chrono::high_resolution_clock::time_point start ) {
+	return std::chrono::duration< double >( std::chrono::high_resolution_clock::now() - start ).count();
+}
+
+// Runs the ROM, checks that a loaded state or a restored snapshot carries on exactly like the machine it was taken from,
+// then times saving and loading the state in memory and through a file, and taking and restoring snapshots
+static int BenchState( const char * romPath, int frameCount ) {
+	RunFrames( frameCount );
+	std::vector< byte > state;
+	{
+		SaveStateWriter out( state );
+		gb.SaveState( out );
+	}
+
+	// The machine goes on from where it was saved, then goes back to the state and runs the same frames again
+	RunFrames( 300 );
+	uint32				continuedHash = FrameHash();
+	std::vector< byte > continued;
+	{
+		SaveStateWriter out( continued );
+		gb.SaveState( out );
+	}
+	gb.LoadState( state.data(), state.size() );
+	RunFrames( 300 );
+	uint32				resumedHash = FrameHash();
+	std::vector< byte > resumed;
+	{
+		SaveStateWriter out( resumed );
+		gb.SaveState( out );
+	}
+
+	// Same from a snapshot
+	std::vector< byte > snapshot;
+	gb.TakeSnapshot( snapshot );
+	RunFrames( 300 );
+	uint32				snapshotContinuedHash = FrameHash();
+	std::vector< byte > snapshotContinued;
+	{
+		SaveStateWriter out( snapshotContinued );
+		gb.SaveState( out );
+	}
+	gb.RestoreSnapshot( snapshot );
+	RunFrames( 300 );
+	uint32				snapshotResumedHash = FrameHash();
+	std::vector< byte > snapshotResumed;
+	{
+		SaveStateWriter out( snapshotResumed );
+		gb.SaveState( out );
+	}
+
+	constexpr int		count = 1000;
+	std::vector< byte > scratch;
+	auto				start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < count; i++ ) {
+		scratch.clear();
+		SaveStateWriter out( scratch );
+		gb.SaveState( out );
+	}
+	double saveSeconds = SecondsSince( start );
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < count; i++ ) {
+		gb.LoadState( state.data(), state.size() );
+	}
+	double loadSeconds = SecondsSince( start );
+
+	constexpr int snapshotCount = 10000;
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < snapshotCount; i++ ) {
+		gb.TakeSnapshot( scratch );
+	}
+	double snapshotSeconds = SecondsSince( start );
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < snapshotCount; i++ ) {
+		gb.RestoreSnapshot( snapshot );
+	}
+	double restoreSeconds = SecondsSince( start );
+
+	constexpr int fileCount = 100;
+	std::string	  path = ( std::filesystem::temp_directory_path() / "gb_headless_bench.state" ).string();
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < fileCount; i++ ) {
+		gb.SerializeSaveState( path.c_str() );
+	}
+	double fileSaveSeconds = SecondsSince( start );
+	start = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < fileCount; i++ ) {
+		gb.LoadSaveState( path.c_str() );
+	}
+	double fileLoadSeconds = SecondsSince( start );
+	remove( path.c_str() );
+
+	printf( "%s: state %d bytes, memory save %.2f us, load %.2f us, file save %.2f us, load %.2f us\n", gb.cart->romName, ( int )state.size(),
+			saveSeconds * 1e6 / count, loadSeconds * 1e6 / count, fileSaveSeconds * 1e6 / fileCount, fileLoadSeconds * 1e6 / fileCount );
+
+	printf( "%s: snapshot %d bytes, take %.2f us, restore %.2f us\n", gb.cart->romName, ( int )snapshot.size(),
+			snapshotSeconds * 1e6 / snapshotCount, restoreSeconds * 1e6 / snapshotCount );
+
+	bool identical = continuedHash == resumedHash && continued == resumed;
+	bool snapshotIdentical = snapshotContinuedHash == snapshotResumedHash && snapshotContinued == snapshotResumed;
+	printf( "%s: 300 frames after loading, frame hash %08x, state %s. After restoring, frame hash %08x, state %s\n", gb.cart->romName,
+			resumedHash, identical ? "identical" : "DIFFERENT", snapshotResumedHash, snapshotIdentical ? "identical" : "DIFFERENT" );
+	identical = identical && snapshotIdentical;
+	return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static uint32 StateHash() {
+	std::vector< byte > state;
+	{
+		SaveStateWriter out( state );
+		gb.SaveState( out );
+	}
+	uint32 hash = fnvDefaultOffsetBasis;
+	for ( byte b : state ) {
+		hash = ( hash ^ b ) * fnvPrime;
+	}
+	return hash;
+}
+
+// Runs the ROM capturing rewind snapshots as the frontend does, then steps back through all of them and checks each one
+// against the state the machine had when it was captured
+static int BenchRewind( const char * romPath, int frameCount ) {
+	constexpr size_t budget = 64 * 1024 * 1024;
+	double			 plainSeconds = RunFrames( frameCount );
+
+	gb.LoadCart( romPath );
+	RewindBuffer rewind;
+	rewind.Configure( budget, rewindFramesPerCapture );
+	std::vector< uint32 > hashes;
+	size_t				  deltaBytes = 0;
+	for ( int frame = 0; frame < frameCount; frame++ ) {
+		RunFrames( 1 );
+		int captureCount = rewind.captureCount;
+		rewind.FrameDone( gb );
+		if ( rewind.captureCount != captureCount ) {
+			hashes.push_back( StateHash() );
+			if ( !rewind.deltas.empty() ) {
+				deltaBytes += rewind.deltas.back().size;
+			}
+		}
+	}
+	int	   count = rewind.Count();
+	double deltaAverage = ( double )deltaBytes / MAX( ( int )hashes.size() - 1, 1 );
+	printf( "%s: snapshot %d bytes every %d frames, delta %.0f bytes on average, capture %.2f us (%.3f%% of the run), %d snapshots in %.1f MB\n",
+			gb.cart->romName, ( int )rewind.latest.size(), rewindFramesPerCapture, deltaAverage, rewind.captureSeconds * 1e6 / rewind.captureCount,
+			rewind.captureSeconds * 100.0 / plainSeconds, count, rewind.BytesUsed() / ( 1024.0 * 1024.0 ) );
+	printf( "%s: %d MB hold %.1f minutes of play\n", gb.cart->romName, ( int )( budget >> 20 ),
+			budget / deltaAverage * rewindFramesPerCapture / 60.0 / 60.0 );
+
+	int mismatches = 0;
+	for ( int i = 0; i < count; i++ ) {
+		if ( !rewind.StepBack( gb ) || StateHash() != hashes[ hashes.size() - 1 - i ] ) {
+			mismatches++;
+		}
+	}
+	printf( "%s: stepped back %d snapshots, %d mismatches\n", gb.cart->romName, count, mismatches );
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs the ROM keeping the hash of every picture, then with 1 to 3 frames of run-ahead: each picture shown has to be
+// the one of the plain run that many frames later, and the real machine has to end where the plain run did
+static int BenchRunAhead( const char * romPath, int frameCount ) {
+	int const			 bufSize = 4096;
+	static blip_sample_t buf[ bufSize ];
+
+	double plainSeconds = RunFrames( frameCount );
+	uint32 plainState = StateHash();
+	gb.LoadCart( romPath );
+	std::vector< uint32 > plainHashes;
+	for ( int frame = 0; frame < frameCount + 3; frame++ ) {
+		RunFrames( 1 );
+		plainHashes.push_back( FrameHash() );
+	}
+	printf( "%s: without run-ahead %.1f us per frame\n", gb.cart->romName, plainSeconds * 1e6 / frameCount );
+
+	bool identical = true;
+	for ( int frames = 1; frames <= 3; frames++ ) {
+		gb.LoadCart( romPath );
+		gb.runAheadFrames = frames;
+		double seconds = RunFrames( frameCount );
+		bool   sameState = StateHash() == plainState;
+
+		gb.LoadCart( romPath );
+		int mismatches = 0;
+		for ( int frame = 0; frame < frameCount; frame++ ) {
+			gb.RunOneFrame();
+			if ( gb.EndSoundFrame() >= bufSize ) {
+				gb.soundBuffer.read_samples( buf, bufSize );
+			}
+			if ( PictureHash( gb.RunAhead() ) != plainHashes[ frame + frames ] ) {
+				mismatches++;
+			}
+		}
+		gb.runAheadFrames = 0;
+		printf( "%s: %d frames ahead %.1f us per frame, %.1f us per frame ahead, %d pictures differ, machine state %s\n", gb.cart->romName,
+				frames, seconds * 1e6 / frameCount, ( seconds - plainSeconds ) * 1e6 / frameCount / frames, mismatches,
+				sameState ? "identical" : "DIFFERENT" );
+		identical = identical && mismatches == 0 && sameState;
+	}
+	return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Seconds to draw the 144 lines of the picture count times, whole then the sprites alone, with LY set to each line as
+// the PPU has it when drawing
+static void TimeScanLines( int count, double & linesSeconds, double & spritesSeconds ) {
+	byte control = gb.Read( 0xff40 );
+	byte LY = gb.mem.highRAM[ 0x44 ];
+	linesSeconds = 0.0;
+	spritesSeconds = 0.0;
+	for ( int i = 0; i < count; i++ ) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for ( int line = 0; line < GB_SCREEN_HEIGHT; line++ ) {
+			gb.mem.highRAM[ 0x44 ] = line;
+			gb.ppu.DrawScanLine( line, &gb );
+		}
+		linesSeconds += SecondsSince( start );
+		start = std::chrono::high_resolution_clock::now();
+		for ( int line = 0; line < GB_SCREEN_HEIGHT; line++ ) {
+			gb.mem.highRAM[ 0x44 ] = line;
+			gb.ppu.DrawSprites( line, control, &gb );
+		}
+		spritesSeconds += SecondsSince( start );
+	}
+	gb.mem.highRAM[ 0x44 ] = LY;
+}
+
+// Runs the ROM, then draws the lines of the screen again from the state it ended in, decodes every tile and draws the
+// debug textures, with the portable kernels and with the ones picked for the host. Both have to draw the same pictures
+static int BenchRender( const char * romPath, int frameCount ) {
+	RunFrames( frameCount );
+	if ( gb.ppu.backgroundTexture.buffer == nullptr ) {
+		gb.ppu.backgroundTexture.Allocate( 256, 256, gb.ppu.frontBuffer.format );
+		gb.ppu.tilesetTexture.Allocate( 16 * 8, 24 * 8, gb.ppu.frontBuffer.format );
+	}
+	constexpr int passCount = 1000;
+	constexpr int decodeCount = 1000;
+	constexpr int textureCount = 200;
+	RenderKernels kernels[ 2 ] = { PortableRenderKernels(), HostRenderKernels() };
+	uint32		  hashes[ 2 ];
+	for ( int k = 0; k < 2; k++ ) {
+		renderKernels = kernels[ k ];
+		double linesSeconds, spritesSeconds;
+		TimeScanLines( passCount, linesSeconds, spritesSeconds );
+		uint32 hash = PictureHash( *gb.ppu.workBuffer );
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for ( int i = 0; i < decodeCount; i++ ) {
+			for ( int tile = 0; tile < gb.ppu.tiles.tileCount; tile++ ) {
+				gb.ppu.tiles.Decode( gb.mem.VRAM, tile );
+			}
+		}
+		double decodeSeconds = SecondsSince( start );
+
+		start = std::chrono::high_resolution_clock::now();
+		for ( int i = 0; i < textureCount; i++ ) {
+			gb.ppu.DrawFullBackgroundToTexture( gb.ppu.backgroundTexture, gb.ppu.backgroundTexture.width, gb.ppu.backgroundTexture.height, &gb );
+			gb.ppu.DrawTilesetToTexture( gb.ppu.tilesetTexture, &gb );
+		}
+		double texturesSeconds = SecondsSince( start );
+		hash = ( hash ^ PictureHash( gb.ppu.backgroundTexture ) ) * fnvPrime;
+		hashes[ k ] = ( hash ^ PictureHash( gb.ppu.tilesetTexture ) ) * fnvPrime;
+
+		int lineCount = passCount * GB_SCREEN_HEIGHT;
+		printf( "%s: %-12s %.1f ns per line, sprites alone %.1f ns, tile decode %.1f ns, debug textures %.1f us\n", gb.cart->romName,
+				kernels[ k ].name, linesSeconds * 1e9 / lineCount, spritesSeconds * 1e9 / lineCount,
+				decodeSeconds * 1e9 / decodeCount / gb.ppu.tiles.tileCount, texturesSeconds * 1e6 / textureCount );
+	}
+	renderKernels = HostRenderKernels();
+	printf( "%s: pictures %s\n", gb.cart->romName, hashes[ 0 ] == hashes[ 1 ] ? "identical" : "DIFFERENT" );
+	return hashes[ 0 ] == hashes[ 1 ] ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const char * pixelFormatNames[ PIXEL_FORMAT_COUNT ] = { "xrgb8888", "rgba8888", "rgb565" };
+
+int main( int argc, char ** argv ) {
+	const char * romPath = nullptr;
+	PixelFormat	 pixelFormat = PIXEL_FORMAT_XRGB8888;
+	int			 frameCount = 3600;
+	bool		 verifyJit = false;
+	bool		 benchHalt = false;
+	bool		 benchMapper = false;
+	bool		 benchJit = false;
+	bool		 benchDma = false;
+	bool		 benchState = false;
+	bool		 benchRewind = false;
+	bool		 benchRunAhead = false;
+	bool		 benchRender = false;
+	const char * loadStatePath = nullptr;
+	const char * saveStatePath = nullptr;
+	bool		 printFootprint = false;
+	for ( int i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[ i ], "--no-block-cache" ) == 0 ) {
+			gb.useBlockCache = false;
+		} else if ( strcmp( argv[ i ], "--eager-flags" ) == 0 ) {
+			gb.cpu.useLazyFlags = false;
+		} else if ( strcmp( argv[ i ], "--bench-cpu" ) == 0 ) {
+			return BenchCpu();
+		} else if ( strcmp( argv[ i ], "--bench-halt" ) == 0 ) {
+			benchHalt = true;
+		} else if ( strcmp( argv[ i ], "--bench-mapper" ) == 0 ) {
+			benchMapper = true;
+		} else if ( strcmp( argv[ i ], "--bench-jit" ) == 0 ) {
+			benchJit = true;
+		} else if ( strcmp( argv[ i ], "--bench-dma" ) == 0 ) {
+			benchDma = true;
+		} else if ( strcmp( argv[ i ], "--bench-state" ) == 0 ) {
+			benchState = true;
+		} else if ( strcmp( argv[ i ], "--bench-rewind" ) == 0 ) {
+			benchRewind = true;
+		} else if ( strcmp( argv[ i ], "--bench-run-ahead" ) == 0 ) {
+			benchRunAhead = true;
+		} else if ( strcmp( argv[ i ], "--bench-render" ) == 0 ) {
+			benchRender = true;
+		} else if ( strcmp( argv[ i ], "--portable-kernels" ) == 0 ) {
+			renderKernels = PortableRenderKernels();
+		} else if ( strcmp( argv[ i ], "--pixel-format" ) == 0 && i + 1 < argc ) {
+			const char * name = argv[ ++i ];
+			int			 format = 0;
+			while ( format < PIXEL_FORMAT_COUNT && strcmp( name, pixelFormatNames[ format ] ) != 0 ) {
+				format++;
+			}
+			if ( format == PIXEL_FORMAT_COUNT ) {
+				printf( "Unknown pixel format %s\n", name );
+				return EXIT_FAILURE;
+			}
+			pixelFormat = ( PixelFormat )format;
+		} else if ( strcmp( argv[ i ], "--run-ahead" ) == 0 && i + 1 < argc ) {
+			int frames = atoi( argv[ ++i ] );
+			gb.runAheadFrames = frames < 0 ? 0 : frames > 3 ? 3 : frames;
+		} else if ( strcmp( argv[ i ], "--load-state" ) == 0 && i + 1 < argc ) {
+			loadStatePath = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--save-state" ) == 0 && i + 1 < argc ) {
+			saveStatePath = argv[ ++i ];
+		} else if ( strcmp( argv[ i ], "--byte-dma" ) == 0 ) {
+			gb.useBulkTransfers = false;
+		} else if ( strcmp( argv[ i ], "--virtual-mapper" ) == 0 ) {
+			gb.useMapperSpecialization = false;
+		} else if ( strcmp( argv[ i ], "--no-halt-skip" ) == 0 ) {
+			gb.skipHaltedClocks = false;
+		} else if ( strcmp( argv[ i ], "--no-idle-skip" ) == 0 ) {
+			gb.skipIdleLoops = false;
+		} else if ( strcmp( argv[ i ], "--footprint" ) == 0 ) {
+			printFootprint = true;
+		} else if ( strcmp( argv[ i ], "--serial" ) == 0 ) {
+			gb.serialOutput = stdout;
+		} else if ( strcmp( argv[ i ], "--jit" ) == 0 ) {
+			gb.useJit = true;
+		} else if ( strcmp( argv[ i ], "--jit-verify" ) == 0 ) {
+			gb.useJit = true;
+			verifyJit = true;
+		} else if ( romPath == nullptr ) {
+			romPath = argv[ i ];
+		} else {
+			frameCount = atoi( argv[ i ] );
+		}
+	}
+	if ( romPath == nullptr ) {
+		printf( "Usage: %s [options] <rom> [frames]\n", argv[ 0 ] );
+		printf( "  --no-block-cache    interpret every instruction from the bus instead of using decoded blocks\n" );
+		printf( "  --eager-flags       compute Z N H C after every ALU operation instead of when they are read\n" );
+		printf( "  --bench-cpu         run the CPU micro-benchmark and exit\n" );
+		printf( "  --bench-halt        run the ROM with and without skipping halted clocks and compare\n" );
+		printf( "  --bench-mapper      run the ROM through the virtual cartridge interface and the specialized mapper and compare\n" );
+		printf( "  --bench-jit         run the ROM with the block interpreter and with the JIT and compare\n" );
+		printf( "  --bench-dma         run the ROM with DMA copied a byte at a time and in bulk, compare, and time the transfers\n" );
+		printf( "  --bench-state       time save states and snapshots after the run, and check that a loaded one runs the same\n" );
+		printf( "  --bench-rewind      capture a rewind snapshot every frame, then step back through them and check each one\n" );
+		printf( "  --bench-run-ahead   run the ROM with 0 to 3 frames of run-ahead, compare the pictures and time them\n" );
+		printf( "  --bench-render      time drawing lines, decoding tiles and the debug textures with portable and vector kernels\n" );
+		printf( "  --run-ahead <k>     run k frames ahead after each frame, 0 to 3\n" );
+		printf( "  --load-state <path> start from the save state at path instead of from power on\n" );
+		printf( "  --save-state <path> write the save state to path after the run\n" );
+		printf( "  --byte-dma          copy OAM DMA and HDMA a byte at a time through the bus\n" );
+		printf( "  --virtual-mapper    call the cartridge through its virtual interface instead of the loop compiled for its mapper\n" );
+		printf( "  --no-halt-skip      step a halted CPU 4 clocks at a time instead of jumping to the next event\n" );
+		printf( "  --no-idle-skip      run every pass of loops polling LY, STAT or RAM instead of jumping to the next event\n" );
+		printf( "  --portable-kernels  draw with the portable renderer kernels instead of the vector ones of the CPU\n" );
+		printf( "  --pixel-format <f>  draw to xrgb8888 (the default), rgba8888 or rgb565 pixels\n" );
+		printf( "  --footprint         print the memory used by the instance after the run\n" );
+		printf( "  --serial            print the bytes the game sends on the serial port\n" );
+		printf( "  --jit               compile hot ROM blocks to native code\n" );
+		printf( "  --jit-verify        same as --jit, and check every compiled block against the interpreter\n" );
+		return EXIT_FAILURE;
+	}
+
+	gb.ppu.AllocateBuffers( pixelFormat );
+	gb.InitSound();
+	gb.LoadCart( romPath );
+	if ( gb.cart == nullptr ) {
+		return EXIT_FAILURE;
+	}
+	if ( gb.useJit && !Jit::IsSupported() ) {
+		printf( "The JIT is not available on this platform, running the interpreter\n" );
+		gb.useJit = false;
+	}
+	if ( benchHalt || benchMapper || benchJit || benchDma || benchState || benchRewind || benchRunAhead || benchRender ) {
+		gb.runAheadFrames = 0;
+		int result = benchHalt	   ? BenchHalt( romPath, frameCount )
+					 : benchMapper ? BenchMapper( romPath, frameCount )
+					 : benchJit	   ? BenchJit( romPath, frameCount )
+					 : benchDma	   ? BenchDma( romPath, frameCount )
+					 : benchState  ? BenchState( romPath, frameCount )
+					 : benchRewind ? BenchRewind( romPath, frameCount )
+					 : benchRender ? BenchRender( romPath, frameCount )
+								   : BenchRunAhead( romPath, frameCount );
+		gb.ppu.DestroyBuffers();
+		delete gb.cart;
+		return result;
+	}
+
+	Gameboy * reference = nullptr;
+	if ( verifyJit && gb.runAheadFrames > 0 ) {
+		// The reference would have to run ahead and come back in step
+		printf( "Run-ahead is off while verifying the JIT\n" );
+		gb.runAheadFrames = 0;
+	}
+	if ( verifyJit && gb.useJit ) {
+		// Interpreter only twin, stepped alongside gb by the JIT
+		reference = new Gameboy();
+		reference->useBlockCache = false;
+		reference->ppu.AllocateBuffers( pixelFormat );
+		reference->InitSound();
+		reference->LoadCart( romPath );
+		gb.jit.reference = reference;
+	}
+
+	if ( loadStatePath != nullptr && !gb.LoadSaveState( loadStatePath ) ) {
+		return EXIT_FAILURE;
+	}
+
+	double seconds = RunFrames( frameCount );
+	uint32 frameHash = FrameHash();
+	printf( "%s: %d frames in %.3fs, %.1f frames/sec (%.1fx realtime), %.2f MIPS, frame hash %08x\n", gb.cart->romName, frameCount,
+			seconds, frameCount / seconds, frameCount / seconds / 60.0, gb.totalInstructions / seconds / 1000000.0, frameHash );
+	double totalClocks = ( double )gb.scheduler.now;
+	printf( "%s: %.1f%% of the clocks skipped while halted, %.1f%% in idle loops\n", gb.cart->romName,
+			gb.skippedHaltClocks * 100.0 / totalClocks, gb.skippedIdleLoopClocks * 100.0 / totalClocks );
+
+	if ( saveStatePath != nullptr && !gb.SerializeSaveState( saveStatePath ) ) {
+		return EXIT_FAILURE;
+	}
+	if ( printFootprint ) {
+		gb.PrintMemoryFootprint( stdout );
+	}
+
+	int result = EXIT_SUCCESS;
+	if ( reference != nullptr ) {
+		printf( "JIT verification: %llu blocks checked, %llu mismatches\n", gb.jit.verifiedBlocks, gb.jit.mismatches );
+		if ( gb.jit.mismatches > 0 ) {
+			result = EXIT_FAILURE;
+		}
+		reference->ppu.DestroyBuffers();
+		delete reference->cart;
+		delete reference;
+	}
+
+	gb.ppu.DestroyBuffers();
+	delete gb.cart;
+	return result;
+}
@@ -0,0 +1,303 @@
+// Debug UI for the emulation core, only linked in the SDL/OpenGL frontend so gb_core stays headless
+#include <stdint.h>
+#include <algorithm>
+#include <imgui/imgui.h>
+#include <imgui/imgui_memory_editor.h>
+#include "gameboy.h"
+#include "gl_texture.h"
+
+static MemoryEditor mem_edit;
+static GLTexture	backgroundGLTexture;
+static GLTexture	tilesetGLTexture;
+// The instance whose memory the editors show, their write handlers are only given the byte
+static Gameboy *	s_editedGameboy = nullptr;
+
+static void WriteVRAM( MemoryEditor::u8 * data, size_t offset, MemoryEditor::u8 value ) {
+	data[ offset ] = value;
+	s_editedGameboy->ppu.tiles.Invalidate( ( int )offset );
+}
+
+static void WriteOAM( MemoryEditor::u8 * data, size_t offset, MemoryEditor::u8 value ) {
+	data[ offset ] = value;
+	s_editedGameboy->ppu.spriteListsStale = true;
+}
+
+static void WriteWorkRAM( MemoryEditor::u8 * data, size_t offset, MemoryEditor::u8 value ) {
+	data[ offset ] = value;
+	BlockCache & blockCache = s_editedGameboy->blockCache;
+	if ( blockCache.IsRAMCode( ( uint32 )offset ) ) {
+		blockCache.InvalidateRAM( ( uint32 )offset );
+		s_editedGameboy->MapWorkRAMPages();
+	}
+}
+
+static void WriteHighRAM( MemoryEditor::u8 * data, size_t offset, MemoryEditor::u8 value ) {
+	data[ offset ] = value;
+	BlockCache & blockCache = s_editedGameboy->blockCache;
+	uint32		 codeOffset = BlockCache::highRAMCodeOffset + ( uint32 )offset - 0x80;
+	if ( offset >= 0x80 && offset < 0xff && blockCache.IsRAMCode( codeOffset ) ) {
+		blockCache.InvalidateRAM( codeOffset );
+	}
+}
+
+void Gameboy::DebugDraw() {
+	static float volume = 50.0f;
+	if ( ImGui::SliderFloat( "Volume", &volume, 0.0f, 100.0f ) ) {
+		if ( volume > 100.0f ) {
+			volume = 100.0f;
+		}
+		apu.volume( volume / 100 );
+	}
+	ImGui::Text( "Cpu speed: %d\n", cpu.speed );
+	ImGui::Columns( 4, "registers" );
+	ImGui::Separator();
+	ImGui::Text( "A" );
+	ImGui::NextColumn();
+	ImGui::Text( "F" );
+	ImGui::NextColumn();
+	ImGui::Text( "B" );
+	ImGui::NextColumn();
+	ImGui::Text( "C" );
+	ImGui::NextColumn();
+	ImGui::Separator();
+	ImGui::Text( "0x%02x", cpu.A.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.GetF() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.BC.high.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.BC.low.Get() );
+	ImGui::NextColumn();
+	ImGui::Columns( 2, "registers 16bits" );
+	ImGui::Separator();
+	ImGui::Text( "0x%04x", ( uint16 )( cpu.A.Get() << 8 ) | ( cpu.GetF() ) );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%04x", cpu.BC.Get() );
+	ImGui::NextColumn();
+	ImGui::Columns( 4, "registers" );
+	ImGui::Separator();
+	ImGui::Text( "D" );
+	ImGui::NextColumn();
+	ImGui::Text( "E" );
+	ImGui::NextColumn();
+	ImGui::Text( "H" );
+	ImGui::NextColumn();
+	ImGui::Text( "L" );
+	ImGui::NextColumn();
+	ImGui::Separator();
+	ImGui::Text( "0x%02x", cpu.DE.high.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.DE.low.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.HL.high.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%02x", cpu.HL.low.Get() );
+	ImGui::NextColumn();
+	ImGui::Columns( 2, "registers 16bits" );
+	ImGui::Separator();
+	ImGui::Text( "0x%04x", cpu.DE.Get() );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%04x", cpu.HL.Get() );
+	ImGui::NextColumn();
+	ImGui::Columns( 2, "PC and SP" );
+	ImGui::Separator();
+	ImGui::Text( "PC" );
+	ImGui::NextColumn();
+	ImGui::Text( "SP" );
+	ImGui::NextColumn();
+	ImGui::Separator();
+	ImGui::Text( "0x%04x", cpu.PC );
+	ImGui::NextColumn();
+	ImGui::Text( "0x%04x", cpu.SP.Get() );
+	ImGui::NextColumn();
+	ImGui::Columns( 4, "flags" );
+	ImGui::Separator();
+	ImGui::Text( "Z" );
+	ImGui::NextColumn();
+	ImGui::Text( "N" );
+	ImGui::NextColumn();
+	ImGui::Text( "H" );
+	ImGui::NextColumn();
+	ImGui::Text( "C" );
+	ImGui::NextColumn();
+	ImGui::Separator();
+	ImGui::Text( "%d", cpu.GetZ() );
+	ImGui::NextColumn();
+	ImGui::Text( "%d", cpu.GetN() );
+	ImGui::NextColumn();
+	ImGui::Text( "%d", cpu.GetH() );
+	ImGui::NextColumn();
+	ImGui::Text( "%d", cpu.GetC() );
+	ImGui::NextColumn();
+
+	ImGui::Columns( 1 );
+	ImGui::Separator();
+	ImGui::Text( "Last instruction: %s", Cpu::s_instructionsNames[ cpu.lastInstructionOpCode ] );
+	ImGui::Text( "Next instruction: %s", Cpu::s_instructionsNames[ Read( cpu.PC ) ] );
+	ImGui::Checkbox( "Skip bios", &skipBios );
+	ImGui::SameLine();
+	ImGui::Checkbox( "Print OPCodes", &dumpOPcodesToStdout );
+
+	ImGui::Text("Total instructions: %lld", totalInstructions);
+
+	static char PCBreakpointStr[ 64 ] = "";
+	ImGui::InputText( "Break at PC: ", PCBreakpointStr, 64, ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase );
+	if ( PCBreakpointStr[ 0 ] != '\0' ) {
+		PCBreakpoint = strtol( PCBreakpointStr, nullptr, 16 );
+	}
+	static char InstructionBreakpointStr[ 64 ] = "";
+	ImGui::InputText( "Break at instruction Count: ", InstructionBreakpointStr, 64, ImGuiInputTextFlags_CharsHexadecimal | ImGuiInputTextFlags_CharsUppercase );
+	if ( InstructionBreakpointStr[ 0 ] != '\0' ) {
+		instructionCountBreakpoint = strtoull( InstructionBreakpointStr, nullptr, 10 );
+	}
+
+	if ( ImGui::Button( "Step" ) ) {
+		shouldStep = true;
+	}
+
+	static int showRomCode = false;
+	if ( ImGui::Button( showRomCode ? "Hide ROM Code" : "Show ROM Code" ) ) {
+		showRomCode = !showRomCode;
+	}
+	ImGui::SameLine();
+	if ( ImGui::Button( "Generate ROM Code" ) && cart != nullptr ) {
+		cart->GenerateSourceCode();
+	}
+
+	static int showMemoryInspector = false;
+	if ( ImGui::TreeNode( "Memory" ) ) {
+		ImGui::TreePop();
+		ImGui::Text( "workRAM bank: %d", mem.workRAMBankIndex );
+		ImGui::Text( "VRAM bank: %d", mem.VRAMBankIndex );
+		ImGui::Text( "Input mask: %d", mem.inputMask );
+		ImGui::Text( "hdma length: %d", mem.hdmaLength );
+		ImGui::Text( "hdma active: %d", mem.hdmaActive );
+		if ( ImGui::Button( showMemoryInspector ? "Hide Memory" : "Show Memory" ) ) {
+			showMemoryInspector = !showMemoryInspector;
+		}
+	}
+
+	if ( ImGui::TreeNode( "Pixel Processing Unit" ) ) {
+		ppu.DebugDraw( this );
+		ImGui::TreePop();
+	}
+	if ( cart != nullptr ) {
+		if ( ImGui::TreeNode( "Cartridge" ) ) {
+			cart->DebugDraw();
+			ImGui::TreePop();
+		}
+	}
+
+	if ( showRomCode && cart != nullptr ) {
+		ImGui::Begin( "ROM Code" );
+		ImGui::BeginGroup();
+
+		ImGui::BeginChild( ImGui::GetID( "ROM CODE DUMP" ) );
+		int remainingLines = 100; // TMP: it is really slow to display a huge list with ImGUI, this is temporary to reduce pressure
+		bool pcFound = false;
+		int PC = cart->DebugResolvePC(cpu.PC);
+		size_t startIndex = 0;
+
+		//binary search our address
+		auto it = std::lower_bound(cart->sourceCodeAddresses.begin(), cart->sourceCodeAddresses.end(), PC);
+		if (it == cart->sourceCodeAddresses.end() || *it != PC) {
+			startIndex = 0;
+		} else {
+			std::size_t index = std::distance(cart->sourceCodeAddresses.begin(), it);
+			startIndex = MAX((int64)index - 100, 0);
+		}   
+
+		for ( size_t i = startIndex; i < startIndex + 200 && i < cart->sourceCodeLines.size(); i++) {
+			const std::string & line = cart->sourceCodeLines[i];
+			bool colored = false;
+			if ( cart->sourceCodeAddresses[i] == PC ) {
+				colored = true;
+				pcFound = true;
+				ImGui::SetScrollHereY( 0.5f ); // 0.0f:top, 0.5f:center, 1.0f:bottom
+			}
+			if ( colored ) {
+				ImGui::TextColored( ImVec4( 1, 1, 0, 1 ), "%s", line.c_str() );
+			} else {
+				ImGui::Text( "%s", line.c_str() );
+			}
+			if (pcFound && remainingLines-- <= 0) {
+				break;
+			}
+		}
+		ImGui::EndChild();
+		ImGui::EndGroup();
+		ImGui::End();
+	}
+
+	if ( showMemoryInspector ) {
+		// Edits land in memory directly, the handlers drop what was derived from the byte written
+		s_editedGameboy = this;
+		mem_edit.WriteFn = WriteVRAM;
+		mem_edit.DrawWindow( "VRAM", mem.VRAM, mem.VRAMSize, 0x0 );
+		mem_edit.WriteFn = WriteHighRAM;
+		mem_edit.DrawWindow( "HighRAM", mem.highRAM, 0x100, 0x0 );
+		mem_edit.WriteFn = WriteOAM;
+		mem_edit.DrawWindow( "OAM", mem.OAM, 0xa0, 0x0 );
+		mem_edit.WriteFn = WriteWorkRAM;
+		mem_edit.DrawWindow( "WorkRAM", mem.workRAM, mem.workRAMSize, 0x0 );
+		mem_edit.WriteFn = nullptr;
+		if ( cart != nullptr ) {
+			// The image is read-only
+			mem_edit.ReadOnly = true;
+			mem_edit.DrawWindow( "ROM", ( void * )cart->GetRawMemory(), cart->rawMemorySize, 0x0 );
+			mem_edit.ReadOnly = false;
+		}
+	}
+}
+
+void Ppu::DebugDraw(Gameboy * gb) {
+	//ImGui::Image((void*)(ppu->frontBuffer->textureHandler), ImVec2(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
+	const char * palettesNames[] = { "Green", "Grey", "Blue" };
+	if (ImGui::Combo("Palette theme", &selectedPalette, palettesNames, 3)) {
+		linePaletteStale = true;
+	}
+	ImGui::Checkbox( "Draw tiles", &(Ppu::debugDrawTiles) );
+	ImGui::SameLine();
+	ImGui::Checkbox( "Draw sprites", &(Ppu::debugDrawSprites) );
+	byte scrollY = gb->Read(0xff42);
+	byte scrollX = gb->Read(0xff43);
+	ImGui::Text("Scroll X %d Scroll Y %d", scrollX, scrollY);
+	ImGui::Text("Scanline counter: %d", ScanlineCounterAt(gb->scheduler.now));
+	byte currentLine = gb->Read(0xff44);
+	ImGui::Text("Current line: %d", currentLine);
+
+	if ( backgroundGLTexture.textureHandler == 0 ) {
+		backgroundGLTexture.Allocate();
+		tilesetGLTexture.Allocate();
+	}
+	if ( backgroundTexture.buffer == nullptr ) {
+		backgroundTexture.Allocate(256, 256);
+		tilesetTexture.Allocate(16 * 8, 24 * 8);
+	}
+
+	ImGui::Checkbox( "Draw background texture", &drawBackgroundTexture );
+	if (drawBackgroundTexture) {
+		DrawFullBackgroundToTexture(backgroundTexture, backgroundTexture.width, backgroundTexture.height, gb);
+		backgroundGLTexture.Update(backgroundTexture);
+		ImGui::Image((void*)(intptr_t)(backgroundGLTexture.textureHandler), ImVec2((float)backgroundTexture.width, (float)backgroundTexture.height), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
+	}
+	static bool drawTileset = false;
+	ImGui::Checkbox( "Draw tileset", &drawTileset);
+	if (drawTileset) {
+		tilesetTexture.Clear();
+		DrawTilesetToTexture(tilesetTexture, gb);
+		tilesetGLTexture.Update(tilesetTexture);
+		ImGui::Image((void*)(intptr_t)(tilesetGLTexture.textureHandler), ImVec2((float)tilesetTexture.width, (float)tilesetTexture.height), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
+	}
+	
+}
+
+void Cartridge::DebugDraw() {
+	ImGui::Checkbox("Force DMG", &forceDMGMode);
+	ImGui::Text("ROM size: %#x", rawMemorySize);
+	if ( ROMIsMBC5( type ) ) {
+		MBC5 * mbc = static_cast< MBC5 * >( this );
+		ImGui::Text( "Rom bank: %d", mbc->romBank );
+		ImGui::Text( "Ram bank: %d", mbc->ramBank );
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <GL/gl3w.h>
+#include "../simple_texture.h"
+
+struct GLTexture {
+	uint32		textureHandler = 0;
+	// Of the storage made by the last upload, the next ones of the same size and format only replace the pixels
+	int			width = 0;
+	int			height = 0;
+	PixelFormat format = PIXEL_FORMAT_COUNT;
+
+	void Allocate() {
+		glGenTextures( 1, &textureHandler );
+		glBindTexture( GL_TEXTURE_2D, textureHandler );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	}
+
+	void Destroy() {
+		glDeleteTextures( 1, &textureHandler );
+		format = PIXEL_FORMAT_COUNT;
+	}
+
+	void Bind() { glBindTexture( GL_TEXTURE_2D, textureHandler ); }
+
+	void Update( const SimpleTexture & image ) {
+		// The layouts the pixel formats were picked for, uploaded without conversion
+		GLint  internalFormat = GL_RGBA8;
+		GLenum pixelFormat = GL_BGRA;
+		GLenum type = GL_UNSIGNED_INT_8_8_8_8_REV;
+		if ( image.format == PIXEL_FORMAT_RGBA8888 ) {
+			pixelFormat = GL_RGBA;
+			type = GL_UNSIGNED_BYTE;
+		} else if ( image.format == PIXEL_FORMAT_RGB565 ) {
+			internalFormat = GL_RGB565;
+			pixelFormat = GL_RGB;
+			type = GL_UNSIGNED_SHORT_5_6_5;
+		}
+		Bind();
+		glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, image.pitch / BytesPerPixel( image.format ) );
+		if ( image.width == width && image.height == height && image.format == format ) {
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, width, height, pixelFormat, type, image.buffer );
+		} else {
+			glTexImage2D( GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, pixelFormat, type, image.buffer );
+			width = image.width;
+			height = image.height;
+			format = image.format;
+		}
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+	}
+};
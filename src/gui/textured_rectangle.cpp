@@ -78,6 +78,7 @@ void TexturedRectangle::Allocate( int x, int y, int width, int height, const Win
 	glEnableVertexAttribArray( 1 );
 
 	glBindVertexArray( 0 );
+	texture.Allocate();
 	Resize( x, y, width, height, window );
 }
 
@@ -132,10 +133,11 @@ void TexturedRectangle::RefreshSize( const Window & window ) {
 void TexturedRectangle::Destroy() {
 	glDeleteVertexArrays( 1, &VAO );
 	glDeleteBuffers( 1, &VBO );
+	texture.Destroy();
 }
 
-void TexturedRectangle::Draw() {
-	texture.Update();
+void TexturedRectangle::Draw( const SimpleTexture & image ) {
+	texture.Update( image );
 	texture.Bind();
 	glUseProgram( shaderProgram );
 	glBindVertexArray( VAO );
@@ -1,12 +1,12 @@
 #pragma once
 
 #include <string.h>
-#include "../simple_texture.h"
+#include "gl_texture.h"
 
 struct Window;
 
 struct TexturedRectangle {
-	SimpleTexture	texture;
+	GLTexture		texture;
 	uint32			VBO;
 	uint32			VAO;
 	uint32			EBO;
@@ -21,7 +21,7 @@ struct TexturedRectangle {
 
 	void Allocate( int x, int y, int width, int height, const Window & window );
 	void Destroy();
-	void Draw();
+	void Draw( const SimpleTexture & image );
 	void Resize( int x, int y, int width, int height, const Window & window );
 	void RefreshSize( const Window & window );
 };
\ No newline at end of file
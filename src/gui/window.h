@@ -1,6 +1,7 @@
 #pragma once
 #include "../gameboy.h"
 #include "../gb_emu.h"
+#include "textured_rectangle.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_opengl3.h"
 #include "imgui/imgui_impl_sdl.h"
@@ -26,6 +27,7 @@ enum eKey {
 	KEY_ESCAPE = SDLK_ESCAPE,
 	KEY_SPACE = SDLK_SPACE,
 	KEY_ENTER = SDLK_RETURN,
+	KEY_BACKSPACE = SDLK_BACKSPACE,
 };
 
 enum eGameBoyKeyValue : byte {
@@ -98,7 +100,7 @@ struct Window {
 
 	void SwapBuffers() { SDL_GL_SwapWindow( this->glWindow ); }
 
-	void PollEvents( Gameboy * gb ) {
+	void PollEvents( Gameboy * gb, TexturedRectangle & screen ) {
 		SDL_Event event;
 		while ( SDL_PollEvent( &event ) ) {
 			ImGui_ImplSDL2_ProcessEvent( &event );
@@ -115,8 +117,7 @@ struct Window {
 			if ( event.type == SDL_WINDOWEVENT_RESIZED ) {
 				Width = event.window.data1;
 				Height = event.window.data1;
-				gb->ppu.frontBuffer.RefreshSize( *this );
-				gb->ppu.backBuffer.RefreshSize( *this );
+				screen.RefreshSize( *this );
 			}
 			if ( event.type == SDL_KEYDOWN ) {
 				auto key = event.key.keysym.sym;
@@ -152,6 +153,9 @@ struct Window {
 					gb->mem.inputMask = BIT_UNSET( gb->mem.inputMask, eGameBoyKeyValue::GB_KEY_SELECT );
 					gb->RaiseInterupt( 4 );
 				}
+				if ( key == eKey::KEY_BACKSPACE ) {
+					rewindHeld = true;
+				}
 			}
 			if ( event.type == SDL_KEYUP ) {
 				auto key = event.key.keysym.sym;
@@ -179,6 +183,9 @@ struct Window {
 				if ( key == eKey::KEY_RIGHT_SHIFT ) {
 					gb->mem.inputMask = BIT_SET( gb->mem.inputMask, eGameBoyKeyValue::GB_KEY_SELECT );
 				}
+				if ( key == eKey::KEY_BACKSPACE ) {
+					rewindHeld = false;
+				}
 			}
 		}
 	}
@@ -186,4 +193,6 @@ struct Window {
 	SDL_Window *  glWindow;
 	SDL_GLContext glContext;
 	bool          shouldClose = false;
+	// Game goes back in time while the key is down
+	bool          rewindHeld = false;
 };
@@ -0,0 +1,1472 @@
+#include <string.h>
+#include <functional>
+#include "jit.h"
+#include "gameboy.h"
+
+#if GBEMU_JIT_SUPPORTED
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Host registers, numbered like in the x86 encoding
+enum HostRegister : byte {
+	RAX = 0,
+	RCX = 1,
+	RDX = 2,
+	RBX = 3,
+	RSP = 4,
+	RBP = 5,
+	RSI = 6,
+	RDI = 7,
+	R8 = 8,
+	R9 = 9,
+	R10 = 10,
+	R11 = 11,
+	R12 = 12,
+	R13 = 13,
+	R14 = 14,
+	R15 = 15,
+};
+
+#if defined( _WIN32 )
+static constexpr HostRegister ARG0 = RCX;
+static constexpr HostRegister ARG1 = RDX;
+static constexpr HostRegister ARG2 = R8;
+static constexpr HostRegister ARG3 = R9;
+#else
+static constexpr HostRegister ARG0 = RDI;
+static constexpr HostRegister ARG1 = RSI;
+static constexpr HostRegister ARG2 = RDX;
+static constexpr HostRegister ARG3 = RCX;
+#endif
+
+// Where the generated code keeps the machine and the guest registers for the whole block. All callee saved, so they
+// survive the helper calls. Pairs are held as 16 bit values, F is always materialized. SP and PC stay in Cpu
+static constexpr HostRegister REG_GB = RBX;
+static constexpr HostRegister REG_F = RBP;
+static constexpr HostRegister REG_BC = R12;
+static constexpr HostRegister REG_DE = R13;
+static constexpr HostRegister REG_HL = R14;
+static constexpr HostRegister REG_A = R15;
+
+// Guest register index as found in the opcode bits, 6 is (HL)
+enum GuestRegister : byte { GB_B, GB_C, GB_D, GB_E, GB_H, GB_L, GB_HL_INDIRECT, GB_A };
+
+// x86 condition codes
+enum Condition : byte { CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_LE = 0xe, CC_G = 0xf };
+
+// Arithmetic group, the /digit of the 0x80 to 0x83 opcodes
+enum AluOperation : byte { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+
+// Shift group, the /digit of the 0xc0, 0xc1, 0xd0 and 0xd1 opcodes
+enum ShiftOperation : byte { SHIFT_ROL, SHIFT_ROR, SHIFT_RCL, SHIFT_RCR, SHIFT_SHL, SHIFT_SHR, SHIFT_SAR = 7 };
+
+static bool IsIORegister( uint32 addr ) { return addr >= 0xff00 && ( addr < 0xff80 || addr == 0xffff ); }
+
+static int FinishAndCheck( Gameboy * gb, int clocks ) {
+	int expectedTime = gb->cpu.cpuTime + clocks;
+	gb->FinishInstruction( clocks );
+	// A different cpuTime means an interrupt was serviced
+	return gb->cpu.cpuTime != expectedTime || gb->cpu.isOnHalt || !gb->shouldRun || gb->cpu.cpuTime >= gb->jit.clockBudget ||
+		   gb->jit.generation != gb->blockCache.generation;
+}
+
+// Helpers called from the generated code. Apart from JitInterpret, they run while the guest registers are in host
+// registers and must not touch A, F, BC, DE or HL. The generated code only adds the clocks of a run of instructions to
+// cpuTime and scheduler.now when it ends, the helpers get the clocks of the instructions before theirs to access IO
+// registers at the right time
+
+// Finishes an instruction through the scheduler when an event comes due during it, the budget runs out or it touched
+// IO registers. Returns non zero when the block has to stop
+static int JitFinish( Gameboy * gb, int clocks ) { return FinishAndCheck( gb, clocks ); }
+
+static int JitInterpret( Gameboy * gb, const DecodedInstruction * instruction ) {
+	Cpu & cpu = gb->cpu;
+	cpu.lastInstructionOpCode = instruction->opcode;
+	cpu.PC = instruction->pc + 1;
+	cpu.decodedOperands = instruction->operands;
+	int clocks = ( cpu.*instruction->handler )( gb );
+	cpu.decodedOperands = nullptr;
+	// The generated code reads and writes F directly
+	cpu.MaterializeFlags();
+	gb->totalInstructions++;
+	return FinishAndCheck( gb, clocks );
+}
+
+// Returns the byte read, with bit 8 set when the read moved an event or requested an interrupt, so the instruction
+// has to be finished through the scheduler
+static int JitRead( Gameboy * gb, uint32 addr, int clocksBefore ) {
+	if ( !IsIORegister( addr ) ) {
+		return gb->Read( addr );
+	}
+	uint64 deadline = gb->scheduler.nextDeadline;
+	byte   requested = gb->mem.highRAM[ 0x0f ];
+	gb->cpu.cpuTime += clocksBefore;
+	gb->scheduler.now += clocksBefore;
+	int value = gb->Read( addr );
+	gb->cpu.cpuTime -= clocksBefore;
+	gb->scheduler.now -= clocksBefore;
+	if ( deadline != gb->scheduler.nextDeadline || requested != gb->mem.highRAM[ 0x0f ] ) {
+		value |= 0x100;
+	}
+	return value;
+}
+
+// Returns non zero when the instruction has to be finished through the scheduler: the write went to an IO register,
+// or to the cartridge or RAM holding code, which stops the block like in RunBlock
+static int JitWrite( Gameboy * gb, uint32 addr, uint32 value, int clocksBefore ) {
+	if ( !IsIORegister( addr ) ) {
+		gb->Write( addr, value );
+		return gb->jit.generation != gb->blockCache.generation;
+	}
+	// A general purpose DMA stalls the CPU from inside the write, its clocks stay
+	gb->cpu.cpuTime += clocksBefore;
+	gb->scheduler.now += clocksBefore;
+	gb->Write( addr, value );
+	gb->cpu.cpuTime -= clocksBefore;
+	gb->scheduler.now -= clocksBefore;
+	return 1;
+}
+
+// A register or [base + index * scale + disp]
+struct Operand {
+	bool  memory = false;
+	int	  base = 0;
+	int	  index = -1;
+	int	  scale = 0;
+	int32 disp = 0;
+};
+
+static Operand Reg( HostRegister reg ) {
+	Operand operand;
+	operand.base = reg;
+	return operand;
+}
+
+static Operand Mem( HostRegister base, int32 disp, int index = -1, int scale = 0 ) {
+	Operand operand;
+	operand.memory = true;
+	operand.base = base;
+	operand.disp = disp;
+	operand.index = index;
+	operand.scale = scale;
+	return operand;
+}
+
+struct X64Emitter {
+	struct Fixup {
+		int position; // Right after the rel32
+		int label;
+	};
+
+	std::vector< byte >	 code;
+	std::vector< int >	 labels;
+	std::vector< Fixup > fixups;
+
+	void Emit8( byte value ) { code.push_back( value ); }
+	void Emit16( uint16 value ) {
+		Emit8( value & 0xff );
+		Emit8( value >> 8 );
+	}
+	void Emit32( uint32 value ) {
+		Emit16( value & 0xffff );
+		Emit16( value >> 16 );
+	}
+	void Emit64( uint64 value ) {
+		Emit32( (uint32)value );
+		Emit32( ( uint32 )( value >> 32 ) );
+	}
+	void Emit( std::initializer_list< byte > bytes ) {
+		for ( byte b : bytes ) {
+			Emit8( b );
+		}
+	}
+
+	// Prefixes, opcode and ModRM of an instruction of size 1, 2, 4 or 8 bytes. reg is a register of that size, or a
+	// /digit or a wider register when byteReg is false
+	void Encode( std::initializer_list< byte > opcode, int reg, const Operand & rm, int size, bool byteReg = true ) {
+		if ( size == 2 ) {
+			Emit8( 0x66 );
+		}
+		byte rex = 0x40 | ( size == 8 ? 0x08 : 0 ) | ( reg & 8 ? 0x04 : 0 ) | ( rm.index >= 8 ? 0x02 : 0 ) | ( rm.base & 8 ? 0x01 : 0 );
+		// Without a REX prefix, byte registers 4 to 7 are AH to BH instead of SPL to DIL
+		bool byteRegisters = size == 1 && ( ( byteReg && ( reg & 7 ) >= 4 ) || ( !rm.memory && ( rm.base & 7 ) >= 4 ) );
+		if ( rex != 0x40 || byteRegisters ) {
+			Emit8( rex );
+		}
+		Emit( opcode );
+		byte mod = !rm.memory ? 0xc0 : rm.disp >= -128 && rm.disp < 128 ? 0x40 : 0x80;
+		if ( !rm.memory ) {
+			Emit8( mod | ( ( reg & 7 ) << 3 ) | ( rm.base & 7 ) );
+			return;
+		} else if ( rm.index < 0 && ( rm.base & 7 ) != RSP ) {
+			Emit8( mod | ( ( reg & 7 ) << 3 ) | ( rm.base & 7 ) );
+		} else {
+			Emit8( mod | 0x04 | ( ( reg & 7 ) << 3 ) );
+			Emit8( ( rm.scale << 6 ) | ( ( rm.index < 0 ? RSP : rm.index ) & 7 ) << 3 | ( rm.base & 7 ) );
+		}
+		mod == 0x40 ? Emit8( rm.disp ) : Emit32( rm.disp );
+	}
+
+	void Mov32( HostRegister dst, HostRegister src ) { Encode( { 0x89 }, src, Reg( dst ), 4 ); }
+	void Mov64( HostRegister dst, HostRegister src ) { Encode( { 0x89 }, src, Reg( dst ), 8 ); }
+	void MovImm32( HostRegister reg, uint32 value ) {
+		if ( reg >= R8 ) {
+			Emit8( 0x41 );
+		}
+		Emit8( 0xb8 + ( reg & 7 ) );
+		Emit32( value );
+	}
+	void MovImm64( HostRegister reg, uint64 value ) {
+		Emit( { ( byte )( reg >= R8 ? 0x49 : 0x48 ), ( byte )( 0xb8 + ( reg & 7 ) ) } );
+		Emit64( value );
+	}
+	// Loads of size bytes, zero extended to 32 bits
+	void Load( HostRegister dst, const Operand & src, int size ) {
+		if ( size == 1 ) {
+			Encode( { 0x0f, 0xb6 }, dst, src, src.memory ? 4 : 1, false );
+		} else if ( size == 2 ) {
+			Encode( { 0x0f, 0xb7 }, dst, src, 4 );
+		} else {
+			Encode( { 0x8b }, dst, src, size );
+		}
+	}
+	void Store( const Operand & dst, HostRegister src, int size ) { Encode( { size == 1 ? ( byte )0x88 : ( byte )0x89 }, src, dst, size ); }
+	void StoreImm( const Operand & dst, uint32 value, int size ) {
+		Encode( { size == 1 ? ( byte )0xc6 : ( byte )0xc7 }, 0, dst, size, false );
+		if ( size == 1 ) {
+			Emit8( value );
+		} else if ( size == 2 ) {
+			Emit16( value );
+		} else {
+			Emit32( value );
+		}
+	}
+	void Alu( AluOperation operation, const Operand & dst, HostRegister src, int size ) {
+		Encode( { ( byte )( operation * 8 + ( size == 1 ? 0 : 1 ) ) }, src, dst, size );
+	}
+	void AluLoad( AluOperation operation, HostRegister dst, const Operand & src, int size ) {
+		Encode( { ( byte )( operation * 8 + ( size == 1 ? 2 : 3 ) ) }, dst, src, size );
+	}
+	void AluImm( AluOperation operation, const Operand & dst, int32 value, int size ) {
+		if ( size == 1 ) {
+			Encode( { 0x80 }, operation, dst, 1, false );
+			Emit8( value );
+		} else if ( value >= -128 && value < 128 ) {
+			Encode( { 0x83 }, operation, dst, size );
+			Emit8( value );
+		} else {
+			Encode( { 0x81 }, operation, dst, size );
+			size == 2 ? Emit16( value ) : Emit32( value );
+		}
+	}
+	void Shift( ShiftOperation operation, HostRegister reg, int count, int size ) {
+		if ( count == 1 ) {
+			Encode( { size == 1 ? ( byte )0xd0 : ( byte )0xd1 }, operation, Reg( reg ), size, false );
+		} else {
+			Encode( { size == 1 ? ( byte )0xc0 : ( byte )0xc1 }, operation, Reg( reg ), size, false );
+			Emit8( count );
+		}
+	}
+	void TestImm( const Operand & operand, uint32 value, int size ) {
+		Encode( { size == 1 ? ( byte )0xf6 : ( byte )0xf7 }, 0, operand, size, false );
+		size == 1 ? Emit8( value ) : Emit32( value );
+	}
+	void Test( HostRegister a, HostRegister b, int size ) { Encode( { size == 1 ? ( byte )0x84 : ( byte )0x85 }, b, Reg( a ), size ); }
+	void Inc( const Operand & operand, int size ) { Encode( { size == 1 ? ( byte )0xfe : ( byte )0xff }, 0, operand, size, false ); }
+	void Dec( const Operand & operand, int size ) { Encode( { size == 1 ? ( byte )0xfe : ( byte )0xff }, 1, operand, size, false ); }
+	void Cmov( Condition condition, HostRegister dst, HostRegister src, int size ) {
+		Encode( { 0x0f, ( byte )( 0x40 + condition ) }, dst, Reg( src ), size );
+	}
+	void SetCondition( Condition condition, HostRegister reg ) { Encode( { 0x0f, ( byte )( 0x90 + condition ) }, 0, Reg( reg ), 1, false ); }
+	// Carry flag = bit of reg
+	void BitTest( HostRegister reg, int bit ) {
+		Encode( { 0x0f, 0xba }, 4, Reg( reg ), 4 );
+		Emit8( bit );
+	}
+	void Lahf() { Emit8( 0x9f ); }
+	// movzx ecx, ah, which cannot have a REX prefix
+	void LoadAHToECX() { Emit( { 0x0f, 0xb6, 0xcc } ); }
+	void Push( HostRegister reg ) {
+		if ( reg >= R8 ) {
+			Emit8( 0x41 );
+		}
+		Emit8( 0x50 + ( reg & 7 ) );
+	}
+	void Pop( HostRegister reg ) {
+		if ( reg >= R8 ) {
+			Emit8( 0x41 );
+		}
+		Emit8( 0x58 + ( reg & 7 ) );
+	}
+	void Call( const void * function ) {
+		MovImm64( RAX, ( uint64 )function );
+		Emit( { 0xff, 0xd0 } ); // call rax
+	}
+	void Ret() { Emit8( 0xc3 ); }
+
+	int	 NewLabel() {
+		 labels.push_back( -1 );
+		 return (int)labels.size() - 1;
+	}
+	void Bind( int label ) { labels[ label ] = (int)code.size(); }
+	void Jump( int label ) {
+		Emit8( 0xe9 );
+		Emit32( 0 );
+		fixups.push_back( { (int)code.size(), label } );
+	}
+	void JumpIf( Condition condition, int label ) {
+		Emit( { 0x0f, ( byte )( 0x80 + condition ) } );
+		Emit32( 0 );
+		fixups.push_back( { (int)code.size(), label } );
+	}
+	void PatchJumps() {
+		for ( const Fixup & fixup : fixups ) {
+			int32 offset = labels[ fixup.label ] - fixup.position;
+			memcpy( &code[ fixup.position - 4 ], &offset, 4 );
+		}
+	}
+};
+
+// Clocks of the instructions compiled to native code, 0 for the ones left to the interpreter. Conditional control flow
+// gets the clocks of the branch not taken, it always ends a block so they are never added to those of the next ones
+static int NativeClocks( const DecodedInstruction & instruction ) {
+	byte opcode = instruction.opcode;
+	if ( opcode == 0x76 ) {
+		// HALT
+		return 0;
+	} else if ( opcode >= 0x40 && opcode < 0xc0 ) {
+		// LD r, r and ALU A, r
+		return ( opcode & 7 ) == GB_HL_INDIRECT || ( opcode >= 0x70 && opcode < 0x78 ) ? 8 : 4;
+	} else if ( opcode < 0x40 ) {
+		switch ( opcode & 0xf ) {
+			case 0x0:
+				// NOP, STOP is left out, JR cc
+				return opcode == 0x00 ? 4 : opcode == 0x10 ? 0 : 8;
+			case 0x1:
+				return 12;
+			case 0x2:
+			case 0x3:
+			case 0x9:
+			case 0xa:
+			case 0xb:
+				return 8;
+			case 0x4:
+			case 0x5:
+			case 0xc:
+			case 0xd:
+				return opcode == 0x34 || opcode == 0x35 ? 12 : 4;
+			case 0x6:
+			case 0xe:
+				return opcode == 0x36 ? 12 : 8;
+			case 0x7:
+			case 0xf:
+				// Rotations of A, SCF, CPL and CCF. DAA is left out
+				return opcode == 0x27 ? 0 : 4;
+			case 0x8:
+				// LD (a16), SP is left out, JR, JR cc
+				return opcode == 0x08 ? 0 : opcode == 0x18 ? 12 : 8;
+		}
+	}
+	switch ( opcode ) {
+		case 0xc0: // RET cc
+		case 0xc8:
+		case 0xd0:
+		case 0xd8:
+			return 8;
+		case 0xc1: // POP
+		case 0xd1:
+		case 0xe1:
+		case 0xf1:
+		case 0xc2: // JP cc
+		case 0xca:
+		case 0xd2:
+		case 0xda:
+		case 0xc4: // CALL cc
+		case 0xcc:
+		case 0xd4:
+		case 0xdc:
+			return 12;
+		case 0xc5: // PUSH
+		case 0xd5:
+		case 0xe5:
+		case 0xf5:
+		case 0xc7: // RST
+		case 0xcf:
+		case 0xd7:
+		case 0xdf:
+		case 0xe7:
+		case 0xef:
+		case 0xf7:
+		case 0xff:
+		case 0xc3: // JP
+		case 0xc9: // RET
+			return 16;
+		case 0xcd: // CALL
+			return 24;
+		case 0xc6: // ALU A, d8
+		case 0xce:
+		case 0xd6:
+		case 0xde:
+		case 0xe6:
+		case 0xee:
+		case 0xf6:
+		case 0xfe:
+		case 0xf9: // LD SP, HL
+			return 8;
+		case 0xe9: // JP HL
+		case 0xf3: // DI
+			return 4;
+		case 0xe2: // LD (C), A  LD A, (C)
+		case 0xf2:
+			return 8;
+		case 0xe0: // LDH
+		case 0xf0:
+			return 12;
+		case 0xea: // LD (a16), A  LD A, (a16)
+		case 0xfa:
+			return 16;
+		case 0xcb: {
+			// Same as the interpreter
+			byte cbOpcode = instruction.operands[ 0 ];
+			if ( ( cbOpcode & 7 ) != GB_HL_INDIRECT ) {
+				return 2;
+			}
+			return cbOpcode >= 0x40 && cbOpcode < 0x80 ? 3 : 4;
+		}
+		default:
+			// EI and RETI, which change when interrupts are taken, the stack pointer arithmetic and the invalid opcodes
+			return 0;
+	}
+}
+
+// Turns one block into a function. The instructions compiled to native code form runs that keep cpuTime and
+// scheduler.now where they were at the start of the run and only add their clocks at its end. The start of a run checks
+// that no interrupt can be taken and computes the slack, the clocks until the next event or the end of the budget.
+// Each instruction compares the clocks of the run so far against it, and when they reach it goes through the
+// scheduler like in the interpreter. The other instructions call their handler, in between runs
+struct JitCompiler {
+	X64Emitter		  emitter;
+	const CodeBlock * block;
+	std::vector< int > clocks;
+	// Code for the rare paths, emitted after the block so the common one runs straight
+	std::vector< std::function< void() > > stubs;
+
+	// Offsets from the Gameboy
+	int A, F, BC, DE, HL, SP, PC;
+	int lastOpcode, cpuTime, interuptsEnabled, interuptsOn, IF, IE;
+	int now, nextDeadline, totalInstructions, readPages, writePages, highRAM, ramCodeBits;
+	int clockBudget, lahfToFlags;
+
+	// Labels of the exits, eax holds the return value. spill stores the guest registers back first
+	int spill;
+	int epilogue;
+	int done;
+	int doneWithoutSpill;
+
+	// The run being compiled: index of its first instruction and clocks of those before the current one
+	int runStart = 0;
+	int runClocks = 0;
+
+	// Right after the win64 shadow space in the stack frame: one temporary that survives helper calls, and the slack of
+	// the run, set to INT32_MIN by the memory accesses that need the instruction finished through the scheduler
+	static constexpr int temporary = 32;
+	static constexpr int slack = 36;
+
+	JitCompiler( Gameboy * gb, const CodeBlock * block ) : block( block ) {
+		auto offset = [ gb ]( const void * p ) { return (int)( (const byte *)p - (const byte *)gb ); };
+		Cpu & cpu = gb->cpu;
+		A = offset( cpu.A.ValuePtr() );
+		F = offset( cpu.F.ValuePtr() );
+		BC = offset( &cpu.BC.value );
+		DE = offset( &cpu.DE.value );
+		HL = offset( &cpu.HL.value );
+		SP = offset( &cpu.SP.value );
+		PC = offset( &cpu.PC );
+		lastOpcode = offset( &cpu.lastInstructionOpCode );
+		cpuTime = offset( &cpu.cpuTime );
+		interuptsEnabled = offset( &cpu.interuptsEnabled );
+		interuptsOn = offset( &cpu.interuptsOn );
+		IF = offset( &gb->mem.highRAM[ 0x0f ] );
+		IE = offset( &gb->mem.highRAM[ 0xff ] );
+		now = offset( &gb->scheduler.now );
+		nextDeadline = offset( &gb->scheduler.nextDeadline );
+		totalInstructions = offset( &gb->totalInstructions );
+		readPages = offset( gb->memoryMap.readPages );
+		writePages = offset( gb->memoryMap.writePages );
+		highRAM = offset( gb->mem.highRAM );
+		ramCodeBits = offset( gb->blockCache.ramCodeBits );
+		clockBudget = offset( &gb->jit.clockBudget );
+		lahfToFlags = offset( gb->jit.lahfToFlags );
+
+		for ( const DecodedInstruction & instruction : block->instructions ) {
+			clocks.push_back( NativeClocks( instruction ) );
+		}
+	}
+
+	Operand Field( int offset ) { return Mem( REG_GB, offset ); }
+
+	void LoadGuestRegisters() {
+		emitter.Load( REG_A, Field( A ), 1 );
+		emitter.Load( REG_F, Field( F ), 1 );
+		emitter.Load( REG_BC, Field( BC ), 2 );
+		emitter.Load( REG_DE, Field( DE ), 2 );
+		emitter.Load( REG_HL, Field( HL ), 2 );
+	}
+	void StoreGuestRegisters() {
+		emitter.Store( Field( A ), REG_A, 1 );
+		emitter.Store( Field( F ), REG_F, 1 );
+		emitter.Store( Field( BC ), REG_BC, 2 );
+		emitter.Store( Field( DE ), REG_DE, 2 );
+		emitter.Store( Field( HL ), REG_HL, 2 );
+	}
+
+	static HostRegister PairRegister( GuestRegister reg ) { return reg < GB_D ? REG_BC : reg < GB_H ? REG_DE : REG_HL; }
+
+	// dst = reg, zero extended
+	void LoadRegister( HostRegister dst, GuestRegister reg ) {
+		if ( reg == GB_A ) {
+			emitter.Mov32( dst, REG_A );
+		} else if ( reg & 1 ) {
+			emitter.Load( dst, Reg( PairRegister( reg ) ), 1 );
+		} else {
+			emitter.Mov32( dst, PairRegister( reg ) );
+			emitter.Shift( SHIFT_SHR, dst, 8, 4 );
+		}
+	}
+	// reg = low byte of src
+	void StoreRegister( GuestRegister reg, HostRegister src ) {
+		HostRegister pair = PairRegister( reg );
+		if ( reg == GB_A ) {
+			emitter.Load( REG_A, Reg( src ), 1 );
+		} else if ( reg & 1 ) {
+			emitter.Store( Reg( pair ), src, 1 );
+		} else {
+			emitter.Load( R11, Reg( src ), 1 );
+			emitter.Shift( SHIFT_SHL, R11, 8, 4 );
+			emitter.AluImm( ALU_AND, Reg( pair ), 0xff, 4 );
+			emitter.Alu( ALU_OR, Reg( pair ), R11, 4 );
+		}
+	}
+	// Keeps a pair register within 16 bits after arithmetic
+	void WrapPair( HostRegister pair ) { emitter.Load( pair, Reg( pair ), 2 ); }
+
+	// eax = byte at address ecx, or at addr when it is known. Clobbers the caller saved registers
+	void Read( int addr = -1 ) {
+		int slow = emitter.NewLabel();
+		int back = emitter.NewLabel();
+		if ( addr >= 0xff00 ) {
+			// No page for IO and high RAM
+			emitter.Jump( slow );
+		} else if ( addr >= 0 ) {
+			emitter.Load( RDX, Field( readPages + ( addr >> 8 ) * 8 ), 8 );
+			emitter.Test( RDX, RDX, 8 );
+			emitter.JumpIf( CC_E, slow );
+			emitter.Load( RAX, Mem( RDX, addr & 0xff ), 1 );
+		} else {
+			emitter.Mov32( RDX, RCX );
+			emitter.Shift( SHIFT_SHR, RDX, 8, 4 );
+			emitter.Load( RDX, Mem( REG_GB, readPages, RDX, 3 ), 8 );
+			emitter.Test( RDX, RDX, 8 );
+			emitter.JumpIf( CC_E, slow );
+			emitter.Load( RAX, Reg( RCX ), 1 );
+			emitter.Load( RAX, Mem( RDX, 0, RAX ), 1 );
+		}
+		emitter.Bind( back );
+		int clocksBefore = runClocks;
+		stubs.push_back( [ = ]() {
+			emitter.Bind( slow );
+			if ( addr >= 0 ) {
+				emitter.MovImm32( ARG1, addr );
+			} else {
+				emitter.Mov32( ARG1, RCX );
+			}
+			emitter.MovImm32( ARG2, clocksBefore );
+			emitter.Mov64( ARG0, REG_GB );
+			emitter.Call( (const void *)&JitRead );
+			int value = emitter.NewLabel();
+			emitter.TestImm( Reg( RAX ), 0x100, 4 );
+			emitter.JumpIf( CC_E, value );
+			emitter.StoreImm( Mem( RSP, slack ), 0x80000000, 4 );
+			emitter.Bind( value );
+			emitter.Load( RAX, Reg( RAX ), 1 );
+			emitter.Jump( back );
+		} );
+	}
+
+	// Writes al at address ecx, or at addr when it is known. Clobbers the caller saved registers
+	void Write( int addr = -1 ) {
+		int slow = emitter.NewLabel();
+		int back = emitter.NewLabel();
+		if ( addr >= 0xff00 && IsIORegister( addr ) ) {
+			emitter.Jump( slow );
+		} else if ( addr >= 0xff00 ) {
+			// High RAM, unless it holds code
+			uint32 ramAddress = BlockCache::highRAMCodeOffset + addr - 0xff80;
+			emitter.TestImm( Field( ramCodeBits + ramAddress / 8 ), 1 << ( ramAddress % 8 ), 1 );
+			emitter.JumpIf( CC_NE, slow );
+			emitter.Store( Field( highRAM + ( addr & 0xff ) ), RAX, 1 );
+		} else if ( addr >= 0 ) {
+			emitter.Load( RDX, Field( writePages + ( addr >> 8 ) * 8 ), 8 );
+			emitter.Test( RDX, RDX, 8 );
+			emitter.JumpIf( CC_E, slow );
+			emitter.Store( Mem( RDX, addr & 0xff ), RAX, 1 );
+		} else {
+			emitter.Mov32( RDX, RCX );
+			emitter.Shift( SHIFT_SHR, RDX, 8, 4 );
+			emitter.Load( RDX, Mem( REG_GB, writePages, RDX, 3 ), 8 );
+			emitter.Test( RDX, RDX, 8 );
+			emitter.JumpIf( CC_E, slow );
+			emitter.Load( R8, Reg( RCX ), 1 );
+			emitter.Store( Mem( RDX, 0, R8 ), RAX, 1 );
+		}
+		emitter.Bind( back );
+		int clocksBefore = runClocks;
+		stubs.push_back( [ = ]() {
+			emitter.Bind( slow );
+			emitter.Load( ARG2, Reg( RAX ), 1 );
+			if ( addr >= 0 ) {
+				emitter.MovImm32( ARG1, addr );
+			} else {
+				emitter.Mov32( ARG1, RCX );
+			}
+			emitter.MovImm32( ARG3, clocksBefore );
+			emitter.Mov64( ARG0, REG_GB );
+			emitter.Call( (const void *)&JitWrite );
+			emitter.Test( RAX, RAX, 4 );
+			emitter.JumpIf( CC_E, back );
+			emitter.StoreImm( Mem( RSP, slack ), 0x80000000, 4 );
+			emitter.Jump( back );
+		} );
+	}
+
+	// Pushes the 16 bits in eax
+	void Push() {
+		emitter.Store( Mem( RSP, temporary ), RAX, 4 );
+		for ( int i = 1; i <= 2; i++ ) {
+			emitter.Load( RCX, Field( SP ), 2 );
+			emitter.AluImm( ALU_SUB, Reg( RCX ), i, 4 );
+			emitter.Load( RCX, Reg( RCX ), 2 );
+			emitter.Load( RAX, Mem( RSP, temporary + 2 - i ), 1 );
+			Write();
+		}
+		emitter.AluImm( ALU_SUB, Field( SP ), 2, 2 );
+	}
+	// eax = the 16 bits popped
+	void Pop() {
+		emitter.Load( RCX, Field( SP ), 2 );
+		Read();
+		emitter.Store( Mem( RSP, temporary ), RAX, 4 );
+		emitter.Load( RCX, Field( SP ), 2 );
+		emitter.Inc( Reg( RCX ), 4 );
+		emitter.Load( RCX, Reg( RCX ), 2 );
+		Read();
+		emitter.Shift( SHIFT_SHL, RAX, 8, 4 );
+		emitter.AluLoad( ALU_OR, RAX, Mem( RSP, temporary ), 4 );
+		emitter.AluImm( ALU_ADD, Field( SP ), 2, 2 );
+	}
+
+	// dst = Z, H and C from the host flags in ah, ored with extraFlags. Clobbers ecx
+	void FlagsFromLahf( HostRegister dst, byte extraFlags ) {
+		emitter.LoadAHToECX();
+		emitter.Load( dst, Mem( REG_GB, lahfToFlags, RCX ), 1 );
+		if ( extraFlags != 0 ) {
+			emitter.AluImm( ALU_OR, Reg( dst ), extraFlags, 4 );
+		}
+	}
+
+	// A = A op cl, with the flags computed like Cpu::Add, Sub, And, Xor, Or and Cp
+	void Alu( int operation ) {
+		static constexpr AluOperation operations[ 8 ] = { ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBB, ALU_AND, ALU_XOR, ALU_OR, ALU_CMP };
+		if ( operation >= 4 && operation <= 6 ) {
+			emitter.Alu( operations[ operation ], Reg( REG_A ), RCX, 4 );
+			emitter.SetCondition( CC_E, RAX );
+			emitter.Load( REG_F, Reg( RAX ), 1 );
+			emitter.Shift( SHIFT_SHL, REG_F, 7, 4 );
+			if ( operation == 4 ) {
+				emitter.AluImm( ALU_OR, Reg( REG_F ), 0x20, 4 );
+			}
+			return;
+		}
+		// The interpreter flags of CP match comparing A against the value
+		emitter.Mov32( RAX, REG_A );
+		if ( operation == 1 || operation == 3 ) {
+			emitter.BitTest( REG_F, 4 );
+		}
+		emitter.Alu( operations[ operation ], Reg( RAX ), RCX, 1 );
+		emitter.Lahf();
+		if ( operation != 7 ) {
+			emitter.Load( REG_A, Reg( RAX ), 1 );
+		}
+		FlagsFromLahf( REG_F, operation >= 2 ? 0x40 : 0x00 );
+	}
+
+	// INC or DEC of al, ecx = the new flags
+	void IncDec( bool decrement ) {
+		decrement ? emitter.Dec( Reg( RAX ), 1 ) : emitter.Inc( Reg( RAX ), 1 );
+		emitter.Lahf();
+		FlagsFromLahf( RCX, decrement ? 0x40 : 0x00 );
+		emitter.AluImm( ALU_AND, Reg( RCX ), decrement ? 0xe0 : 0xa0, 4 );
+		emitter.Mov32( RDX, REG_F );
+		emitter.AluImm( ALU_AND, Reg( RDX ), 0x10, 4 );
+		emitter.Alu( ALU_OR, Reg( RCX ), RDX, 4 );
+	}
+
+	// CB prefixed operation on al, ecx = the new flags. Returns false for BIT, which leaves the value alone
+	bool CBOperation( byte cbOpcode ) {
+		int operation = cbOpcode >> 3;
+		if ( operation < 8 ) {
+			static constexpr ShiftOperation shifts[ 8 ] = { SHIFT_ROL, SHIFT_ROR, SHIFT_RCL, SHIFT_RCR, SHIFT_SHL, SHIFT_SAR, SHIFT_ROL, SHIFT_SHR };
+			if ( operation == 2 || operation == 3 ) {
+				emitter.BitTest( REG_F, 4 );
+			}
+			// SWAP is a rotation by 4 and clears C
+			emitter.Shift( shifts[ operation ], RAX, operation == 6 ? 4 : 1, 1 );
+			if ( operation == 6 ) {
+				emitter.MovImm32( RCX, 0 );
+			} else {
+				emitter.SetCondition( CC_B, RCX );
+				emitter.Load( RCX, Reg( RCX ), 1 );
+				emitter.Shift( SHIFT_SHL, RCX, 4, 4 );
+			}
+			emitter.Test( RAX, RAX, 1 );
+			emitter.SetCondition( CC_E, RDX );
+			emitter.Load( RDX, Reg( RDX ), 1 );
+			emitter.Shift( SHIFT_SHL, RDX, 7, 4 );
+			emitter.Alu( ALU_OR, Reg( RCX ), RDX, 4 );
+			return true;
+		}
+		int bit = ( cbOpcode >> 3 ) & 7;
+		if ( cbOpcode < 0x80 ) {
+			// BIT keeps C, sets H
+			emitter.TestImm( Reg( RAX ), 1 << bit, 1 );
+			emitter.SetCondition( CC_E, RCX );
+			emitter.Load( RCX, Reg( RCX ), 1 );
+			emitter.Shift( SHIFT_SHL, RCX, 7, 4 );
+			emitter.Mov32( RDX, REG_F );
+			emitter.AluImm( ALU_AND, Reg( RDX ), 0x10, 4 );
+			emitter.Alu( ALU_OR, Reg( RCX ), RDX, 4 );
+			emitter.AluImm( ALU_OR, Reg( RCX ), 0x20, 4 );
+			return false;
+		}
+		// RES and SET, flags untouched
+		emitter.AluImm( cbOpcode < 0xc0 ? ALU_AND : ALU_OR, Reg( RAX ), cbOpcode < 0xc0 ? ~( 1 << bit ) & 0xff : 1 << bit, 1 );
+		emitter.Mov32( RCX, REG_F );
+		return true;
+	}
+
+	// Slack of the run = the clocks it can take before it reaches the next event or the end of the budget
+	void EmitSlack() {
+		emitter.Load( RAX, Field( nextDeadline ), 8 );
+		emitter.AluLoad( ALU_SUB, RAX, Field( now ), 8 );
+		emitter.MovImm32( RCX, 0x7fffffff );
+		emitter.Alu( ALU_CMP, Reg( RAX ), RCX, 8 );
+		emitter.Cmov( CC_G, RAX, RCX, 8 );
+		emitter.Load( RCX, Field( clockBudget ), 4 );
+		emitter.AluLoad( ALU_SUB, RCX, Field( cpuTime ), 4 );
+		emitter.Alu( ALU_CMP, Reg( RAX ), RCX, 4 );
+		emitter.Cmov( CC_G, RAX, RCX, 4 );
+		emitter.Store( Mem( RSP, slack ), RAX, 4 );
+	}
+
+	// Starts the run of native instructions at index. FinishInstruction processes interrupts after every instruction,
+	// leaves for RunBlock if it would do it after the first one. The scheduler checks it again when an instruction
+	// touches IO registers or an event comes due, nothing else in a run can change it
+	void EmitRunStart( int index ) {
+		int fail = emitter.NewLabel();
+		emitter.AluImm( ALU_CMP, Field( interuptsEnabled ), 0, 1 );
+		emitter.JumpIf( CC_NE, fail );
+		int pass = emitter.NewLabel();
+		emitter.AluImm( ALU_CMP, Field( interuptsOn ), 0, 1 );
+		emitter.JumpIf( CC_E, pass );
+		emitter.Load( RAX, Field( IF ), 1 );
+		emitter.AluLoad( ALU_AND, RAX, Field( IE ), 1 );
+		emitter.TestImm( Reg( RAX ), 0x1f, 1 );
+		emitter.JumpIf( CC_NE, fail );
+		emitter.Bind( pass );
+		EmitSlack();
+		stubs.push_back( [ = ]() {
+			emitter.Bind( fail );
+			emitter.MovImm32( RAX, index );
+			emitter.Jump( spill );
+		} );
+	}
+
+	// Called after the instruction at index when the run goes on. Finishes it through the scheduler if the run reached
+	// its slack, then starts counting again from the new slack
+	void EmitCheck( int index ) {
+		const DecodedInstruction & instruction = block->instructions[ index ];
+		int						   total = runClocks + clocks[ index ];
+		int						   count = index - runStart + 1;
+		int						   slow = emitter.NewLabel();
+		int						   back = emitter.NewLabel();
+		emitter.AluImm( ALU_CMP, Mem( RSP, slack ), total, 4 );
+		emitter.JumpIf( CC_LE, slow );
+		emitter.Bind( back );
+		int clocksBefore = runClocks;
+		stubs.push_back( [ = ]() {
+			emitter.Bind( slow );
+			emitter.StoreImm( Field( PC ), instruction.pc + Cpu::s_instructionsSize[ instruction.opcode ], 2 );
+			emitter.StoreImm( Field( lastOpcode ), instruction.opcode, 1 );
+			emitter.AluImm( ALU_ADD, Field( totalInstructions ), count, 8 );
+			if ( clocksBefore > 0 ) {
+				emitter.AluImm( ALU_ADD, Field( now ), clocksBefore, 8 );
+				emitter.AluImm( ALU_ADD, Field( cpuTime ), clocksBefore, 4 );
+			}
+			emitter.MovImm32( ARG1, clocks[ index ] );
+			emitter.Mov64( ARG0, REG_GB );
+			emitter.Call( (const void *)&JitFinish );
+			emitter.Test( RAX, RAX, 4 );
+			emitter.JumpIf( CC_NE, done );
+			// Back to the clocks at the start of the run, which the rest of it counts from
+			emitter.AluImm( ALU_SUB, Field( now ), total, 8 );
+			emitter.AluImm( ALU_SUB, Field( cpuTime ), total, 4 );
+			emitter.AluImm( ALU_SUB, Field( totalInstructions ), count, 8 );
+			EmitSlack();
+			emitter.Jump( back );
+		} );
+	}
+
+	// Ends the run with the instruction at index, which took lastClocks and leaves PC at nextPC, or where it stored it
+	// when nextPC is -1. Leaves the block if it has to stop
+	void EmitFinish( int index, int lastClocks, int nextPC ) {
+		int total = runClocks + lastClocks;
+		int slow = emitter.NewLabel();
+		int back = emitter.NewLabel();
+		if ( nextPC >= 0 ) {
+			emitter.StoreImm( Field( PC ), nextPC, 2 );
+		}
+		emitter.StoreImm( Field( lastOpcode ), block->instructions[ index ].opcode, 1 );
+		emitter.AluImm( ALU_ADD, Field( totalInstructions ), index - runStart + 1, 8 );
+		emitter.AluImm( ALU_CMP, Mem( RSP, slack ), total, 4 );
+		emitter.JumpIf( CC_LE, slow );
+		emitter.AluImm( ALU_ADD, Field( now ), total, 8 );
+		emitter.AluImm( ALU_ADD, Field( cpuTime ), total, 4 );
+		emitter.Bind( back );
+		int clocksBefore = runClocks;
+		stubs.push_back( [ = ]() {
+			emitter.Bind( slow );
+			if ( clocksBefore > 0 ) {
+				emitter.AluImm( ALU_ADD, Field( now ), clocksBefore, 8 );
+				emitter.AluImm( ALU_ADD, Field( cpuTime ), clocksBefore, 4 );
+			}
+			emitter.MovImm32( ARG1, lastClocks );
+			emitter.Mov64( ARG0, REG_GB );
+			emitter.Call( (const void *)&JitFinish );
+			emitter.Test( RAX, RAX, 4 );
+			emitter.JumpIf( CC_NE, done );
+			emitter.Jump( back );
+		} );
+	}
+
+	// Conditional control flow at index: jumps to notTaken when the condition in the opcode bits 3 and 4 is false
+	void JumpIfNotTaken( byte opcode, int notTaken ) {
+		int condition = ( opcode >> 3 ) & 3;
+		emitter.TestImm( Reg( REG_F ), condition < 2 ? 0x80 : 0x10, 1 );
+		emitter.JumpIf( condition & 1 ? CC_E : CC_NE, notTaken );
+	}
+
+	// Compiles the instruction at index, with control flow ending the run
+	void CompileInstruction( int index ) {
+		const DecodedInstruction & instruction = block->instructions[ index ];
+		byte					   opcode = instruction.opcode;
+		byte					   d8 = instruction.operands[ 0 ];
+		uint16					   d16 = ( (uint16)instruction.operands[ 1 ] << 8 ) | instruction.operands[ 0 ];
+
+		if ( opcode == 0x00 ) {
+			// NOP
+		} else if ( opcode >= 0x40 && opcode < 0x80 ) {
+			// LD r, r
+			GuestRegister dst = ( GuestRegister )( ( opcode >> 3 ) & 7 );
+			GuestRegister src = ( GuestRegister )( opcode & 7 );
+			if ( src == GB_HL_INDIRECT ) {
+				emitter.Mov32( RCX, REG_HL );
+				Read();
+				StoreRegister( dst, RAX );
+			} else if ( dst == GB_HL_INDIRECT ) {
+				LoadRegister( RAX, src );
+				emitter.Mov32( RCX, REG_HL );
+				Write();
+				return;
+			} else if ( dst != src ) {
+				LoadRegister( RAX, src );
+				StoreRegister( dst, RAX );
+			}
+		} else if ( opcode >= 0x80 && opcode < 0xc0 ) {
+			// ALU A, r
+			GuestRegister src = ( GuestRegister )( opcode & 7 );
+			if ( src == GB_HL_INDIRECT ) {
+				emitter.Mov32( RCX, REG_HL );
+				Read();
+				emitter.Mov32( RCX, RAX );
+			} else {
+				LoadRegister( RCX, src );
+			}
+			Alu( ( opcode >> 3 ) & 7 );
+		} else if ( opcode >= 0xc0 && ( opcode & 7 ) == 6 ) {
+			// ALU A, d8
+			emitter.MovImm32( RCX, d8 );
+			Alu( ( opcode >> 3 ) & 7 );
+		} else if ( opcode == 0x34 || opcode == 0x35 ) {
+			// INC (HL), DEC (HL)
+			emitter.Mov32( RCX, REG_HL );
+			Read();
+			IncDec( opcode == 0x35 );
+			emitter.Store( Mem( RSP, temporary ), RCX, 4 );
+			emitter.Mov32( RCX, REG_HL );
+			Write();
+			emitter.Load( REG_F, Mem( RSP, temporary ), 4 );
+			return;
+		} else if ( opcode < 0x40 && ( ( opcode & 7 ) == 4 || ( opcode & 7 ) == 5 ) ) {
+			// INC r, DEC r
+			GuestRegister reg = ( GuestRegister )( ( opcode >> 3 ) & 7 );
+			LoadRegister( RAX, reg );
+			IncDec( ( opcode & 7 ) == 5 );
+			StoreRegister( reg, RAX );
+			emitter.Mov32( REG_F, RCX );
+		} else if ( opcode == 0x36 ) {
+			// LD (HL), d8
+			emitter.MovImm32( RAX, d8 );
+			emitter.Mov32( RCX, REG_HL );
+			Write();
+			return;
+		} else if ( opcode < 0x40 && ( opcode & 7 ) == 6 ) {
+			// LD r, d8
+			emitter.MovImm32( RAX, d8 );
+			StoreRegister( ( GuestRegister )( ( opcode >> 3 ) & 7 ), RAX );
+		} else if ( opcode < 0x40 && ( opcode & 0xf ) == 0x1 ) {
+			// LD rr, d16
+			if ( opcode == 0x31 ) {
+				emitter.StoreImm( Field( SP ), d16, 2 );
+			} else {
+				emitter.MovImm32( PairRegister( ( GuestRegister )( ( opcode >> 4 ) * 2 ) ), d16 );
+			}
+		} else if ( opcode < 0x40 && ( ( opcode & 0xf ) == 0x3 || ( opcode & 0xf ) == 0xb ) ) {
+			// INC rr, DEC rr
+			bool increment = ( opcode & 0xf ) == 0x3;
+			if ( opcode >= 0x30 ) {
+				increment ? emitter.Inc( Field( SP ), 2 ) : emitter.Dec( Field( SP ), 2 );
+			} else {
+				HostRegister pair = PairRegister( ( GuestRegister )( ( opcode >> 4 ) * 2 ) );
+				increment ? emitter.Inc( Reg( pair ), 4 ) : emitter.Dec( Reg( pair ), 4 );
+				WrapPair( pair );
+			}
+		} else if ( opcode < 0x40 && ( opcode & 0xf ) == 0x9 ) {
+			// ADD HL, rr: H is the carry out of bit 11, C out of bit 15, Z is kept
+			if ( opcode == 0x39 ) {
+				emitter.Load( RCX, Field( SP ), 2 );
+			} else {
+				emitter.Mov32( RCX, PairRegister( ( GuestRegister )( ( opcode >> 4 ) * 2 ) ) );
+			}
+			emitter.Mov32( RAX, REG_HL );
+			emitter.Mov32( RDX, REG_HL );
+			emitter.Alu( ALU_ADD, Reg( RDX ), RCX, 4 );
+			emitter.Alu( ALU_XOR, Reg( RAX ), RCX, 4 );
+			emitter.Alu( ALU_XOR, Reg( RAX ), RDX, 4 );
+			emitter.Shift( SHIFT_SHR, RAX, 7, 4 );
+			emitter.AluImm( ALU_AND, Reg( RAX ), 0x20, 4 );
+			emitter.Mov32( RCX, RDX );
+			emitter.Shift( SHIFT_SHR, RCX, 12, 4 );
+			emitter.AluImm( ALU_AND, Reg( RCX ), 0x10, 4 );
+			emitter.AluImm( ALU_AND, Reg( REG_F ), 0x80, 4 );
+			emitter.Alu( ALU_OR, Reg( REG_F ), RAX, 4 );
+			emitter.Alu( ALU_OR, Reg( REG_F ), RCX, 4 );
+			emitter.Load( REG_HL, Reg( RDX ), 2 );
+		} else if ( opcode < 0x40 && ( opcode & 0xf ) == 0x2 ) {
+			// LD (BC), A  LD (DE), A  LD (HL+), A  LD (HL-), A
+			emitter.Mov32( RCX, opcode >= 0x20 ? REG_HL : PairRegister( ( GuestRegister )( ( opcode >> 4 ) * 2 ) ) );
+			emitter.Mov32( RAX, REG_A );
+			Write();
+			if ( opcode >= 0x20 ) {
+				opcode == 0x22 ? emitter.Inc( Reg( REG_HL ), 4 ) : emitter.Dec( Reg( REG_HL ), 4 );
+				WrapPair( REG_HL );
+			}
+			return;
+		} else if ( opcode < 0x40 && ( opcode & 0xf ) == 0xa ) {
+			// LD A, (BC)  LD A, (DE)  LD A, (HL+)  LD A, (HL-)
+			emitter.Mov32( RCX, opcode >= 0x20 ? REG_HL : PairRegister( ( GuestRegister )( ( opcode >> 4 ) * 2 ) ) );
+			Read();
+			emitter.Mov32( REG_A, RAX );
+			if ( opcode >= 0x20 ) {
+				opcode == 0x2a ? emitter.Inc( Reg( REG_HL ), 4 ) : emitter.Dec( Reg( REG_HL ), 4 );
+				WrapPair( REG_HL );
+			}
+		} else if ( opcode == 0x07 || opcode == 0x0f || opcode == 0x17 || opcode == 0x1f ) {
+			// RLCA, RRCA, RLA, RRA: Z N H cleared, C is the bit shifted out
+			static constexpr ShiftOperation shifts[ 4 ] = { SHIFT_ROL, SHIFT_ROR, SHIFT_RCL, SHIFT_RCR };
+			emitter.Mov32( RAX, REG_A );
+			if ( opcode >= 0x10 ) {
+				emitter.BitTest( REG_F, 4 );
+			}
+			emitter.Shift( shifts[ opcode >> 3 ], RAX, 1, 1 );
+			emitter.SetCondition( CC_B, RCX );
+			emitter.Load( REG_A, Reg( RAX ), 1 );
+			emitter.Load( REG_F, Reg( RCX ), 1 );
+			emitter.Shift( SHIFT_SHL, REG_F, 4, 4 );
+		} else if ( opcode == 0x2f ) {
+			// CPL
+			emitter.AluImm( ALU_XOR, Reg( REG_A ), 0xff, 4 );
+			emitter.AluImm( ALU_OR, Reg( REG_F ), 0x60, 4 );
+		} else if ( opcode == 0x37 ) {
+			// SCF
+			emitter.AluImm( ALU_AND, Reg( REG_F ), 0x80, 4 );
+			emitter.AluImm( ALU_OR, Reg( REG_F ), 0x10, 4 );
+		} else if ( opcode == 0x3f ) {
+			// CCF
+			emitter.AluImm( ALU_XOR, Reg( REG_F ), 0x10, 4 );
+			emitter.AluImm( ALU_AND, Reg( REG_F ), 0x90, 4 );
+		} else if ( opcode == 0xf3 ) {
+			// DI, no interrupt can be taken after it
+			emitter.StoreImm( Field( interuptsOn ), 0, 1 );
+		} else if ( opcode == 0xf9 ) {
+			// LD SP, HL
+			emitter.Store( Field( SP ), REG_HL, 2 );
+		} else if ( opcode == 0xfa || opcode == 0xf0 ) {
+			// LD A, (a16)  LDH A, (a8)
+			uint16 addr = opcode == 0xf0 ? 0xff00 + d8 : d16;
+			if ( addr >= 0xff80 && !IsIORegister( addr ) ) {
+				emitter.Load( REG_A, Field( highRAM + ( addr & 0xff ) ), 1 );
+			} else {
+				Read( addr );
+				emitter.Mov32( REG_A, RAX );
+			}
+		} else if ( opcode == 0xea || opcode == 0xe0 ) {
+			// LD (a16), A  LDH (a8), A
+			emitter.Mov32( RAX, REG_A );
+			Write( opcode == 0xe0 ? 0xff00 + d8 : d16 );
+		} else if ( opcode == 0xf2 ) {
+			// LD A, (C)
+			LoadRegister( RCX, GB_C );
+			emitter.AluImm( ALU_OR, Reg( RCX ), 0xff00, 4 );
+			Read();
+			emitter.Mov32( REG_A, RAX );
+		} else if ( opcode == 0xe2 ) {
+			// LD (C), A
+			LoadRegister( RCX, GB_C );
+			emitter.AluImm( ALU_OR, Reg( RCX ), 0xff00, 4 );
+			emitter.Mov32( RAX, REG_A );
+			Write();
+		} else if ( opcode == 0xcb ) {
+			byte		  cbOpcode = d8;
+			GuestRegister reg = ( GuestRegister )( cbOpcode & 7 );
+			if ( reg != GB_HL_INDIRECT ) {
+				LoadRegister( RAX, reg );
+				if ( CBOperation( cbOpcode ) ) {
+					StoreRegister( reg, RAX );
+				}
+				emitter.Mov32( REG_F, RCX );
+			} else {
+				emitter.Mov32( RCX, REG_HL );
+				Read();
+				if ( !CBOperation( cbOpcode ) ) {
+					emitter.Mov32( REG_F, RCX );
+				} else {
+					emitter.Store( Mem( RSP, temporary ), RCX, 4 );
+					emitter.Mov32( RCX, REG_HL );
+					Write();
+					emitter.Load( REG_F, Mem( RSP, temporary ), 4 );
+					return;
+				}
+			}
+		} else if ( ( opcode & 0xcf ) == 0xc5 ) {
+			// PUSH rr
+			if ( opcode == 0xf5 ) {
+				emitter.Mov32( RAX, REG_A );
+				emitter.Shift( SHIFT_SHL, RAX, 8, 4 );
+				emitter.Alu( ALU_OR, Reg( RAX ), REG_F, 4 );
+			} else {
+				emitter.Mov32( RAX, PairRegister( ( GuestRegister )( ( ( opcode >> 4 ) - 0xc ) * 2 ) ) );
+			}
+			Push();
+			return;
+		} else if ( ( opcode & 0xcf ) == 0xc1 ) {
+			// POP rr, the low bits of F always read 0
+			Pop();
+			if ( opcode == 0xf1 ) {
+				emitter.Mov32( REG_F, RAX );
+				emitter.AluImm( ALU_AND, Reg( REG_F ), 0xf0, 4 );
+				emitter.Shift( SHIFT_SHR, RAX, 8, 4 );
+				emitter.Mov32( REG_A, RAX );
+			} else {
+				emitter.Mov32( PairRegister( ( GuestRegister )( ( ( opcode >> 4 ) - 0xc ) * 2 ) ), RAX );
+			}
+		} else {
+			CompileControlFlow( index );
+		}
+	}
+
+	// The instructions ending a block, they finish the run themselves
+	void CompileControlFlow( int index ) {
+		const DecodedInstruction & instruction = block->instructions[ index ];
+		byte					   opcode = instruction.opcode;
+		uint16					   nextPC = instruction.pc + Cpu::s_instructionsSize[ opcode ];
+		uint16					   d16 = ( (uint16)instruction.operands[ 1 ] << 8 ) | instruction.operands[ 0 ];
+		uint16					   relativeTarget = nextPC + (int8)instruction.operands[ 0 ];
+
+		switch ( opcode ) {
+			case 0x18: // JR r8
+				EmitFinish( index, 12, relativeTarget );
+				break;
+			case 0xc3: // JP a16
+				EmitFinish( index, 16, d16 );
+				break;
+			case 0xe9: // JP HL
+				emitter.Store( Field( PC ), REG_HL, 2 );
+				EmitFinish( index, 4, -1 );
+				break;
+			case 0xcd: // CALL a16
+				emitter.MovImm32( RAX, nextPC );
+				Push();
+				EmitFinish( index, 24, d16 );
+				break;
+			case 0xc9: // RET
+				Pop();
+				emitter.Store( Field( PC ), RAX, 2 );
+				EmitFinish( index, 16, -1 );
+				break;
+			case 0xc7: // RST
+			case 0xcf:
+			case 0xd7:
+			case 0xdf:
+			case 0xe7:
+			case 0xef:
+			case 0xf7:
+			case 0xff:
+				emitter.MovImm32( RAX, nextPC );
+				Push();
+				EmitFinish( index, 16, opcode & 0x38 );
+				break;
+			default: {
+				// JR cc, JP cc, CALL cc and RET cc
+				int notTaken = emitter.NewLabel();
+				JumpIfNotTaken( opcode, notTaken );
+				if ( opcode < 0x40 ) {
+					EmitFinish( index, 12, relativeTarget );
+				} else if ( ( opcode & 7 ) == 2 ) {
+					EmitFinish( index, 16, d16 );
+				} else if ( ( opcode & 7 ) == 4 ) {
+					emitter.MovImm32( RAX, nextPC );
+					Push();
+					EmitFinish( index, 24, d16 );
+				} else {
+					Pop();
+					emitter.Store( Field( PC ), RAX, 2 );
+					EmitFinish( index, 20, -1 );
+				}
+				emitter.Jump( done );
+				emitter.Bind( notTaken );
+				EmitFinish( index, clocks[ index ], nextPC );
+				break;
+			}
+		}
+		emitter.Jump( done );
+	}
+
+	// Runs the instruction at index through its handler
+	void EmitInterpreted( int index ) {
+		StoreGuestRegisters();
+		emitter.MovImm64( ARG1, ( uint64 )&block->instructions[ index ] );
+		emitter.Mov64( ARG0, REG_GB );
+		emitter.Call( (const void *)&JitInterpret );
+		emitter.Test( RAX, RAX, 4 );
+		emitter.JumpIf( CC_NE, doneWithoutSpill );
+		if ( index + 1 == (int)block->instructions.size() ) {
+			emitter.Jump( doneWithoutSpill );
+		} else {
+			LoadGuestRegisters();
+		}
+	}
+
+	bool Compile() {
+		int count = (int)block->instructions.size();
+		int native = 0;
+		for ( int clock : clocks ) {
+			native += clock > 0 ? 1 : 0;
+		}
+		if ( native == 0 ) {
+			return false;
+		}
+
+		spill = emitter.NewLabel();
+		epilogue = emitter.NewLabel();
+		done = emitter.NewLabel();
+		doneWithoutSpill = emitter.NewLabel();
+
+		static constexpr HostRegister saved[ 6 ] = { RBX, RBP, R12, R13, R14, R15 };
+		for ( HostRegister reg : saved ) {
+			emitter.Push( reg );
+		}
+		// The win64 shadow space, the temporary, and the stack aligned on 16 bytes for the calls
+		emitter.AluImm( ALU_SUB, Reg( RSP ), 40, 8 );
+		emitter.Mov64( REG_GB, ARG0 );
+		LoadGuestRegisters();
+
+		for ( int index = 0; index < count; index++ ) {
+			if ( clocks[ index ] == 0 ) {
+				EmitInterpreted( index );
+				continue;
+			}
+			if ( index == 0 || clocks[ index - 1 ] == 0 ) {
+				runStart = index;
+				runClocks = 0;
+				EmitRunStart( index );
+			}
+			const DecodedInstruction & instruction = block->instructions[ index ];
+			CompileInstruction( index );
+			if ( IsControlFlow( instruction.opcode ) ) {
+				// Always the last one, it finished the run itself
+				break;
+			} else if ( EndsRun( index ) ) {
+				EmitFinish( index, clocks[ index ], instruction.pc + Cpu::s_instructionsSize[ instruction.opcode ] );
+				if ( index + 1 == count ) {
+					emitter.Jump( done );
+				}
+			} else {
+				EmitCheck( index );
+			}
+			runClocks += clocks[ index ];
+		}
+
+		for ( const std::function< void() > & stub : stubs ) {
+			stub();
+		}
+
+		emitter.Bind( done );
+		emitter.MovImm32( RAX, -1 );
+		emitter.Bind( spill );
+		StoreGuestRegisters();
+		emitter.Bind( epilogue );
+		emitter.AluImm( ALU_ADD, Reg( RSP ), 40, 8 );
+		for ( int i = 5; i >= 0; i-- ) {
+			emitter.Pop( saved[ i ] );
+		}
+		emitter.Ret();
+		emitter.Bind( doneWithoutSpill );
+		emitter.MovImm32( RAX, -1 );
+		emitter.Jump( epilogue );
+		emitter.PatchJumps();
+		return true;
+	}
+
+	bool EndsRun( int index ) const { return index + 1 == (int)clocks.size() || clocks[ index + 1 ] == 0; }
+
+	static bool IsControlFlow( byte opcode ) {
+		switch ( opcode ) {
+			case 0x18:
+			case 0x20:
+			case 0x28:
+			case 0x30:
+			case 0x38:
+			case 0xc0:
+			case 0xc2:
+			case 0xc3:
+			case 0xc4:
+			case 0xc7:
+			case 0xc8:
+			case 0xc9:
+			case 0xca:
+			case 0xcc:
+			case 0xcd:
+			case 0xcf:
+			case 0xd0:
+			case 0xd2:
+			case 0xd4:
+			case 0xd7:
+			case 0xd8:
+			case 0xda:
+			case 0xdc:
+			case 0xdf:
+			case 0xe7:
+			case 0xe9:
+			case 0xef:
+			case 0xf7:
+			case 0xff:
+				return true;
+			default:
+				return false;
+		}
+	}
+};
+
+Jit::Jit() {
+	for ( int i = 0; i < 0x100; i++ ) {
+		lahfToFlags[ i ] = ( BIT_VALUE( i, 6 ) << 7 ) | ( BIT_VALUE( i, 4 ) << 5 ) | ( BIT_VALUE( i, 0 ) << 4 );
+	}
+}
+
+Jit::BlockFunction Jit::Compile( Gameboy * gb, const CodeBlock * block ) {
+	JitCompiler compiler( gb, block );
+	if ( !compiler.Compile() ) {
+		return nullptr;
+	}
+	std::vector< byte > & code = compiler.emitter.code;
+	return (BlockFunction)AllocateCode( code.data(), (int)code.size() );
+}
+
+// The arena is never writable and executable at the same time: the pages the new code lands on are made writable for
+// the copy and executable again afterwards
+byte * Jit::AllocateCode( const byte * code, int size ) {
+	if ( codeArena == nullptr ) {
+#if defined( _WIN32 )
+		codeArena = (byte *)VirtualAlloc( nullptr, codeArenaSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+#else
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined( __APPLE__ )
+		flags |= MAP_JIT;
+#endif
+		void * memory = mmap( nullptr, codeArenaSize, PROT_READ | PROT_WRITE, flags, -1, 0 );
+		codeArena = memory == MAP_FAILED ? nullptr : (byte *)memory;
+#endif
+		if ( codeArena == nullptr ) {
+			printf( "Could not allocate executable memory for the JIT\n" );
+			return nullptr;
+		}
+	}
+	// Keep entry points 16 bytes aligned
+	int start = ( codeArenaUsed + 15 ) & ~15;
+	if ( start + size > codeArenaSize ) {
+		return nullptr;
+	}
+	byte * memory = codeArena + start;
+#if defined( _WIN32 )
+	DWORD oldProtection;
+	if ( !VirtualProtect( memory, size, PAGE_READWRITE, &oldProtection ) ) {
+		printf( "Could not make the JIT code writable\n" );
+		return nullptr;
+	}
+	memcpy( memory, code, size );
+	if ( !VirtualProtect( memory, size, PAGE_EXECUTE_READ, &oldProtection ) ) {
+		printf( "Could not make the JIT code executable\n" );
+		return nullptr;
+	}
+	FlushInstructionCache( GetCurrentProcess(), memory, size );
+#else
+	uintptr_t pageSize = (uintptr_t)sysconf( _SC_PAGESIZE );
+	byte *	  pages = (byte *)( (uintptr_t)memory & ~( pageSize - 1 ) );
+	size_t	  pagesSize = memory + size - pages;
+	if ( mprotect( pages, pagesSize, PROT_READ | PROT_WRITE ) != 0 ) {
+		printf( "Could not make the JIT code writable\n" );
+		return nullptr;
+	}
+	memcpy( memory, code, size );
+	if ( mprotect( pages, pagesSize, PROT_READ | PROT_EXEC ) != 0 ) {
+		printf( "Could not make the JIT code executable\n" );
+		return nullptr;
+	}
+#endif
+	codeArenaUsed = start + size;
+	return memory;
+}
+
+Jit::~Jit() {
+	if ( codeArena != nullptr ) {
+#if defined( _WIN32 )
+		VirtualFree( codeArena, 0, MEM_RELEASE );
+#else
+		munmap( codeArena, codeArenaSize );
+#endif
+	}
+}
+
+#else
+
+Jit::Jit() {}
+Jit::BlockFunction Jit::Compile( Gameboy * gb, const CodeBlock * block ) { return nullptr; }
+byte *			   Jit::AllocateCode( const byte * code, int size ) { return nullptr; }
+Jit::~Jit() {}
+
+#endif
+
+bool Jit::Run( Gameboy * gb, const CodeBlock * block, int clockBudget ) {
+	if ( !IsSupported() || block->startPC >= 0x8000 || gb->PCBreakpoint >= 0 || gb->instructionCountBreakpoint != 0 ) {
+		// Only ROM code, which never changes, gets compiled. The generated code does not stop on breakpoints
+		return false;
+	}
+
+	if ( lookupCache.empty() ) {
+		lookupCache.resize( lookupCacheSize );
+	}
+	LookupCacheEntry & cached = lookupCache[ ( (uintptr_t)block >> 4 ) % lookupCacheSize ];
+	if ( cached.block != block ) {
+		cached.block = block;
+		cached.compiled = &blocks[ block ];
+	}
+	CompiledBlock * entry = cached.compiled;
+	if ( entry->code == nullptr ) {
+		if ( entry->hits < 0 || ++entry->hits < hotThreshold ) {
+			return false;
+		}
+		BlockFunction code = Compile( gb, block );
+		if ( code == nullptr && codeArenaUsed > 0 && codeArenaUsed + 0x1000 > codeArenaSize ) {
+			// Out of room, start over with an empty arena
+			Flush();
+			entry = &blocks[ block ];
+			lookupCache[ ( (uintptr_t)block >> 4 ) % lookupCacheSize ] = { block, entry };
+			code = Compile( gb, block );
+		}
+		if ( code == nullptr ) {
+			// Nothing in it can be compiled, leave it to the block interpreter for good
+			entry->hits = -1;
+			return false;
+		}
+		entry->code = code;
+	}
+
+	this->clockBudget = clockBudget;
+	generation = gb->blockCache.generation;
+	gb->cpu.MaterializeFlags();
+	int resume = entry->code( gb );
+	if ( resume >= 0 ) {
+		gb->RunBlock( block, clockBudget, resume );
+	}
+	if ( reference != nullptr ) {
+		Verify( gb, block );
+	}
+	return true;
+}
+
+void Jit::Flush() {
+	blocks.clear();
+	lookupCache.assign( lookupCache.size(), LookupCacheEntry() );
+	codeArenaUsed = 0;
+}
+
+static void CatchUp( Gameboy * reference, Gameboy * gb ) {
+	while ( reference->totalInstructions < gb->totalInstructions || reference->cpu.cpuTime < gb->cpu.cpuTime ) {
+		reference->StepInstruction();
+	}
+}
+
+void Jit::Verify( Gameboy * gb, const CodeBlock * block ) {
+	CatchUp( reference, gb );
+	verifiedBlocks++;
+
+	Cpu & a = gb->cpu;
+	Cpu & b = reference->cpu;
+	if ( a.A.Get() == b.A.Get() && a.GetF() == b.GetF() && a.BC.Get() == b.BC.Get() && a.DE.Get() == b.DE.Get() && a.HL.Get() == b.HL.Get() &&
+		 a.SP.Get() == b.SP.Get() && a.PC == b.PC && a.cpuTime == b.cpuTime && a.isOnHalt == b.isOnHalt && a.interuptsOn == b.interuptsOn &&
+		 a.interuptsEnabled == b.interuptsEnabled && gb->totalInstructions == reference->totalInstructions ) {
+		return;
+	}
+
+	mismatches++;
+	printf( "JIT mismatch after the block at 0x%04x, instruction %llu\n", block->startPC, gb->totalInstructions );
+	printf( "  jit:         A %02x F %02x BC %04x DE %04x HL %04x SP %04x PC %04x time %d instructions %llu\n", a.A.Get(), a.GetF(), a.BC.Get(),
+			a.DE.Get(), a.HL.Get(), a.SP.Get(), a.PC, a.cpuTime, gb->totalInstructions );
+	printf( "  interpreter: A %02x F %02x BC %04x DE %04x HL %04x SP %04x PC %04x time %d instructions %llu\n", b.A.Get(), b.GetF(), b.BC.Get(),
+			b.DE.Get(), b.HL.Get(), b.SP.Get(), b.PC, b.cpuTime, reference->totalInstructions );
+	// The two machines have diverged, comparing further would only repeat the same error
+	reference = nullptr;
+}
+
+void Jit::SyncReferenceFrame( Gameboy * gb ) {
+	CatchUp( reference, gb );
+	reference->EndSoundFrame();
+	reference->soundBuffer.clear();
+	reference->cpu.cpuTime = 0;
+	reference->mem.inputMask = gb->mem.inputMask;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "gb_emu.h"
+
+struct Gameboy;
+struct CodeBlock;
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define GBEMU_JIT_SUPPORTED 1
+#else
+#define GBEMU_JIT_SUPPORTED 0
+#endif
+
+// Compiles hot ROM blocks to x86-64. The generated code keeps the guest registers in host registers for the whole
+// block and only counts clocks, it goes back to the scheduler when an event comes due, an interrupt can be taken or
+// the clock budget runs out, so it stays in lockstep with the interpreter.
+struct Jit {
+	// Returns -1 when the block ran to its end or had to stop, otherwise the index of the instruction where RunBlock
+	// has to take over
+	typedef int ( *BlockFunction )( Gameboy * gb );
+
+	static constexpr int hotThreshold = 32;
+	static constexpr int codeArenaSize = 4 * 1024 * 1024;
+	static constexpr int lookupCacheSize = 1024;
+
+	struct CompiledBlock {
+		int			  hits = 0;
+		BlockFunction code = nullptr;
+	};
+
+	std::unordered_map< const CodeBlock *, CompiledBlock > blocks;
+	// Direct mapped in front of blocks, whose entries stay where they are until Flush. Allocated on the first run
+	struct LookupCacheEntry {
+		const CodeBlock * block = nullptr;
+		CompiledBlock *	  compiled = nullptr;
+	};
+	std::vector< LookupCacheEntry > lookupCache;
+	byte *												  codeArena = nullptr;
+	int													  codeArenaUsed = 0;
+
+	// Valid while a compiled block runs, read by the helpers it calls
+	int	   clockBudget = 0;
+	uint32 generation = 0;
+
+	// Z, H and C from the host flags stored by LAHF (ZF bit 6, AF bit 4, CF bit 0)
+	byte lahfToFlags[ 0x100 ];
+
+	// Lockstep verification: a second machine running the interpreter only, compared after each compiled block
+	Gameboy * reference = nullptr;
+	uint64	  verifiedBlocks = 0;
+	uint64	  mismatches = 0;
+
+	Jit();
+	~Jit();
+
+	static bool IsSupported() { return GBEMU_JIT_SUPPORTED != 0; }
+
+	// Runs the compiled version of block if it is hot enough, returns false if the caller has to run it another way
+	bool Run( Gameboy * gb, const CodeBlock * block, int clockBudget );
+	void Flush();
+
+	// Brings the reference machine to the same point as gb and compares the CPU state
+	void Verify( Gameboy * gb, const CodeBlock * block );
+	// Keeps the reference in sync across frame boundaries, called before gb starts a new frame
+	void SyncReferenceFrame( Gameboy * gb );
+
+private:
+	BlockFunction Compile( Gameboy * gb, const CodeBlock * block );
+	byte *		  AllocateCode( const byte * code, int size );
+};
@@ -4,10 +4,41 @@
 #include "cpu.h"
 #include "sound/Gb_Apu.h"
 
-void Gameboy::ResetMemory() {
-	memset( mem.VRAM, 0, 0x4000 );
-	memset( mem.workRAM, 0, 0x9000 );
+void Gameboy::ResetMemory( bool isCGB ) {
+	int VRAMSize = isCGB ? 0x4000 : 0x2000;
+	int workRAMSize = isCGB ? 0x8000 : 0x2000;
+	int cartRAMSize = cart != nullptr ? cart->ramSize : 0;
+	int arenaSize = VRAMSize + workRAMSize + cartRAMSize;
+	byte * cartRAM = nullptr;
+	if ( arenaSize != stateArenaSize ) {
+		byte * arena = new byte[ arenaSize ];
+		cartRAM = arena + VRAMSize + workRAMSize;
+		if ( cart != nullptr && cart->ram != nullptr ) {
+			memcpy( cartRAM, cart->ram, cartRAMSize );
+		} else {
+			memset( cartRAM, 0, cartRAMSize );
+		}
+		delete[] stateArena;
+		stateArena = arena;
+		stateArenaSize = arenaSize;
+	} else {
+		cartRAM = stateArena + VRAMSize + workRAMSize;
+		if ( cart != nullptr && cart->ram != cartRAM ) {
+			memset( cartRAM, 0, cartRAMSize );
+		}
+	}
+	mem.VRAM = stateArena;
+	mem.workRAM = stateArena + VRAMSize;
+	mem.VRAMSize = VRAMSize;
+	mem.workRAMSize = workRAMSize;
+	ppu.tiles.Allocate( VRAMSize );
+	if ( cart != nullptr ) {
+		cart->ram = cartRAMSize > 0 ? cartRAM : nullptr;
+	}
+	memset( mem.VRAM, 0, mem.VRAMSize );
+	memset( mem.workRAM, 0, mem.workRAMSize );
 	memset( mem.OAM, 0, 0x100 );
+	ppu.spriteListsStale = true;
 	memset( mem.highRAM, 0, 0x100 );
 	mem.workRAMBankIndex = 1;
 	mem.VRAMBankIndex = 0;
@@ -59,42 +90,145 @@ void Gameboy::ResetMemory() {
 	mem.highRAM[0xFF] = 0x00;
 }
 
-void Gameboy::Write( uint16 addr, byte value ) {
+void Gameboy::UpdateMemoryMap() {
+	for ( int i = 0; i < 0x100; i++ ) {
+		memoryMap.readPages[ i ] = nullptr;
+		memoryMap.writePages[ i ] = nullptr;
+	}
+	MapCartridgePages();
+	MapVRAMPages();
+	MapWorkRAMPages();
+	if ( mem.highRAM[ 0x50 ] != 0 ) {
+		// Echo RAM mirrors the start of work RAM without banking, writes are dropped
+		for ( int i = 0xe0; i < 0xfe; i++ ) {
+			memoryMap.readPages[ i ] = mem.workRAM + ( i - 0xe0 ) * 0x100;
+		}
+	}
+}
+
+template < typename Mapper >
+void Gameboy::MapCartridgePages() {
+	if ( mem.highRAM[ 0x50 ] == 0 ) {
+		// The BIOS is mapped over the cartridge, every read goes through ReadUnmapped
+		return;
+	}
+	Mapper *	 mapper = static_cast< Mapper * >( cart );
+	const byte * bank0 = mapper != nullptr ? mapper->MapRead( 0x0000 ) : nullptr;
+	const byte * bank1 = mapper != nullptr ? mapper->MapRead( 0x4000 ) : nullptr;
+	const byte * ramRead = mapper != nullptr ? mapper->MapRead( 0xa000 ) : nullptr;
+	byte *		 ramWrite = mapper != nullptr ? mapper->MapWrite( 0xa000 ) : nullptr;
+	for ( int i = 0; i < 0x40; i++ ) {
+		memoryMap.readPages[ i ] = bank0 != nullptr ? bank0 + i * 0x100 : nullptr;
+		memoryMap.readPages[ 0x40 + i ] = bank1 != nullptr ? bank1 + i * 0x100 : nullptr;
+	}
+	for ( int i = 0; i < 0x20; i++ ) {
+		memoryMap.readPages[ 0xa0 + i ] = ramRead != nullptr ? ramRead + i * 0x100 : nullptr;
+		memoryMap.writePages[ 0xa0 + i ] = ramWrite != nullptr ? ramWrite + i * 0x100 : nullptr;
+	}
+}
+
+template < typename Mapper >
+void Gameboy::WriteCartridge( uint16 addr, byte value ) {
+	Mapper * mapper = static_cast< Mapper * >( cart );
+	mapper->Write( addr, value );
+	// The mapped ROM bank may have changed
+	blockCache.generation++;
+	MapCartridgePages< Mapper >();
+}
+
+template void Gameboy::MapCartridgePages< Cartridge >();
+template void Gameboy::MapCartridgePages< ROM >();
+template void Gameboy::MapCartridgePages< MBC1 >();
+template void Gameboy::MapCartridgePages< MBC3 >();
+template void Gameboy::MapCartridgePages< MBC5 >();
+template void Gameboy::WriteCartridge< Cartridge >( uint16 addr, byte value );
+template void Gameboy::WriteCartridge< ROM >( uint16 addr, byte value );
+template void Gameboy::WriteCartridge< MBC1 >( uint16 addr, byte value );
+template void Gameboy::WriteCartridge< MBC3 >( uint16 addr, byte value );
+template void Gameboy::WriteCartridge< MBC5 >( uint16 addr, byte value );
+
+void Gameboy::MapVRAMPages() {
+	byte * bank = mem.VRAM + mem.VRAMBankIndex * 0x2000;
+	for ( int i = 0; i < 0x20; i++ ) {
+		if ( mem.highRAM[ 0x50 ] != 0 ) {
+			memoryMap.readPages[ 0x80 + i ] = bank + i * 0x100;
+		}
+		// Tile data writes go to WriteUnmapped, which marks the decoded tile stale
+		memoryMap.writePages[ 0x80 + i ] = 0x80 + i < 0x98 ? nullptr : bank + i * 0x100;
+	}
+}
+
+void Gameboy::MapWorkRAMPages() {
+	for ( int i = 0; i < 0x20; i++ ) {
+		uint32 ramAddress = i < 0x10 ? i * 0x100 : ( i - 0x10 ) * 0x100 + mem.WorkRAMBankOffset();
+		byte * page = mem.workRAM + ramAddress;
+		if ( mem.highRAM[ 0x50 ] != 0 ) {
+			memoryMap.readPages[ 0xc0 + i ] = page;
+		}
+		bool holdsCode = false;
+		for ( uint32 bits = ramAddress / 64; bits < ( ramAddress + 0x100 ) / 64; bits++ ) {
+			holdsCode = holdsCode || blockCache.ramCodeBits[ bits ] != 0;
+		}
+		memoryMap.writePages[ 0xc0 + i ] = holdsCode ? nullptr : page;
+	}
+}
+
+void Gameboy::WriteUnmapped( uint16 addr, byte value ) {
 	if ( addr < 0x100 ) {
 		return;
 	} else if ( addr < 0x8000 ) {
-		cart->Write( addr, value );
+		( this->*writeCartridge )( addr, value );
 	} else if ( addr < 0xA000 ) {
 		// mem.VRAM banking
 		uint16 bankOffset = mem.VRAMBankIndex * 0x2000;
 		mem.VRAM[ addr - 0x8000 + bankOffset ] = value;
+		ppu.tiles.Invalidate( addr - 0x8000 + bankOffset );
 	} else if ( addr < 0xC000 ) {
 		cart->WriteRAM( addr, value );
 	} else if ( addr < 0xD000 ) {
 		// Work RAM, bank 0
 		mem.workRAM[ addr - 0xC000 ] = value;
+		if ( blockCache.IsRAMCode( addr - 0xC000 ) ) {
+			blockCache.InvalidateRAM( addr - 0xC000 );
+			MapWorkRAMPages();
+		}
 	} else if ( addr < 0xE000 ) {
 		// Work RAM with banking
-		mem.workRAM[ addr - 0xC000 + ( (uint16)mem.workRAMBankIndex * 0x1000 ) ] = value;
+		uint32 ramAddress = addr - 0xD000 + mem.WorkRAMBankOffset();
+		mem.workRAM[ ramAddress ] = value;
+		if ( blockCache.IsRAMCode( ramAddress ) ) {
+			blockCache.InvalidateRAM( ramAddress );
+			MapWorkRAMPages();
+		}
 	} else if ( addr < 0xFE00 ) {
 		// Echo RAM, don't know yet what to do with that
 		// DEBUG_BREAK;
 	} else if ( addr < 0xFEA0 ) {
 		// Object Attribute Memory
 		mem.OAM[ addr - 0xFE00 ] = value;
+		ppu.spriteListsStale = true;
 	} else if ( addr < 0xFF00 ) {
 		// Unusable memory
 		// DEBUG_BREAK;
 	} else {
 		WriteHighRam( addr, value );
+		if ( addr >= 0xFF80 && addr < 0xFFFF && blockCache.IsRAMCode( BlockCache::highRAMCodeOffset + addr - 0xFF80 ) ) {
+			blockCache.InvalidateRAM( BlockCache::highRAMCodeOffset + addr - 0xFF80 );
+		} else if ( addr == 0xFF50 || addr == 0xFF70 ) {
+			// BIOS mapping or work RAM bank changed
+			blockCache.generation++;
+			UpdateMemoryMap();
+		} else if ( addr == 0xFF4F ) {
+			MapVRAMPages();
+		}
 	}
 }
 
-byte Gameboy::Read( uint16 addr ) {
+byte Gameboy::ReadUnmapped( uint16 addr ) {
 	if ( !cpu.IsCGB && mem.highRAM[ 0x50 ] == 0 && addr < 0x100 ) {
 		return DMG_BIOS[ addr ];
 	}
-	if ( cpu.IsCGB && mem.highRAM[ 0x50 ] == 0 && (addr < 0x100 || addr >= 0x200) ) {
+	if ( cpu.IsCGB && mem.highRAM[ 0x50 ] == 0 && (addr < 0x100 || (addr >= 0x200 && addr < 0x900)) ) {
 		return CGB_BIOS[ addr ];
 	}
 	switch ( ( addr & 0xf000 ) >> 12 ) { // Switch on 4th byte
@@ -124,7 +258,7 @@ byte Gameboy::Read( uint16 addr ) {
 			return mem.workRAM[ addr - 0xc000 ];
 		case 0xd:
 			// Work RAM with banking
-			return mem.workRAM[ addr - 0xc000 + ( (uint16)mem.workRAMBankIndex * 0x1000 ) ];
+			return mem.workRAM[ addr - 0xd000 + mem.WorkRAMBankOffset() ];
 		case 0xe:
 		case 0xf: {
 			if ( addr < 0xFE00 ) {
@@ -159,6 +293,10 @@ byte Gameboy::ReadHighRam( uint16 addr ) {
 		return apu.read_register( cpu.cpuTime * APU_OVERCLOCKING, addr );
 	} else if ( addr == 0xff0f ) {
 		return mem.highRAM[ 0x0f ] | 0xe0;
+	} else if ( addr == 0xff04 || addr == 0xff05 ) {
+		// DIV and TIMA
+		cpu.SyncTimer( this );
+		return mem.highRAM[ addr - 0xff00 ];
 	} else if ( addr > 0xff72 && addr <= 0xff77 ) {
 		// Unkown
 		DEBUG_BREAK;
@@ -201,38 +339,74 @@ void Gameboy::WriteHighRam( uint16 addr, byte value ) {
 	switch ( lowPart ) {
 		case 0x02:
 			// DEBUG_BREAK; // Serial transfer control
+			if ( serialOutput != nullptr && value == 0x81 ) {
+				// No link cable, the byte being sent is only logged. Test ROMs report their results this way
+				fputc( mem.highRAM[ 0x01 ], serialOutput );
+				fflush( serialOutput );
+			}
 			break;
 		case 0x04:
 			// Divider register
+			cpu.SyncTimer( this );
 			cpu.clockCounter = 0;
 			cpu.divider = 0;
 			mem.highRAM[ lowPart ] = 0;
+			cpu.ScheduleTimer( this );
 			break;
 		case 0x05:
+			// TIMA
+			cpu.SyncTimer( this );
+			mem.highRAM[ lowPart ] = value;
+			cpu.ScheduleTimer( this );
+			break;
 		case 0x06:
-			// TIMA and TMA
+			// TMA, only read when TIMA overflows
 			mem.highRAM[ lowPart ] = value;
 			break;
 		case 0x07: {
 			// Tac
+			cpu.SyncTimer( this );
 			byte currentFreq = mem.highRAM[ lowPart ] & 0x3;
 			mem.highRAM[ lowPart ] = value | 0xf8;
 			byte newValue = mem.highRAM[ lowPart ] & 0x3;
 			if ( currentFreq != newValue ) {
 				cpu.clockCounter = 0;
 			}
+			cpu.ScheduleTimer( this );
 			break;
 		}
+		case 0x0f:
+			if ( BIT_IS_SET( mem.highRAM[ 0x0f ], 1 ) && !BIT_IS_SET( value, 1 ) ) {
+				// A STAT interrupt still matching LYC is raised again after the next instruction
+				scheduler.Schedule( EVENT_PPU_STATUS, 0 );
+			}
+			mem.highRAM[ 0x0f ] = value;
+			break;
+		case 0x40:
+		case 0x45:
+			// LCDC and LYC
+			mem.highRAM[ lowPart ] = value;
+			scheduler.Schedule( EVENT_PPU_STATUS, 0 );
+			break;
 		case 0x41:
 			mem.highRAM[ 0x41 ] = value | 0x80;
+			scheduler.Schedule( EVENT_PPU_STATUS, 0 );
 			break;
 		case 0x44:
 			// Scanline register
 			mem.highRAM[ 0x44 ] = value;
+			scheduler.Schedule( EVENT_PPU_STATUS, 0 );
 			break;
 		case 0x46:
 			DMATransfer( value );
 			break;
+		case 0x47:
+		case 0x48:
+		case 0x49:
+			// BGP, OBP0 and OBP1
+			mem.highRAM[ lowPart ] = value;
+			ppu.linePaletteStale = true;
+			break;
 		case 0x4d:
 			if ( cpu.IsCGB ) {
 				cpu.speedSwitchRequested = BIT_IS_SET( value, 0 );
@@ -257,6 +431,7 @@ void Gameboy::WriteHighRam( uint16 addr, byte value ) {
 		case 0x69:
 			if ( cpu.IsCGB ) {
 				mem.bgPalette.Write( value );
+				ppu.linePaletteStale = true;
 			}
 			break;
 		case 0x6a:
@@ -268,6 +443,7 @@ void Gameboy::WriteHighRam( uint16 addr, byte value ) {
 		case 0x6b:
 			if ( cpu.IsCGB ) {
 				mem.spritePalette.Write( value );
+				ppu.linePaletteStale = true;
 			}
 			break;
 		case 0x70:
@@ -296,6 +472,8 @@ void Gameboy::DMATransfer_CGB( byte value ) {
 	if ( value >> 7 == 0 ) {
 		PerformDMATransfer(length);
 		mem.highRAM[0x55] = 0xff;
+		// The CPU waits for the transfer, 32 clocks per block at single speed and twice as many CPU clocks at double speed
+		StallCpu( length / 0x10 * 32 * cpu.speed );
 	} else {
 		mem.hdmaLength = value;
 		mem.hdmaActive = true;
@@ -304,6 +482,12 @@ void Gameboy::DMATransfer_CGB( byte value ) {
 
 void Gameboy::DMATransfer( byte value ) {
 	uint16 addr = (uint16)value << 8;
+	const byte * page = memoryMap.readPages[ value ];
+	if ( useBulkTransfers && page != nullptr ) {
+		memcpy( mem.OAM, page, 0xa0 );
+		ppu.spriteListsStale = true;
+		return;
+	}
 	for ( uint16 i = 0; i < 0xa0; i++ ) {
 		Write( 0xfe00 + i, Read( addr + i ) );
 	}
@@ -330,11 +514,9 @@ void Gameboy::PerformDMATransfer( uint16 length ) {
 	uint16 dest = (uint16)mem.highRAM[ 0x53 ] << 8 | ((uint16)mem.highRAM[ 0x54 ] & 0x1ff0);
 	dest += 0x8000;
 
-	for ( uint16 i = 0; i < length; i++ ) {
-		Write( dest, Read( source ) );
-		dest++;
-		source++;
-	}
+	CopyThroughBus( dest, source, length );
+	dest += length;
+	source += length;
 
 	mem.highRAM[ 0x51 ] = BIT_HIGH_8( source );
 	mem.highRAM[ 0x52 ] = BIT_LOW_8( source );
@@ -342,6 +524,36 @@ void Gameboy::PerformDMATransfer( uint16 length ) {
 	mem.highRAM[ 0x54 ] = dest & 0xf0;
 }
 
+void Gameboy::CopyThroughBus( uint16 dest, uint16 source, int length ) {
+	while ( length > 0 ) {
+		// Up to the end of the source or the destination page
+		int			 run = MIN( length, MIN( 0x100 - ( source & 0xff ), 0x100 - ( dest & 0xff ) ) );
+		const byte * from = memoryMap.readPages[ source >> 8 ];
+		byte *		 to = memoryMap.writePages[ dest >> 8 ];
+		// Tile data is not mapped for writes, the copy marks the decoded tiles stale itself
+		bool tileData = dest >= 0x8000 && dest < 0x9800;
+		if ( tileData ) {
+			to = mem.VRAM + mem.VRAMBankIndex * 0x2000 + ( dest & 0xff00 ) - 0x8000;
+		}
+		// Overlapping runs are copied byte by byte, forward, as the bus does
+		bool overlap = from != nullptr && to != nullptr && from + ( source & 0xff ) < to + ( dest & 0xff ) + run &&
+					   to + ( dest & 0xff ) < from + ( source & 0xff ) + run;
+		if ( useBulkTransfers && from != nullptr && to != nullptr && !overlap ) {
+			memcpy( to + ( dest & 0xff ), from + ( source & 0xff ), run );
+			if ( tileData ) {
+				ppu.tiles.InvalidateRange( ( int )( to + ( dest & 0xff ) - mem.VRAM ), run );
+			}
+		} else {
+			for ( int i = 0; i < run; i++ ) {
+				Write( dest + i, Read( source + i ) );
+			}
+		}
+		dest += run;
+		source += run;
+		length -= run;
+	}
+}
+
 void Gameboy::RaiseInterupt( byte code ) {
 	byte mask = Read( 0xff0f );
 	mask = BIT_SET( mask, code );
@@ -2,8 +2,7 @@
 #include "ppu.h"
 #include "cpu.h"
 #include "gameboy.h"
-#include <imgui/imgui.h>
-#include "gui/window.h"
+#include "render_kernels.h"
 
 constexpr int lcdMode1Bounds = 144;
 constexpr int lcdMode2Bounds = 376;
@@ -38,15 +37,11 @@ uint8 cgbColorsValue[] = {
 	0x83, 0x8b, 0x94, 0x9c, 0xa4, 0xac, 0xb4, 0xbd, 0xc5, 0xcd, 0xd5, 0xde, 0xe6, 0xee, 0xf6, 0xff,
 };
 
-void Ppu::AllocateBuffers( const Window & window ) {
-	frontBuffer.Allocate(0, 20, GB_SCREEN_WIDTH * 4, GB_SCREEN_HEIGHT * 4, window);
-	backBuffer.Allocate(0, 20, GB_SCREEN_WIDTH * 4, GB_SCREEN_HEIGHT * 4, window);
-	frontBuffer.texture.Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
-	backBuffer.texture.Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
+void Ppu::AllocateBuffers(PixelFormat format) {
+	frontBuffer.Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, format);
+	backBuffer.Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, format);
 	workBuffer = &frontBuffer;
 	drawingBuffer = &backBuffer;
-	backgroundTexture.Allocate(256, 256);
-	tilesetTexture.Allocate(16 * 8, 24 * 8);
 	Reset();
 }
 
@@ -54,36 +49,49 @@ bool Ppu::IsLcdOn(Gameboy * gb) {
 	return BIT_IS_SET(gb->Read(0xff40), 7);
 }
 
-void Ppu::Update(int cycles, Gameboy * gb) {
+void Ppu::UpdateStatus(Gameboy * gb, uint64 instructionStart) {
 	byte status = gb->Read(0xff41);
 
 	if (!IsLcdOn(gb)) {
 		scanlineCounter = 456;
+		lcdRunning = false;
 		gb->mem.highRAM[0x44] = 0;
 		status &= 0xfc;
 		status = BIT_UNSET(status, 0);
 		status = BIT_UNSET(status, 1);
-		gb->Write(0xff41, status);
+		gb->mem.highRAM[0x41] = status | 0x80;
+		gb->scheduler.Cancel(EVENT_PPU_STATUS);
+		gb->scheduler.Cancel(EVENT_PPU_LINE);
 		return;
 	}
+	if (!lcdRunning) {
+		// Switched on during this instruction, whose clocks already count toward the first line
+		lcdRunning = true;
+		scanlineBaseTime = instructionStart;
+		gb->scheduler.Schedule(EVENT_PPU_LINE, scanlineBaseTime + scanlineCounter);
+	}
+	int  counter = ScanlineCounterAt(instructionStart);
 	byte currentLine = gb->Read(0xff44);
 	byte currentMode = status & 0x3;
 	byte nextMode = 0;
 	bool requestInterupt = false;
+	int  nextModeBounds = 0;
 
 	if (currentLine >= 144) {
 		nextMode = 1;
 		status = BIT_SET(status, 0);
 		status = BIT_UNSET(status, 1);
 		requestInterupt = BIT_IS_SET(status, 4);
-	} else if (scanlineCounter >= lcdMode2Bounds) {
+	} else if (counter >= lcdMode2Bounds) {
 		nextMode = 2;
+		nextModeBounds = lcdMode2Bounds;
 		status = BIT_UNSET(status, 0);
 		status = BIT_SET(status, 1);
 		requestInterupt = BIT_IS_SET(status, 5);
 	}
-	else if (scanlineCounter >= lcdMode3Bounds) {
+	else if (counter >= lcdMode3Bounds) {
 		nextMode = 3;
+		nextModeBounds = lcdMode3Bounds;
 		status = BIT_SET(status, 0);
 		status = BIT_SET(status, 1);
 		if (nextMode != currentMode) {
@@ -114,71 +122,137 @@ void Ppu::Update(int cycles, Gameboy * gb) {
 		status = BIT_UNSET(status, 2);
 	}
 
-	gb->Write(0xff41, status);
+	gb->mem.highRAM[0x41] = status | 0x80;
 
-	////////////////
+	if (nextModeBounds != 0) {
+		// First instruction starting with fewer clocks left than the bounds of the current mode
+		gb->scheduler.Schedule(EVENT_PPU_STATUS, instructionStart + (counter - nextModeBounds) + 1);
+	} else {
+		// Nothing changes before the next line
+		gb->scheduler.Cancel(EVENT_PPU_STATUS);
+	}
+}
 
-	scanlineCounter -= cycles;
+void Ppu::AdvanceLine(Gameboy * gb) {
+	SyncScanlineCounter(gb->scheduler.now);
 
-	if (scanlineCounter <= 0) {
-		byte currentLine = gb->Read(0xff44) + 1;
-		gb->Write(0xff44, currentLine);
-		if (currentLine > 153) {
-			SwapBuffers();
-			memset(bgPriority, 0, sizeof(bgPriority));
-			gb->Write(0xff44, 0);
-			currentLine = 0;
-		}
+	byte currentLine = gb->Read(0xff44) + 1;
+	gb->mem.highRAM[0x44] = currentLine;
+	if (currentLine > 153) {
+		SwapBuffers();
+		gb->mem.highRAM[0x44] = 0;
+		currentLine = 0;
+	}
 
-		scanlineCounter += 456 * gb->cpu.speed;
-		if (currentLine == GB_SCREEN_HEIGHT) {
-			gb->RaiseInterupt(0);
-		}
+	scanlineCounter += 456 * gb->cpu.speed;
+	if (currentLine == GB_SCREEN_HEIGHT) {
+		gb->RaiseInterupt(0);
 	}
+
+	gb->scheduler.Schedule(EVENT_PPU_LINE, scanlineBaseTime + scanlineCounter);
+	// The new line shows up in STAT after the next instruction
+	gb->scheduler.Schedule(EVENT_PPU_STATUS, gb->scheduler.now);
 }
 
 void Ppu::DrawScanLine(int scanline, Gameboy * gb) {
+	if (gb->scheduler.now < skipOutputUntil) {
+		workSkipped = true;
+		return;
+	}
 	byte control = gb->Read(0xff40);
+	memset(bgPriority, 0, sizeof(bgPriority));
 
-	if ((gb->cpu.IsCGB || BIT_IS_SET(control, 0)) && debugDrawTiles) {
+	bool drawTiles = (gb->cpu.IsCGB || BIT_IS_SET(control, 0)) && debugDrawTiles;
+	if (drawTiles) {
 		DrawTiles(scanline, control, gb);
+	} else {
+		memset(lineSlots, noSlot, sizeof(lineSlots));
 	}
 
 	if (BIT_IS_SET(control, 1) && debugDrawSprites) {
 		DrawSprites(scanline, control, gb);
 	}
-}
 
-void Ppu::PutPixel(byte x, byte y, byte tileAttr, byte colorIndex, byte palette, bool priority, Gameboy * gb, const CGBPalette & CGBpalette) {
-	Pixel pixel;
-	if (gb->cpu.IsCGB) {
-		byte cgbPalette = tileAttr & 0x7;
-		byte index = cgbPalette * 8 + colorIndex * 2;
-		uint16 color = CGBpalette.palette[index] | (CGBpalette.palette[index + 1] << 8);
-		pixel.R = cgbColorsValue[ color & 0x1f ];
-		pixel.G = cgbColorsValue[ ( color >> 5 ) & 0x1f ];
-		pixel.B = cgbColorsValue[ ( color >> 10 ) & 0x1f ];
+	// The palettes as the line is drawn, a write between two lines shows from the next one
+	if (linePaletteStale || linePalette.format != workBuffer->format) {
+		linePalette.format = workBuffer->format;
+		UpdateLinePalette(gb);
 	}
-	else {
-		byte highBit = colorIndex << 1 | 1;
-		byte lowBit = colorIndex << 1;
-		byte column = (BIT_VALUE(palette, highBit) << 1) | BIT_VALUE(palette, lowBit);
-		pixel = dmgPaletteColors[selectedPalette][column];
+	gbemu_debug_assert(scanline < workBuffer->height);
+	byte * pixels = workBuffer->Row(scanline);
+	if (drawTiles) {
+		renderKernels.resolveLine(lineSlots, GB_SCREEN_WIDTH, linePalette, pixels);
+	} else {
+		int bytesPerPixel = BytesPerPixel(linePalette.format);
+		for (int x = 0; x < GB_SCREEN_WIDTH; x++) {
+			if (lineSlots[x] != noSlot) {
+				StorePixel(pixels + x * bytesPerPixel, linePalette.format, linePalette.packed[lineSlots[x]]);
+			}
+		}
+	}
+}
+
+void Ppu::PutPixel(byte x, byte slot, bool priority) {
+	if ( (priority && bgPriority[x] == 0 ) || tileScanLine[x] == 0 ) {
+		lineSlots[x] = slot;
 	}
-	if ( (priority && bgPriority[x + y * GB_SCREEN_WIDTH] == 0 ) || tileScanLine[x] == 0 ) {
-		workBuffer->texture.SetPixel(pixel, x, y);
+}
+
+static Pixel CGBColor(const CGBPalette & palette, int color) {
+	uint16 value = palette.palette[color * 2] | (palette.palette[color * 2 + 1] << 8);
+	return { cgbColorsValue[value & 0x1f], cgbColorsValue[(value >> 5) & 0x1f], cgbColorsValue[(value >> 10) & 0x1f] };
+}
+
+void Ppu::UpdateLinePalette(Gameboy * gb) {
+	if (gb->cpu.IsCGB) {
+		for (int i = 0; i < 32; i++) {
+			linePalette.Set(i, CGBColor(gb->mem.bgPalette, i));
+			linePalette.Set(32 + i, CGBColor(gb->mem.spritePalette, i));
+		}
+	} else {
+		byte bgp = gb->Read(0xff47);
+		byte obp0 = gb->Read(0xff48);
+		byte obp1 = gb->Read(0xff49);
+		for (int i = 0; i < 4; i++) {
+			linePalette.Set(i, dmgPaletteColors[selectedPalette][(bgp >> (i * 2)) & 3]);
+			linePalette.Set(32 + i, dmgPaletteColors[selectedPalette][(obp0 >> (i * 2)) & 3]);
+			linePalette.Set(36 + i, dmgPaletteColors[selectedPalette][(obp1 >> (i * 2)) & 3]);
+		}
 	}
+	linePaletteStale = false;
 }
 
 void Ppu::SwapBuffers() {
-	if ( workBuffer == &frontBuffer) {
-		workBuffer = &backBuffer;
-		drawingBuffer = &frontBuffer;
-	} else {
-		workBuffer = &frontBuffer;
-		drawingBuffer = &backBuffer;
+	// Front and back buffers, or the run-ahead pair
+	SimpleTexture * finished = workBuffer;
+	workBuffer = drawingBuffer;
+	drawingBuffer = finished;
+	workBuffer->Clear();
+	drawingSkipped = workSkipped;
+	workSkipped = false;
+}
+
+void Ppu::BeginRunAhead() {
+	if (runAheadBuffers[0].buffer == nullptr) {
+		runAheadBuffers[0].Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, frontBuffer.format);
+		runAheadBuffers[1].Allocate(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, frontBuffer.format);
 	}
-	workBuffer->texture.Clear();
+	realDrawingBuffer = drawingBuffer;
+	realWorkBuffer = workBuffer;
+	// Same pictures as the real pair, for lines drawn before and frames in which the LCD completes none
+	memcpy(runAheadBuffers[0].buffer, workBuffer->buffer, workBuffer->AllocatedSize());
+	memcpy(runAheadBuffers[1].buffer, drawingBuffer->buffer, drawingBuffer->AllocatedSize());
+	workBuffer = &runAheadBuffers[0];
+	drawingBuffer = &runAheadBuffers[1];
+	workSkipped = false;
+	drawingSkipped = false;
+}
+
+const SimpleTexture & Ppu::EndRunAhead() {
+	const SimpleTexture & picture = *drawingBuffer;
+	drawingBuffer = realDrawingBuffer;
+	workBuffer = realWorkBuffer;
+	return picture;
 }
 
 void Ppu::DrawTiles(int scanline, byte control, Gameboy * gb) {
@@ -188,13 +262,8 @@ void Ppu::DrawTiles(int scanline, byte control, Gameboy * gb) {
 	byte windowY = gb->Read(0xff4a);
 	byte windowX = gb->Read(0xff4b) - 7;
 
-	uint16 tileData = 0x8800;
-	bool usingUnsigned = false;
+	bool usingUnsigned = BIT_IS_SET(control, 4);
 	bool usingWindow = false;
-	if (BIT_IS_SET(control, 4)) {
-		tileData = 0x8000;
-		usingUnsigned = true;
-	}
 	if (BIT_IS_SET(control, 5)) {
 		if (gb->Read(0xff44) >= windowY) {
 			usingWindow = true; // Is current scanline inside the window?
@@ -206,84 +275,113 @@ void Ppu::DrawTiles(int scanline, byte control, Gameboy * gb) {
 	}
 
 	byte yPos = usingWindow ? scanline - windowY : scanline + scrollY;
-	uint16 tileRow = (uint16)(yPos / 8) * 32;
-	byte palette = gb->Read(0xff47);
-
-	memset(tileScanLine, 0, sizeof(tileScanLine));
-	// Draw one horizontal line
-	for (byte x = 0; x < GB_SCREEN_WIDTH; x++) {
-		byte xPos = (usingWindow && x >= windowX) ? x - windowX : x + scrollX;
-		uint16 tileColumn = xPos / 8;
-		uint16 tileAddr = backgroundMemory + tileRow + tileColumn;
-
-		uint16 tileLocation;
-		if (usingUnsigned) {
-			int16 tileIndex = (int16)(gb->Read(tileAddr)); 
-			tileLocation = tileData + (uint16)(tileIndex * 16) + 0x0000;
-		}
-		else {
-			int16 tileIndex = (int8)(gb->Read(tileAddr));
-			tileLocation = (uint16)((int)tileData + (int)((tileIndex + 128) * 16)) + 0x0000;
-		}
-
-		// Attributes used in CGB mode
-		//
-		//    Bit 0-2  Background Palette number  (BGP0-7)
-		//    Bit 3    Tile VRAM Bank number      (0=Bank 0, 1=Bank 1)
-		//    Bit 5    Horizontal Flip            (0=Normal, 1=Mirror horizontally)
-		//    Bit 6    Vertical Flip              (0=Normal, 1=Mirror vertically)
-		//    Bit 7    BG-to-OAM Priority         (0=Use OAM priority bit, 1=BG Priority)
-
-		byte tileAttr = gb->Read(tileAddr + 0x2000);
-		bool useBank1 = BIT_IS_SET(tileAttr, 3);
-		bool hflip = BIT_IS_SET(tileAttr, 5);
-		bool vflip = BIT_IS_SET(tileAttr, 6);
-		bool priority = BIT_IS_SET(tileAttr, 7);
+	bool isCGB = gb->cpu.IsCGB;
+	// Tile indices come from the VRAM bank selected for the CPU, as the bus returns them
+	const byte * tileRow = gb->mem.VRAM + gb->mem.VRAMBankIndex * 0x2000 + backgroundMemory - 0x8000 + (yPos / 8) * 32;
+	const byte * attrRow = isCGB ? gb->mem.VRAM + 0x2000 + backgroundMemory - 0x8000 + (yPos / 8) * 32 : nullptr;
+
+	// Left of the window the map is followed from SCX, then from the left edge of the window
+	int windowStart = usingWindow && windowX < GB_SCREEN_WIDTH ? windowX : GB_SCREEN_WIDTH;
+	for (int part = 0; part < 2; part++) {
+		int x = part == 0 ? 0 : windowStart;
+		int end = part == 0 ? windowStart : GB_SCREEN_WIDTH;
+		byte offset = part == 0 ? scrollX : (byte)-windowX;
+		// One fetch per tile, then its pixels on the line
+		while (x < end) {
+			byte xPos = x + offset;
+			byte tileIndex = tileRow[xPos / 8];
+			uint16 tileLocation = usingUnsigned ? 0x8000 + tileIndex * 16 : 0x9000 + (int8)tileIndex * 16;
 
-		uint16 bankOffset = gb->cpu.IsCGB && useBank1 ? 0x2000 : 0x0000;
-		byte line = gb->cpu.IsCGB && vflip ? ((7 - yPos) % 8) * 2 : (yPos % 8) * 2;
-
-		byte tileData1 = gb->Read(tileLocation + line + bankOffset);
-		byte tileData2 = gb->Read(tileLocation + line + bankOffset + 1);
+			// Attributes used in CGB mode
+			//
+			//    Bit 0-2  Background Palette number  (BGP0-7)
+			//    Bit 3    Tile VRAM Bank number      (0=Bank 0, 1=Bank 1)
+			//    Bit 5    Horizontal Flip            (0=Normal, 1=Mirror horizontally)
+			//    Bit 6    Vertical Flip              (0=Normal, 1=Mirror vertically)
+			//    Bit 7    BG-to-OAM Priority         (0=Use OAM priority bit, 1=BG Priority)
 
-		if (gb->cpu.IsCGB && hflip) {
-			xPos = 7 - xPos;
+			byte tileAttr = isCGB ? attrRow[xPos / 8] : 0;
+			bool useBank1 = BIT_IS_SET(tileAttr, 3);
+			bool hflip = BIT_IS_SET(tileAttr, 5);
+			bool vflip = BIT_IS_SET(tileAttr, 6);
+			byte priority = BIT_IS_SET(tileAttr, 7) ? 1 : 0;
+
+			uint16 bankOffset = isCGB && useBank1 ? 0x2000 : 0x0000;
+			byte line = isCGB && vflip ? ((7 - yPos) % 8) * 2 : (yPos % 8) * 2;
+
+			const byte * row = tiles.Row(gb->mem.VRAM, tileLocation - 0x8000 + line + bankOffset, isCGB && hflip);
+			byte paletteSlot = (tileAttr & 0x7) * 4;
+
+			int first = xPos % 8;
+			int count = MIN(8 - first, end - x);
+			if (count == 8) {
+				uint64 slots;
+				memcpy(&slots, row, 8);
+				slots |= paletteSlot * 0x0101010101010101ull;
+				memcpy(lineSlots + x, &slots, 8);
+			} else {
+				for (int column = 0; column < count; column++) {
+					lineSlots[x + column] = paletteSlot | row[first + column];
+				}
+			}
+			memcpy(tileScanLine + x, row + first, count);
+			if (isCGB) {
+				memset(bgPriority + x, priority, count);
+			}
+			x += count;
 		}
-		byte colorBit = (int8)((xPos % 8) - 7) * -1;
-		byte colorIndex = (BIT_VALUE(tileData2, colorBit) << 1) | BIT_VALUE(tileData1, colorBit);
-		// Draw if sprite has priority of if no pixel has been drawn there
-		PutPixel(x, scanline, tileAttr, colorIndex, palette, true, gb, gb->mem.bgPalette);
-		tileScanLine[x] = colorIndex;
-		if (gb->cpu.IsCGB) {
-			bgPriority[x + scanline * GB_SCREEN_WIDTH ] = priority ? 1 : 0;
+	}
+}
+
+void Ppu::BuildSpriteLists(int ySize, Gameboy * gb) {
+	memset(lineSpriteCounts, 0, sizeof(lineSpriteCounts));
+	for (int sprite = 0; sprite < 40; sprite++) {
+		const byte * entry = gb->mem.OAM + sprite * 4;
+		int yPos = (int)entry[0] - 16;
+		int firstLine = MAX(yPos, 0);
+		int lastLine = MIN(yPos + ySize, GB_SCREEN_HEIGHT);
+		for (int line = firstLine; line < lastLine; line++) {
+			byte * list = lineSprites[line];
+			int count = lineSpriteCounts[line];
+			if (count == 10) {
+				continue; // Game boy can't display more than 10 sprites per line
+			}
+			// On DMG after the ones with a smaller or the same X
+			int position = count;
+			while (!gb->cpu.IsCGB && position > 0 && gb->mem.OAM[list[position - 1] * 4 + 1] > entry[1]) {
+				list[position] = list[position - 1];
+				position--;
+			}
+			list[position] = (byte)sprite;
+			lineSpriteCounts[line] = (byte)(count + 1);
 		}
 	}
+	spriteListsHeight = ySize;
+	spriteListsCGB = gb->cpu.IsCGB;
+	spriteListsStale = false;
 }
 
 void Ppu::DrawSprites(int scanline, byte control, Gameboy * gb) {
 	int ySize = BIT_IS_SET(control, 2) ? 16 : 8;
-	byte palette1 = gb->Read(0xFF48);
-	byte palette2 = gb->Read(0xFF49);
-
-	int minX[GB_SCREEN_WIDTH];
-	memset(minX, 0, sizeof(minX));
-	int lineSprites = 0;
-	for (uint16 sprite = 0; sprite < 40; sprite++) {
-		uint16 index = sprite * 4;
-
-		int yPos = (int)(gb->Read(0xfe00 + index)) - 16;
-		if (scanline < yPos || scanline >= (yPos + ySize)) {
-			continue;
-		}
+	if (spriteListsStale || ySize != spriteListsHeight || gb->cpu.IsCGB != spriteListsCGB) {
+		BuildSpriteLists(ySize, gb);
+	}
+	gbemu_debug_assert(scanline < GB_SCREEN_HEIGHT);
+	int lineSpriteCount = lineSpriteCounts[scanline];
+	if (lineSpriteCount == 0) {
+		return;
+	}
 
-		if (lineSprites >= 10) {
-			break; // Game boy can't display more than 10 sprites per line
-		}
-		lineSprites++;
+	// Set where a sprite drawn before put a pixel, the next ones are behind it
+	byte taken[GB_SCREEN_WIDTH];
+	memset(taken, 0, sizeof(taken));
+	for (int i = 0; i < lineSpriteCount; i++) {
+		const byte * entry = gb->mem.OAM + lineSprites[scanline][i] * 4;
 
-		int xPos = (int)(gb->Read(0xfe00 + index + 1)) - 8;
-		int tileLocation = gb->Read(0xfe00 + index + 2);
-		int spriteAttr = gb->Read(0xfe00 + index + 3);
+		int yPos = (int)entry[0] - 16;
+		int xPos = (int)entry[1] - 8;
+		int tileLocation = entry[2];
+		int spriteAttr = entry[3];
 
 		bool useBank1 = BIT_IS_SET(spriteAttr, 3);
 		bool hflip = BIT_IS_SET(spriteAttr, 5);
@@ -291,6 +389,8 @@ void Ppu::DrawSprites(int scanline, byte control, Gameboy * gb) {
 		bool priority = !BIT_IS_SET(spriteAttr, 7);
 
 		uint16 bankOffset = gb->cpu.IsCGB && useBank1 ? 0x2000 : 0x0;
+		// Sprite palettes start at slot 32, DMG has OBP0 and OBP1
+		byte paletteSlot = 32 + (gb->cpu.IsCGB ? (spriteAttr & 0x7) * 4 : BIT_IS_SET(spriteAttr, 4) ? 4 : 0);
 
 		int line = scanline - yPos;
 		if (vflip) {
@@ -298,66 +398,29 @@ void Ppu::DrawSprites(int scanline, byte control, Gameboy * gb) {
 		}
 
 		uint16 dataAddr = ((uint16)tileLocation * 16) + (line * 2) + bankOffset;
-		byte spriteData1 = gb->mem.VRAM[dataAddr];
-		byte spriteData2 = gb->mem.VRAM[dataAddr + 1];
+		const byte * row = tiles.Row(gb->mem.VRAM, dataAddr, hflip);
 
 		// Draw the sprite line
-		for (byte tilePixel = 0; tilePixel < 8; tilePixel++) {
-			int16 pixel = xPos + int16(7 - tilePixel);
-			if (pixel < 0 || pixel >= GB_SCREEN_WIDTH) {
-				continue;
-			}
-			// Check if something was already drawn here
-			if (minX[pixel] != 0 && (gb->cpu.IsCGB || minX[pixel] <= xPos + 100)) {
+		for (int column = 7; column >= 0; column--) {
+			int16 pixel = xPos + column;
+			if (pixel < 0 || pixel >= GB_SCREEN_WIDTH || taken[pixel] != 0) {
 				continue;
 			}
 
-			byte colorBit = hflip ? (byte)((int8)(tilePixel - 7) * -1) : tilePixel;
-			byte colorIndex = (BIT_VALUE(spriteData2, colorBit) << 1) | BIT_VALUE(spriteData1, colorBit);
+			byte colorIndex = row[column];
 
 			if (colorIndex == 0) {
 				// transparent pixel
 				continue;
 			}
 
-			PutPixel((byte)pixel, (byte)scanline, spriteAttr, colorIndex, BIT_IS_SET(spriteAttr, 4) ? palette2 : palette1, priority, gb, gb->mem.spritePalette);
+			PutPixel((byte)pixel, paletteSlot | colorIndex, priority);
 
-			minX[pixel] = xPos + 100;
+			taken[pixel] = 1;
 		}
 	}
 }
 
-void Ppu::DebugDraw(Gameboy * gb) {
-	//ImGui::Image((void*)(ppu->frontBuffer->textureHandler), ImVec2(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
-	const char * palettesNames[] = { "Green", "Grey", "Blue" };
-	ImGui::Combo("Palette theme", &selectedPalette, palettesNames, 3);
-	ImGui::Checkbox( "Draw tiles", &(Ppu::debugDrawTiles) );
-	ImGui::SameLine();
-	ImGui::Checkbox( "Draw sprites", &(Ppu::debugDrawSprites) );
-	byte scrollY = gb->Read(0xff42);
-	byte scrollX = gb->Read(0xff43);
-	ImGui::Text("Scroll X %d Scroll Y %d", scrollX, scrollY);
-	ImGui::Text("Scanline counter: %d", scanlineCounter);
-	byte currentLine = gb->Read(0xff44);
-	ImGui::Text("Current line: %d", currentLine);
-
-	ImGui::Checkbox( "Draw background texture", &drawBackgroundTexture );
-	if (drawBackgroundTexture) {
-		DrawFullBackgroundToTexture(backgroundTexture, backgroundTexture.width, backgroundTexture.height, gb);
-		backgroundTexture.Update();
-		ImGui::Image((void*)(backgroundTexture.textureHandler), ImVec2((float)backgroundTexture.width, (float)backgroundTexture.height), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
-	}
-	static bool drawTileset = false;
-	ImGui::Checkbox( "Draw tileset", &drawTileset);
-	if (drawTileset) {
-		tilesetTexture.Clear();
-		DrawTilesetToTexture(tilesetTexture, gb);
-		tilesetTexture.Update();
-		ImGui::Image((void*)(tilesetTexture.textureHandler), ImVec2((float)tilesetTexture.width, (float)tilesetTexture.height), ImVec2(0,0), ImVec2(1,1), ImVec4(1.0f,1.0f,1.0f,1.0f), ImVec4(1.0f,1.0f,1.0f,0.5f));
-	}
-	
-}
-
 void Ppu::DrawFullBackgroundToTexture(SimpleTexture & texture, int width, int height, Gameboy * gb) {
 	byte scrollY = gb->Read(0xff42);
 	byte scrollX = gb->Read(0xff43);
@@ -372,15 +435,27 @@ void Ppu::DrawFullBackgroundToTexture(SimpleTexture & texture, int width, int he
 	if ( BIT_IS_SET( control, 3 ) ) {
 		backgroundMemory = 0x9c00; // switching to window memory
 	}
+	byte		palette = gb->Read( 0xff47 );
+	LinePalette colors;
+	colors.format = texture.format;
+	for ( int i = 0; i < 4; i++ ) {
+		colors.Set( i, dmgPaletteColors[ selectedPalette ][ ( palette >> ( i * 2 ) ) & 3 ] );
+	}
+	// Outline of the screen
+	int		boundXMin = MIN( scrollX, ( scrollX + GB_SCREEN_WIDTH ) % width );
+	int		boundYMin = MIN( scrollY, ( scrollY + GB_SCREEN_HEIGHT ) % height );
+	int		boundXMax = MAX( scrollX, ( scrollX + GB_SCREEN_WIDTH ) % width );
+	int		boundYMax = MAX( scrollY, ( scrollY + GB_SCREEN_HEIGHT ) % height );
+	const Pixel outline = { 0, 0, 0 };
+	byte		indices[ 256 ];
+	gbemu_assert( width <= 256 );
 
 	for ( int yPos = 0; yPos < height; yPos++ ) {
 		uint16	tileRow = ( uint16 )( yPos / 8 ) * 32;
-		byte	palette = gb->Read( 0xff47 );
 
-		// Draw one horizontal line
-		for ( int x = 0; x < width; x++ ) {
-			byte	xPos = x;
-			uint16	tileColumn = xPos / 8;
+		// Draw one horizontal line, a tile at a time
+		for ( int x = 0; x < width; x += 8 ) {
+			uint16	tileColumn = ( byte )x / 8;
 			uint16	tileAddr = backgroundMemory + tileRow + tileColumn;
 
 			uint16 tileLocation;
@@ -400,69 +475,47 @@ void Ppu::DrawFullBackgroundToTexture(SimpleTexture & texture, int width, int he
 			//    Bit 6    Vertical Flip              (0=Normal, 1=Mirror vertically)
 			//    Bit 7    BG-to-OAM Priority         (0=Use OAM priority bit, 1=BG Priority)
 
-			byte tileAttr = gb->mem.VRAM[ tileAddr - 0x6000 ];
+			byte tileAttr = gb->cpu.IsCGB ? gb->mem.VRAM[ tileAddr - 0x6000 ] : 0;
 			bool useBank1 = BIT_IS_SET( tileAttr, 3 );
 			bool hflip = BIT_IS_SET( tileAttr, 5 );
 			bool vflip = BIT_IS_SET( tileAttr, 6 );
-			bool priority = BIT_IS_SET( tileAttr, 7 );
 
 			uint16	bankOffset = gb->cpu.IsCGB && useBank1 ? 0x6000 : 0x8000;
 			byte	line = gb->cpu.IsCGB && vflip ? ( ( 7 - yPos ) % 8 ) * 2 : ( yPos % 8 ) * 2;
 
-			byte tileData1 = gb->mem.VRAM[ tileLocation + line - bankOffset ];
-			byte tileData2 = gb->mem.VRAM[ tileLocation + line - bankOffset + 1 ];
-
-			if ( gb->cpu.IsCGB && hflip ) {
-				xPos = 7 - xPos;
-			}
-			byte	colorBit = ( int8 )( ( xPos % 8 ) - 7 ) * -1;
-			byte	colorIndex = ( BIT_VALUE( tileData2, colorBit ) << 1 ) | BIT_VALUE( tileData1, colorBit );
-			byte	highBit = colorIndex << 1 | 1;
-			byte	lowBit = colorIndex << 1;
-			byte	column = ( BIT_VALUE( palette, highBit ) << 1 ) | BIT_VALUE( palette, lowBit );
-			int		boundXMin = MIN( scrollX, ( scrollX + GB_SCREEN_WIDTH ) % width );
-			int		boundYMin = MIN( scrollY, ( scrollY + GB_SCREEN_HEIGHT ) % height );
-			int		boundXMax = MAX( scrollX, ( scrollX + GB_SCREEN_WIDTH ) % width );
-			int		boundYMax = MAX( scrollY, ( scrollY + GB_SCREEN_HEIGHT ) % height );
-			if ( ( ( x == boundXMin || x == boundXMax ) && yPos >= boundYMin && yPos <= boundYMax ) ||
-				 ( ( yPos == boundYMin || yPos == boundYMax ) && x >= boundXMin && x <= boundXMax ) ) {
-				texture.SetPixel( Pixel{ 0, 0, 0 }, xPos, yPos );
-			} else {
-				texture.SetPixel( dmgPaletteColors[ selectedPalette ][ column ], xPos, yPos );
+			const byte * row = tiles.Row( gb->mem.VRAM, tileLocation + line - bankOffset, gb->cpu.IsCGB && hflip );
+			memcpy( indices + x, row, MIN( 8, width - x ) );
+		}
+		renderKernels.resolveLine( indices, width, colors, texture.Row( yPos ) );
+		if ( yPos >= boundYMin && yPos <= boundYMax ) {
+			texture.SetPixel( outline, boundXMin, yPos );
+			texture.SetPixel( outline, boundXMax, yPos );
+		}
+		if ( yPos == boundYMin || yPos == boundYMax ) {
+			for ( int x = boundXMin; x <= boundXMax; x++ ) {
+				texture.SetPixel( outline, x, yPos );
 			}
 		}
 	}
 }
 
 void Ppu::DrawTilesetToTexture(SimpleTexture & texture, Gameboy * gb) {
-	int		x = 0;
-	int		y = 0;
-	byte	palette = gb->Read( 0xff47 );
-	int		line = 0;
-	for ( int i = 0x8000; i < 0x9800; i += 2 ) {
-		byte color1 = gb->Read( i );
-		byte color2 = gb->Read( i + 1 );
-		for ( int j = 7; j >= 0; j-- ) {
-			byte	colorIndex = ( BIT_VALUE( color2, j ) << 1 ) | ( BIT_VALUE( color1, j ) );
-			byte	highBit = colorIndex << 1 | 1;
-			byte	lowBit = colorIndex << 1;
-			byte	column = ( BIT_VALUE( palette, highBit ) << 1 ) | BIT_VALUE( palette, lowBit );
-			Pixel & pixel = dmgPaletteColors[ selectedPalette ][ column ];
-			texture.SetPixel( pixel, x++, y );
-		}
-		line++;
-		if ( line == 8 ) {
-			line = 0;
-			if ( x >= 16 * 8 ) {
-				x = 0;
-				y++;
-			} else {
-				y = y - ( y % 8 );
+	byte		palette = gb->Read( 0xff47 );
+	LinePalette colors;
+	colors.format = texture.format;
+	for ( int i = 0; i < 4; i++ ) {
+		colors.Set( i, dmgPaletteColors[ selectedPalette ][ ( palette >> ( i * 2 ) ) & 3 ] );
+	}
+	int		bankOffset = gb->mem.VRAMBankIndex * 0x2000;
+	byte	indices[ 16 * 8 ];
+	// 16 tiles a row, of the bank the CPU sees
+	for ( int tileRow = 0; tileRow < TileCache::tilesPerBank / 16; tileRow++ ) {
+		for ( int y = 0; y < 8; y++ ) {
+			for ( int column = 0; column < 16; column++ ) {
+				int tile = tileRow * 16 + column;
+				memcpy( indices + column * 8, tiles.Row( gb->mem.VRAM, bankOffset + tile * 16 + y * 2, false ), 8 );
 			}
-		} else {
-			x--;
-			x = x - ( x % 8 );
-			y++;
+			renderKernels.resolveLine( indices, 16 * 8, colors, texture.Row( tileRow * 8 + y ) );
 		}
 	}
 }
@@ -1,57 +1,109 @@
 #pragma once
 
 #include "gb_emu.h"
+#include "render_kernels.h"
 #include "simple_texture.h"
-#include "gui/textured_rectangle.h"
+#include "tile_cache.h"
 
 struct Gameboy;
-struct Window;
-struct CGBPalette;
 
 struct Ppu {
-	TexturedRectangle	frontBuffer;
-	TexturedRectangle	backBuffer;
-	TexturedRectangle * drawingBuffer = nullptr;
-	TexturedRectangle * workBuffer = nullptr;
+	SimpleTexture	frontBuffer;
+	SimpleTexture	backBuffer;
+	SimpleTexture * drawingBuffer = nullptr;
+	SimpleTexture * workBuffer = nullptr;
+	// Run-ahead frames draw there, the pair above keeps the picture of the real machine. Allocated by BeginRunAhead
+	SimpleTexture	runAheadBuffers[ 2 ];
+	SimpleTexture * realDrawingBuffer = nullptr;
+	SimpleTexture * realWorkBuffer = nullptr;
+	// Lines are not drawn before this time on the scheduler clock, for frames nobody sees
+	uint64			skipOutputUntil = 0;
+	// The picture in workBuffer, drawingBuffer, lacks the lines skipped that way
+	bool			workSkipped = false;
+	bool			drawingSkipped = false;
 
 	static bool debugDrawTiles;
 	static bool debugDrawSprites;
 
+	// Clocks left on the current line, as of scanlineBaseTime on the scheduler clock while the LCD runs
 	int		scanlineCounter = 456;
+	uint64	scanlineBaseTime = 0;
+	bool	lcdRunning = false;
 	int		selectedPalette = 0;
 	byte	tileScanLine[ GB_SCREEN_WIDTH ];
-	byte	bgPriority[ GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT ];
+	// BG-to-OAM priority of the line being drawn, CGB only
+	byte	bgPriority[ GB_SCREEN_WIDTH ];
+	// The line being drawn as slots of linePalette, turned to pixels once the sprites are drawn too
+	byte	lineSlots[ GB_SCREEN_WIDTH ];
+	// Left out of lineSlots when the background is off, the pixel stays as it is
+	static constexpr byte noSlot = 0xff;
+	// Colors of the palette registers as of the last write to one of them, packed to the format of workBuffer
+	LinePalette	linePalette;
+	bool		linePaletteStale = true;
+	// OAM entries on each line, 10 at most, in the order they win over one another: OAM order on CGB, the smaller X first
+	// on DMG. Rebuilt before the next line drawn once OAM, the sprite size or the mode changed
+	byte	lineSprites[ GB_SCREEN_HEIGHT ][ 10 ];
+	byte	lineSpriteCounts[ GB_SCREEN_HEIGHT ];
+	// Every write to OAM has to set it
+	bool	spriteListsStale = true;
+	int		spriteListsHeight = 0;
+	bool	spriteListsCGB = false;
+	// Sized by Gameboy::ResetMemory, not part of the machine state: restoring VRAM marks it all stale
+	TileCache	tiles;
 
-	void AllocateBuffers( const Window & window );
+	// The picture buffers, of format. The run-ahead pair follows
+	void AllocateBuffers( PixelFormat format = PIXEL_FORMAT_XRGB8888 );
 
 	void DestroyBuffers() {
 		frontBuffer.Destroy();
 		backBuffer.Destroy();
 		backgroundTexture.Destroy();
 		tilesetTexture.Destroy();
+		runAheadBuffers[ 0 ].Destroy();
+		runAheadBuffers[ 1 ].Destroy();
 	}
 
 	void Reset() {
-		frontBuffer.texture.Clear();
-		backBuffer.texture.Clear();
+		frontBuffer.Clear();
+		backBuffer.Clear();
 		backgroundTexture.Clear();
 		tilesetTexture.Clear();
 		scanlineCounter = 456;
+		scanlineBaseTime = 0;
+		lcdRunning = false;
+		linePaletteStale = true;
+		spriteListsStale = true;
 	}
 
 	void SwapBuffers();
-	void Update( int cycles, Gameboy * gb );
+	// Points the buffers at the run-ahead pair, starting from copies of the real ones
+	void BeginRunAhead();
+	// Back to the buffers of the real machine. Returns the last picture completed ahead
+	const SimpleTexture & EndRunAhead();
+	// Recomputes STAT from the line and the clocks left on it at instructionStart, schedules the next mode change
+	void UpdateStatus( Gameboy * gb, uint64 instructionStart );
+	// Moves LY to the next line once the clocks of the current one elapsed
+	void AdvanceLine( Gameboy * gb );
+	int	 ScanlineCounterAt( uint64 time ) const { return lcdRunning ? scanlineCounter - ( int )( time - scanlineBaseTime ) : scanlineCounter; }
+	void SyncScanlineCounter( uint64 time ) {
+		scanlineCounter = ScanlineCounterAt( time );
+		scanlineBaseTime = time;
+	}
 	bool IsLcdOn( Gameboy * gb );
 
 	void DrawScanLine( int line, Gameboy * gb );
 	void DrawTiles( int line, byte scanline, Gameboy * gb );
 	void DrawSprites( int line, byte scanline, Gameboy * gb );
+	void BuildSpriteLists( int ySize, Gameboy * gb );
 
-	void PutPixel( byte x, byte y, byte tileAttr, byte colorIndex, byte palette, bool priority, Gameboy * gb, const CGBPalette & cgbPalette );
+	void PutPixel( byte x, byte slot, bool priority );
+	// Rebuilds linePalette from BGP, OBP0 and OBP1, or from the CGB palettes
+	void UpdateLinePalette( Gameboy * gb );
 
 	void			DebugDraw( Gameboy * gb );
 	void			DrawFullBackgroundToTexture( SimpleTexture & texture, int width, int height, Gameboy * gb );
 	void			DrawTilesetToTexture( SimpleTexture & texture, Gameboy * gb );
+	// Only allocated when the debug window draws them
 	SimpleTexture	backgroundTexture;
 	SimpleTexture	tilesetTexture;
 
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "render_kernels.h"
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define GBEMU_X64_KERNELS 1
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+// MSVC compiles any intrinsic without asking
+#define GBEMU_TARGET_SSSE3
+#else
+#define GBEMU_TARGET_SSSE3 __attribute__( ( target( "ssse3" ) ) )
+#endif
+#else
+#define GBEMU_X64_KERNELS 0
+#endif
+
+// Byte i of the result is 1 when the bit of bits picked by byte i of mask is set. Lane order is the one of memory on a
+// little endian host
+static uint64 SpreadBits( byte bits, uint64 mask ) {
+	uint64 lanes = ( bits * 0x0101010101010101ull ) & mask;
+	// A lane holds a single bit at most, adding 0x7f carries into its top bit only when it is not zero
+	return ( ( lanes + 0x7f7f7f7f7f7f7f7full ) >> 7 ) & 0x0101010101010101ull;
+}
+
+static void StoreLanes( byte * out, uint64 lanes ) {
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	lanes = __builtin_bswap64( lanes );
+#endif
+	memcpy( out, &lanes, sizeof( lanes ) );
+}
+
+static void DecodeTilePortable( const byte * data, byte * rows, byte * mirroredRows ) {
+	// Column 0 is bit 7 of the row, or bit 0 mirrored
+	constexpr uint64 leftToRight = 0x0102040810204080ull;
+	constexpr uint64 mirrored = 0x8040201008040201ull;
+	for ( int row = 0; row < 8; row++ ) {
+		byte low = data[ row * 2 ];
+		byte high = data[ row * 2 + 1 ];
+		StoreLanes( rows + row * 8, SpreadBits( low, leftToRight ) | SpreadBits( high, leftToRight ) << 1 );
+		StoreLanes( mirroredRows + row * 8, SpreadBits( low, mirrored ) | SpreadBits( high, mirrored ) << 1 );
+	}
+}
+
+static void ResolveLinePortable( const byte * slots, int count, const LinePalette & palette, byte * out ) {
+	if ( palette.format == PIXEL_FORMAT_RGB565 ) {
+		for ( int x = 0; x < count; x++ ) {
+			uint16 pixel = ( uint16 )palette.packed[ slots[ x ] ];
+			memcpy( out + x * 2, &pixel, sizeof( pixel ) );
+		}
+	} else {
+		for ( int x = 0; x < count; x++ ) {
+			memcpy( out + x * 4, &palette.packed[ slots[ x ] ], sizeof( uint32 ) );
+		}
+	}
+}
+
+#if GBEMU_X64_KERNELS
+// planes holds one byte of a bit plane per 8 lanes, 2 rows. Returns 1 in the lanes whose bit is set
+static __m128i SetBitsSSE2( __m128i planes, __m128i mask ) {
+	return _mm_and_si128( _mm_cmpeq_epi8( _mm_and_si128( planes, mask ), mask ), _mm_set1_epi8( 1 ) );
+}
+
+static void DecodeTileSSE2( const byte * data, byte * rows, byte * mirroredRows ) {
+	__m128i tile = _mm_loadu_si128( ( const __m128i * )data );
+	// The 8 low plane bytes, then the 8 high plane ones
+	__m128i lowPlane = _mm_and_si128( tile, _mm_set1_epi16( 0xff ) );
+	__m128i highPlane = _mm_srli_epi16( tile, 8 );
+	__m128i planes = _mm_packus_epi16( lowPlane, highPlane );
+	// Each byte 8 times: low plane rows 0 to 7 in lows, high plane in highs, 2 rows a register
+	__m128i doubled = _mm_unpacklo_epi8( planes, planes );
+	__m128i doubledHigh = _mm_unpackhi_epi8( planes, planes );
+	__m128i lows[ 4 ], highs[ 4 ];
+	for ( int half = 0; half < 2; half++ ) {
+		__m128i low4 = half == 0 ? _mm_unpacklo_epi16( doubled, doubled ) : _mm_unpackhi_epi16( doubled, doubled );
+		__m128i high4 = half == 0 ? _mm_unpacklo_epi16( doubledHigh, doubledHigh ) : _mm_unpackhi_epi16( doubledHigh, doubledHigh );
+		lows[ half * 2 ] = _mm_unpacklo_epi32( low4, low4 );
+		lows[ half * 2 + 1 ] = _mm_unpackhi_epi32( low4, low4 );
+		highs[ half * 2 ] = _mm_unpacklo_epi32( high4, high4 );
+		highs[ half * 2 + 1 ] = _mm_unpackhi_epi32( high4, high4 );
+	}
+	const __m128i leftToRight = _mm_setr_epi8( -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1 );
+	const __m128i mirrored = _mm_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128 );
+	for ( int i = 0; i < 4; i++ ) {
+		__m128i high = SetBitsSSE2( highs[ i ], leftToRight );
+		__m128i normal = _mm_or_si128( SetBitsSSE2( lows[ i ], leftToRight ), _mm_add_epi8( high, high ) );
+		high = SetBitsSSE2( highs[ i ], mirrored );
+		__m128i flipped = _mm_or_si128( SetBitsSSE2( lows[ i ], mirrored ), _mm_add_epi8( high, high ) );
+		_mm_storeu_si128( ( __m128i * )( rows + i * 16 ), normal );
+		_mm_storeu_si128( ( __m128i * )( mirroredRows + i * 16 ), flipped );
+	}
+}
+
+// 16 pixels a step. A shuffle looks up 16 entries, so each byte of the pixels takes 4, one per quarter of the palette: the
+// slots outside the quarter get their top bit set, which makes the shuffle return 0 for them. The 2 or 4 bytes are then
+// interleaved into the pixels with unpacks
+GBEMU_TARGET_SSSE3 static void ResolveLineSSSE3( const byte * slots, int count, const LinePalette & palette, byte * out ) {
+	const int planeCount = BytesPerPixel( palette.format );
+	__m128i	  tables[ 4 ][ 4 ];
+	for ( int plane = 0; plane < planeCount; plane++ ) {
+		for ( int quarter = 0; quarter < 4; quarter++ ) {
+			tables[ plane ][ quarter ] = _mm_loadu_si128( ( const __m128i * )( palette.planes[ plane ] + quarter * 16 ) );
+		}
+	}
+	int x = 0;
+	for ( ; x + 16 <= count; x += 16 ) {
+		__m128i slotValues = _mm_loadu_si128( ( const __m128i * )( slots + x ) );
+		__m128i planes[ 4 ] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+		for ( int quarter = 0; quarter < 4; quarter++ ) {
+			// 0x70 to 0x7f inside the quarter, 0x80 and up outside
+			__m128i inQuarter = _mm_adds_epu8( _mm_xor_si128( slotValues, _mm_set1_epi8( ( char )( quarter * 16 ) ) ), _mm_set1_epi8( 0x70 ) );
+			for ( int plane = 0; plane < planeCount; plane++ ) {
+				planes[ plane ] = _mm_or_si128( planes[ plane ], _mm_shuffle_epi8( tables[ plane ][ quarter ], inQuarter ) );
+			}
+		}
+		__m128i * pixels = ( __m128i * )( out + x * planeCount );
+		__m128i	  low01 = _mm_unpacklo_epi8( planes[ 0 ], planes[ 1 ] );
+		__m128i	  high01 = _mm_unpackhi_epi8( planes[ 0 ], planes[ 1 ] );
+		if ( planeCount == 2 ) {
+			_mm_storeu_si128( pixels, low01 );
+			_mm_storeu_si128( pixels + 1, high01 );
+		} else {
+			__m128i low23 = _mm_unpacklo_epi8( planes[ 2 ], planes[ 3 ] );
+			__m128i high23 = _mm_unpackhi_epi8( planes[ 2 ], planes[ 3 ] );
+			_mm_storeu_si128( pixels, _mm_unpacklo_epi16( low01, low23 ) );
+			_mm_storeu_si128( pixels + 1, _mm_unpackhi_epi16( low01, low23 ) );
+			_mm_storeu_si128( pixels + 2, _mm_unpacklo_epi16( high01, high23 ) );
+			_mm_storeu_si128( pixels + 3, _mm_unpackhi_epi16( high01, high23 ) );
+		}
+	}
+	ResolveLinePortable( slots + x, count - x, palette, out + x * planeCount );
+}
+
+static bool HostHasSSSE3() {
+#if defined( _MSC_VER )
+	int info[ 4 ];
+	__cpuid( info, 1 );
+	return ( info[ 2 ] >> 9 ) & 1;
+#else
+	return __builtin_cpu_supports( "ssse3" );
+#endif
+}
+#endif
+
+RenderKernels PortableRenderKernels() {
+	return { "portable", DecodeTilePortable, ResolveLinePortable };
+}
+
+RenderKernels HostRenderKernels() {
+#if GBEMU_X64_KERNELS
+	if ( HostHasSSSE3() ) {
+		return { "SSE2 + SSSE3", DecodeTileSSE2, ResolveLineSSSE3 };
+	}
+	return { "SSE2", DecodeTileSSE2, ResolveLinePortable };
+#else
+	return PortableRenderKernels();
+#endif
+}
+
+RenderKernels renderKernels = HostRenderKernels();
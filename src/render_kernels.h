@@ -0,0 +1,40 @@
+#pragma once
+
+#include "gb_emu.h"
+#include "simple_texture.h"
+
+// The 64 colors a line is drawn with, 4 per palette: the 8 background palettes, then the 8 sprite ones. DMG only has
+// BGP at 0, OBP0 at 32 and OBP1 at 36
+struct LinePalette {
+	// What the colors are packed to, the format of the texture drawn to
+	PixelFormat format = PIXEL_FORMAT_XRGB8888;
+	uint32		packed[ 64 ];
+	// The same colors a byte of the pixel at a time, in memory order, for the vector kernels
+	byte		planes[ 4 ][ 64 ];
+
+	void Set( int slot, const Pixel & color ) {
+		packed[ slot ] = PackPixel( format, color );
+		byte bytes[ 4 ] = {};
+		StorePixel( bytes, format, packed[ slot ] );
+		for ( int i = 0; i < 4; i++ ) {
+			planes[ i ][ slot ] = bytes[ i ];
+		}
+	}
+};
+
+// The inner loops of the renderer, picked once for the CPU running the emulator. Each one has a portable version; on
+// x86-64 the tile decode uses SSE2, which every x86-64 CPU has, and the line resolve SSSE3 when the CPU has it
+struct RenderKernels {
+	const char * name;
+	// The 16 bytes of a tile to its 8 rows of 8 color indices, left to right, and to the same rows mirrored
+	void ( *decodeTile )( const byte * data, byte * rows, byte * mirroredRows );
+	// count slots of palette, 0 to 63, to pixels of palette.format
+	void ( *resolveLine )( const byte * slots, int count, const LinePalette & palette, byte * out );
+};
+
+RenderKernels PortableRenderKernels();
+// The fastest kernels the host CPU runs
+RenderKernels HostRenderKernels();
+
+// What the renderer calls, HostRenderKernels unless a frontend picks others
+extern RenderKernels renderKernels;
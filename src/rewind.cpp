@@ -0,0 +1,153 @@
+#include <string.h>
+#include <chrono>
+#include "rewind.h"
+#include "gameboy.h"
+
+static byte * PutLength( byte * out, size_t value ) {
+	while ( value >= 0x80 ) {
+		*out++ = ( byte )( value | 0x80 );
+		value >>= 7;
+	}
+	*out++ = ( byte )value;
+	return out;
+}
+
+static const byte * GetLength( const byte * in, size_t & value ) {
+	value = 0;
+	for ( int shift = 0;; shift += 7 ) {
+		byte b = *in++;
+		value |= ( size_t )( b & 0x7f ) << shift;
+		if ( ( b & 0x80 ) == 0 ) {
+			return in;
+		}
+	}
+}
+
+static uint64 Load64( const byte * data ) {
+	uint64 value;
+	memcpy( &value, data, sizeof( value ) );
+	return value;
+}
+
+// Writes to out how to go from current back to previous
+static void EncodeDelta( const byte * current, const byte * previous, size_t size, std::vector< byte > & out ) {
+	// Each record but the first covers at least 9 bytes with at most 2 * 3 bytes of lengths
+	out.resize( size * 2 + 16 );
+	byte * write = out.data();
+	size_t i = 0;
+	while ( i < size ) {
+		size_t unchangedStart = i;
+		while ( i + 8 <= size && Load64( current + i ) == Load64( previous + i ) ) {
+			i += 8;
+		}
+		while ( i < size && current[ i ] == previous[ i ] ) {
+			i++;
+		}
+		// Changed bytes up to 8 unchanged ones in a row, shorter runs cost more to restart than to store
+		size_t changedStart = i;
+		size_t changedEnd = i;
+		while ( i < size && i - changedEnd < 8 ) {
+			if ( current[ i ] != previous[ i ] ) {
+				changedEnd = i + 1;
+			}
+			i++;
+		}
+		i = changedEnd;
+		write = PutLength( write, changedStart - unchangedStart );
+		write = PutLength( write, changedEnd - changedStart );
+		for ( size_t j = changedStart; j < changedEnd; j++ ) {
+			*write++ = current[ j ] ^ previous[ j ];
+		}
+	}
+	out.resize( write - out.data() );
+}
+
+static void ApplyDelta( byte * snapshot, size_t size, const byte * delta, size_t deltaSize ) {
+	const byte * end = delta + deltaSize;
+	size_t		 position = 0;
+	while ( delta < end ) {
+		size_t unchanged, changed;
+		delta = GetLength( delta, unchanged );
+		delta = GetLength( delta, changed );
+		position += unchanged;
+		for ( size_t i = 0; i < changed && position < size; i++ ) {
+			snapshot[ position++ ] ^= *delta++;
+		}
+	}
+}
+
+void RewindBuffer::Configure( size_t capacityBytes, int framesPerCapture ) {
+	delete[] ring;
+	capacity = capacityBytes;
+	ring = new byte[ capacity ];
+	this->framesPerCapture = framesPerCapture;
+	Clear();
+}
+
+void RewindBuffer::Clear() {
+	deltas.clear();
+	latest.clear();
+	framesSinceCapture = 0;
+}
+
+void RewindBuffer::Capture( Gameboy & gb ) {
+	auto start = std::chrono::high_resolution_clock::now();
+	framesSinceCapture = 0;
+	gb.TakeSnapshot( current );
+	if ( latest.size() != current.size() || gb.cart->romHash != romHash ) {
+		// First capture, or another cartridge or mode: the deltas cannot lead anywhere anymore
+		deltas.clear();
+	} else if ( ring != nullptr ) {
+		EncodeDelta( current.data(), latest.data(), current.size(), encoded );
+		size_t size = encoded.size();
+		size_t offset = deltas.empty() ? 0 : deltas.back().offset + deltas.back().size;
+		if ( offset + size > capacity ) {
+			// Too short before the end of the ring, the deltas left there are the oldest
+			while ( !deltas.empty() && deltas.front().offset >= offset ) {
+				deltas.pop_front();
+			}
+			offset = 0;
+		}
+		while ( !deltas.empty() && deltas.front().offset < offset + size && deltas.front().offset + deltas.front().size > offset ) {
+			deltas.pop_front();
+		}
+		if ( size <= capacity ) {
+			memcpy( ring + offset, encoded.data(), size );
+			deltas.push_back( { offset, size } );
+		} else {
+			deltas.clear();
+		}
+	}
+	latest.swap( current );
+	romHash = gb.cart->romHash;
+	captureSeconds += std::chrono::duration< double >( std::chrono::high_resolution_clock::now() - start ).count();
+	captureCount++;
+}
+
+bool RewindBuffer::StepBack( Gameboy & gb ) {
+	if ( latest.empty() ) {
+		return false;
+	}
+	byte inputMask = gb.mem.inputMask;
+	if ( !gb.RestoreSnapshot( latest ) ) {
+		Clear();
+		return false;
+	}
+	gb.mem.inputMask = inputMask;
+	framesSinceCapture = 0;
+	// The next step goes one snapshot further back, the oldest one stays where it is
+	if ( !deltas.empty() ) {
+		const Delta & delta = deltas.back();
+		ApplyDelta( latest.data(), latest.size(), ring + delta.offset, delta.size );
+		deltas.pop_back();
+	}
+	return true;
+}
+
+size_t RewindBuffer::BytesUsed() const {
+	size_t used = latest.capacity() + current.capacity() + encoded.capacity();
+	for ( const Delta & delta : deltas ) {
+		used += delta.size;
+	}
+	return used;
+}
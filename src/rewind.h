@@ -0,0 +1,58 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "gb_emu.h"
+
+struct Gameboy;
+
+// 30 snapshots a second
+constexpr int rewindFramesPerCapture = 2;
+
+// Snapshots of the last minutes of play, to step back through. Only the newest snapshot is kept whole, each capture stores
+// how to go back from it to the one before: the XOR of the two, with the runs of unchanged bytes counted instead of
+// stored. Those deltas go to a ring of fixed size that drops the oldest when it is full, so the memory used does not grow
+// with the length of the session.
+// Delta format, repeated: unchanged byte count, changed byte count (both LEB128), then the changed bytes XOR the previous
+// snapshot.
+struct RewindBuffer {
+	// A capture every framesPerCapture frames
+	int	   framesPerCapture = rewindFramesPerCapture;
+	size_t capacity = 0;
+	byte * ring = nullptr;
+
+	struct Delta {
+		size_t offset;
+		size_t size;
+	};
+	// Oldest first
+	std::deque< Delta > deltas;
+	// Newest snapshot, or the one a step back restores next
+	std::vector< byte > latest;
+	std::vector< byte > current;
+	std::vector< byte > encoded;
+	int					framesSinceCapture = 0;
+	uint32				romHash = 0;
+	// Time spent in Capture, for the benchmark
+	double				captureSeconds = 0.0;
+	int					captureCount = 0;
+
+	~RewindBuffer() { delete[] ring; }
+
+	// Sets the ring size, and drops what was captured
+	void Configure( size_t capacityBytes, int framesPerCapture );
+	void Clear();
+	// Called after every frame, captures a snapshot when one is due
+	void FrameDone( Gameboy & gb ) {
+		if ( ++framesSinceCapture >= framesPerCapture ) {
+			Capture( gb );
+		}
+	}
+	void Capture( Gameboy & gb );
+	// Restores the newest snapshot not restored yet. The keys keep the state the player holds them in now. False when
+	// nothing was captured, or when the machine does not fit the snapshots anymore
+	bool StepBack( Gameboy & gb );
+	size_t BytesUsed() const;
+	// Snapshots a step back can reach
+	int	   Count() const { return latest.empty() ? 0 : ( int )deltas.size() + 1; }
+};
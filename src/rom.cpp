@@ -3,38 +3,56 @@
 #include <string.h>
 #include "rom.h"
 #include "cpu.h"
-#include <imgui/imgui.h>
 
 bool Cartridge::forceDMGMode = false;
 
+static const byte * FillOpenBusBank() {
+	static byte bank[ 0x2000 ];
+	memset( bank, 0xff, sizeof( bank ) );
+	return bank;
+}
+
+const byte * Cartridge::openBusBank = FillOpenBusBank();
+
+// Header byte 0x149
+static int RAMSizeFromHeader( byte code ) {
+	switch ( code ) {
+		case 0x01:
+			return 0x800;
+		case 0x02:
+			return 0x2000;
+		case 0x03:
+			return 0x8000;
+		case 0x04:
+			return 0x20000;
+		case 0x05:
+			return 0x10000;
+		default:
+			return 0;
+	}
+}
+
 Cartridge * Cartridge::LoadFromFile( const char * path ) {
-	FILE * fh = fopen( path, "r" );
-	if ( fh == nullptr ) {
+	ROMImage * image = ROMImage::Acquire( path );
+	if ( image == nullptr ) {
 		printf( "Could not find ROM file %s\n", path );
 		DEBUG_BREAK;
 		return nullptr;
 	}
-	fseek( fh, 0L, SEEK_END );
-	long size = ftell( fh );
-	rewind( fh );
 
-	if ( size < 0x148 ) {
-		// We won't be able to check cart type, this is not a valid rom
-		fclose( fh );
+	if ( image->size < 0x150 ) {
+		// Shorter than the header read below, this is not a valid rom
+		ROMImage::Release( image );
 		return nullptr;
 	}
 
-	byte * cartData = new byte[ size ];
-	fread( cartData, size, 1, fh );
-	fclose( fh );
+	const byte * cartData = image->data;
 
 	ROMType cartType = (ROMType)cartData[ 0x147 ];
 
 	Cartridge * cart = nullptr;
 	if ( ROMIsBasicROM( cartType ) ) {
-		ROM * rom = new ROM();
-		rom->data = cartData;
-		cart = rom;
+		cart = new ROM();
 	} else if ( ROMIsMBC1( cartType ) ) {
 		MBC1 * rom = new MBC1();
 		cart = rom;
@@ -48,13 +66,17 @@ Cartridge * Cartridge::LoadFromFile( const char * path ) {
 		cart = rom;
 		rom->ramEnabled = ROMHasRAM( cartType );
 	} else {
+		ROMImage::Release( image );
 		DEBUG_BREAK;
 	}
 
 	if ( cart != nullptr ) {
+		cart->image = image;
 		cart->data = cartData;
-		cart->rawMemorySize = size;
+		cart->rawMemorySize = image->size;
 		cart->type = cartType;
+		cart->romHash = image->hash;
+		cart->ramSize = RAMSizeFromHeader( cartData[ 0x149 ] );
 		if ( cartData[0x143] == 0x80 ) {
 			cart->mode = CGB_DMG;
 		} else if ( cartData[0x143] == 0xc0 ) {
@@ -78,11 +100,6 @@ Cartridge * Cartridge::LoadFromFile( const char * path ) {
 	return cart;
 }
 
-void Cartridge::DebugDraw() {
-	ImGui::Checkbox("Force DMG", &forceDMGMode);
-	ImGui::Text("ROM size: %#llx", rawMemorySize);
-}
-
 void Cartridge::GenerateSourceCode() {
 	char buf[100] = {};
 	for ( int addr = 0; addr < rawMemorySize; addr++ ) {
@@ -114,21 +131,11 @@ void Cartridge::GenerateSourceCode() {
 
 byte MBC1::Read( uint16 addr ) {
 	if ( addr < 0x4000 ) {
-		return data[ addr ];
+		return ReadROM( addr );
 	} else if ( addr < 0x8000 ) {
-		return data[ addr - 0x4000 + romBank * 0x4000 ];
-	} else {
-		return ram[ ramBank * 0x2000 + addr - 0xa000 ];
-	}
-}
-
-int MBC1::DebugResolvePC( uint16 PC ) {
-	if ( PC < 0x4000 ) {
-		return PC;
-	} else if ( PC < 0x8000 ) {
-		return PC - 0x4000 + romBank * 0x4000;
+		return ReadROM( addr - 0x4000 + romBank * 0x4000 );
 	} else {
-		return 0;
+		return ramSize > 0 ? ram[ RAMOffset( ramBank, addr ) ] : 0xff;
 	}
 }
 
@@ -177,16 +184,16 @@ void MBC1::Write( uint16 addr, byte val ) {
 }
 
 void MBC1::WriteRAM( uint16 addr, byte val ) {
-	if ( ramEnabled ) {
-		ram[ ramBank * 0x2000 + addr - 0xa000 ] = val;
+	if ( ramEnabled && ramSize > 0 ) {
+		ram[ RAMOffset( ramBank, addr ) ] = val;
 	}
 }
 
 byte MBC3::Read( uint16 addr ) {
 	if ( addr < 0x4000 ) {
-		return data[ addr ];
+		return ReadROM( addr );
 	} else if ( addr < 0x8000 ) {
-		return data[ addr - 0x4000 + romBank * 0x4000 ];
+		return ReadROM( addr - 0x4000 + romBank * 0x4000 );
 	} else {
 		if ( ramBank >= 0x4 ) {
 			if ( latched ) {
@@ -194,17 +201,7 @@ byte MBC3::Read( uint16 addr ) {
 			}
 			return rtc[ ramBank ];
 		}
-		return ram[ ramBank * 0x2000 + addr - 0xa000 ];
-	}
-}
-
-int MBC3::DebugResolvePC( uint16 PC ) {
-	if ( PC < 0x4000 ) {
-		return PC;
-	} else if ( PC < 0x8000 ) {
-		return PC - 0x4000 + romBank * 0x4000;
-	} else {
-		return 0;
+		return ramSize > 0 ? ram[ RAMOffset( ramBank, addr ) ] : 0xff;
 	}
 }
 
@@ -244,29 +241,19 @@ void MBC3::WriteRAM( uint16 addr, byte val ) {
 	if ( ramEnabled ) {
 		if ( ramBank >= 0x4 ) {
 			rtc[ ramBank ] = val;
-		} else {
-			ram[ ramBank * 0x2000 + addr - 0xa000 ] = val;
+		} else if ( ramSize > 0 ) {
+			ram[ RAMOffset( ramBank, addr ) ] = val;
 		}
 	}
 }
 
 byte MBC5::Read( uint16 addr ) {
 	if ( addr < 0x4000 ) {
-		return data[ addr ];
+		return ReadROM( addr );
 	} else if ( addr < 0x8000 ) {
-		return data[ addr - 0x4000 + romBank * 0x4000 ];
+		return ReadROM( addr - 0x4000 + romBank * 0x4000 );
 	} else {
-		return ram[ ramBank * 0x2000 + addr - 0xa000 ];
-	}
-}
-
-int MBC5::DebugResolvePC( uint16 PC ) {
-	if ( PC < 0x4000 ) {
-		return PC;
-	} else if ( PC < 0x8000 ) {
-		return PC - 0x4000 + romBank * 0x4000;
-	} else {
-		return 0;
+		return ramSize > 0 ? ram[ RAMOffset( ramBank, addr ) ] : 0xff;
 	}
 }
 
@@ -298,17 +285,11 @@ void MBC5::Write( uint16 addr, byte val ) {
 }
 
 void MBC5::WriteRAM( uint16 addr, byte val ) {
-	if ( ramEnabled ) {
-		ram[ ramBank * 0x2000 + addr - 0xa000 ] = val;
+	if ( ramEnabled && ramSize > 0 ) {
+		ram[ RAMOffset( ramBank, addr ) ] = val;
 	}
 }
 
-void MBC5::DebugDraw() {
-	Cartridge::DebugDraw();
-	ImGui::Text( "Rom bank: %d", romBank );
-	ImGui::Text( "Ram bank: %d", ramBank );
-}
-
 bool ROMHasBattery( ROMType type ) {
 	switch ( type ) {
 		case CART_TYPE_MBC1_RAM_BATTERY:
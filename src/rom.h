@@ -1,6 +1,8 @@
 #pragma once
 
 #include "gb_emu.h"
+#include "rom_store.h"
+#include <string.h>
 #include <vector>
 #include <string>
 
@@ -52,67 +54,128 @@ bool ROMIsMBC2( ROMType type );
 bool ROMIsMBC3( ROMType type );
 bool ROMIsMBC5( ROMType type );
 
+// Mapper registers as save states keep them, those a mapper does not have stay 0
+struct CartridgeRegisters {
+	uint16	romBank = 0;
+	uint16	ramBank = 0;
+	bool	romBanking = false;
+	bool	ramEnabled = false;
+	bool	latched = false;
+	byte	rtc[ 0x10 ] = {};
+	byte	latchedRtc[ 0x10 ] = {};
+};
+
 class Cartridge {
 public:
 	virtual byte	Read( uint16 addr ) = 0;
 	virtual void	Write( uint16 addr, byte val ) = 0;
 	virtual void	WriteRAM( uint16 addr, byte val ) = 0;
 	virtual int		DebugResolvePC(uint16 PC) = 0;
-	byte *			GetRawMemory() { return data; }
+	// Size of the object, without ram or the image
+	virtual size_t	ObjectSize() const = 0;
+	// Host memory behind the region starting at regionStart: 0x0000 or 0x4000 for 16KB of ROM, 0xa000 for 8KB of RAM.
+	// nullptr when the region has to go through Read and WriteRAM
+	virtual const byte *	MapRead( uint16 regionStart ) { return nullptr; }
+	virtual byte *			MapWrite( uint16 regionStart ) { return nullptr; }
+	virtual void	GetRegisters( CartridgeRegisters & registers ) {}
+	virtual void	SetRegisters( const CartridgeRegisters & registers ) {}
+	const byte *	GetRawMemory() { return data; }
 	int				GetRawMemorySize() { return rawMemorySize; };
 
 	virtual ~Cartridge() {
-		delete [] data;
+		if ( image != nullptr ) {
+			ROMImage::Release( image );
+		}
 	}
 
 	static bool forceDMGMode;
-	virtual void DebugDraw();
+	void DebugDraw();
 
 	static Cartridge * LoadFromFile( const char * path );
 
 	ROMType type;
 	ColorMode mode;
-	byte * data = nullptr;
+	// Read-only, shared with the other cartridges loaded from the same image
+	ROMImage * image = nullptr;
+	const byte * data = nullptr;
 	char romName[ 0xF ];
 	char romPath[ 0x200 ];
 	int rawMemorySize = 0;
+	// External RAM, sized from the header. Lives in the state arena of the Gameboy running the cartridge, which sets it
+	byte * ram = nullptr;
+	int ramSize = 0;
+	// FNV hash of the whole image, identifies the ROM across instances
+	uint32 romHash = 0;
 
 	std::vector<std::string> sourceCodeLines;
 	std::vector<uint32> sourceCodeAddresses;
 
 	void GenerateSourceCode();
+
+protected:
+	// Offset of addr in ram with the given bank selected. Like on the cartridge, bank and address bits past the size of the
+	// RAM are not connected and mirror its start
+	int				RAMOffset( int bank, uint16 addr ) { return ( bank * 0x2000 + addr - 0xa000 ) & ( ramSize - 1 ); }
+	// Only mapped if it is a whole 8KB bank
+	byte *			MapRAMBank( int bank ) { return ramSize >= 0x2000 ? ram + RAMOffset( bank, 0xa000 ) : nullptr; }
+	// Reads without RAM, nothing drives the bus
+	const byte *	MapRAMBankRead( int bank ) { return ramSize == 0 ? openBusBank : MapRAMBank( bank ); }
+	// 8KB of 0xff
+	static const byte * openBusBank;
+	// bank is only mapped if it is entirely inside the image
+	const byte *	MapROMBank( int bank ) { return ( bank + 1 ) * 0x4000 <= rawMemorySize ? data + bank * 0x4000 : nullptr; }
+	// Nothing answers past the end of the image, which is mapped read-only and may end there
+	byte			ReadROM( int offset ) { return offset < rawMemorySize ? data[ offset ] : 0xff; }
 };
 
-class ROM : public Cartridge {
+class ROM final : public Cartridge {
 public:
-	virtual byte Read( uint16 addr ) override { return data[ addr ]; }
+	virtual byte Read( uint16 addr ) override { return ReadROM( addr ); }
 	virtual int DebugResolvePC(uint16 PC) override { return PC; }
+	virtual size_t ObjectSize() const override { return sizeof( *this ); }
 	virtual void Write( uint16 addr, byte val ) override {}
 	virtual void WriteRAM( uint16 addr, byte val ) override {}
-
-	virtual byte *	GetRawMemory() { return data; }
+	virtual const byte * MapRead( uint16 regionStart ) override { return regionStart < 0x8000 ? MapROMBank( regionStart / 0x4000 ) : nullptr; }
 };
 
-class MBC1 : public Cartridge {
+class MBC1 final : public Cartridge {
 public:
 	uint16	romBank = 1;
 	bool	romBanking = false;
 
-	byte	ram[ 0x8000 ];
 	uint16	ramBank = 1;
 	bool	ramEnabled = true;
 
 	virtual byte Read( uint16 addr ) override;
 	virtual void Write( uint16 addr, byte val ) override;
 	virtual void WriteRAM( uint16 addr, byte val ) override;
-	virtual int DebugResolvePC(uint16 PC) override;
+	virtual int DebugResolvePC( uint16 PC ) override { return PC < 0x4000 ? PC : PC < 0x8000 ? PC - 0x4000 + romBank * 0x4000 : 0; }
+	virtual size_t ObjectSize() const override { return sizeof( *this ); }
+	virtual const byte * MapRead( uint16 regionStart ) override {
+		if ( regionStart < 0x8000 ) {
+			return MapROMBank( regionStart < 0x4000 ? 0 : romBank );
+		}
+		return MapRAMBankRead( ramBank );
+	}
+	virtual byte * MapWrite( uint16 regionStart ) override { return ramEnabled ? MapRAMBank( ramBank ) : nullptr; }
+	virtual void GetRegisters( CartridgeRegisters & registers ) override {
+		registers.romBank = romBank;
+		registers.romBanking = romBanking;
+		registers.ramBank = ramBank;
+		registers.ramEnabled = ramEnabled;
+	}
+	virtual void SetRegisters( const CartridgeRegisters & registers ) override {
+		romBank = registers.romBank;
+		romBanking = registers.romBanking;
+		ramBank = registers.ramBank;
+		ramEnabled = registers.ramEnabled;
+	}
 };
 
-class MBC3 : public Cartridge {
+class MBC3 final : public Cartridge {
 public:
 	uint16	romBank = 1;
 
-	byte	ram[ 0x8000 ];
 	uint16	ramBank = 0;
 	bool	ramEnabled = true;
 
@@ -123,22 +186,64 @@ public:
 	virtual byte Read( uint16 addr ) override;
 	virtual void Write( uint16 addr, byte val ) override;
 	virtual void WriteRAM( uint16 addr, byte val ) override;
-	virtual int DebugResolvePC(uint16 PC) override;
+	virtual int DebugResolvePC( uint16 PC ) override { return PC < 0x4000 ? PC : PC < 0x8000 ? PC - 0x4000 + romBank * 0x4000 : 0; }
+	virtual size_t ObjectSize() const override { return sizeof( *this ); }
+	virtual const byte * MapRead( uint16 regionStart ) override {
+		if ( regionStart < 0x8000 ) {
+			return MapROMBank( regionStart < 0x4000 ? 0 : romBank );
+		}
+		// The clock registers stay behind Read
+		return ramBank < 0x4 ? MapRAMBankRead( ramBank ) : nullptr;
+	}
+	virtual byte * MapWrite( uint16 regionStart ) override { return ramEnabled && ramBank < 0x4 ? MapRAMBank( ramBank ) : nullptr; }
+	virtual void GetRegisters( CartridgeRegisters & registers ) override {
+		registers.romBank = romBank;
+		registers.ramBank = ramBank;
+		registers.ramEnabled = ramEnabled;
+		registers.latched = latched;
+		memcpy( registers.rtc, rtc, sizeof( rtc ) );
+		memcpy( registers.latchedRtc, latchedRtc, sizeof( latchedRtc ) );
+	}
+	virtual void SetRegisters( const CartridgeRegisters & registers ) override {
+		romBank = registers.romBank;
+		ramBank = registers.ramBank;
+		ramEnabled = registers.ramEnabled;
+		latched = registers.latched;
+		memcpy( rtc, registers.rtc, sizeof( rtc ) );
+		memcpy( latchedRtc, registers.latchedRtc, sizeof( latchedRtc ) );
+	}
 };
 
-class MBC5 : public Cartridge {
+class MBC5 final : public Cartridge {
 public:
 	uint16	romBank = 1;
 	bool	romBanking = true;
 
-	byte	ram[ 0x20000 ];
 	uint16	ramBank = 0;
 	bool	ramEnabled = true;
 
 	virtual byte Read( uint16 addr ) override;
 	virtual void Write( uint16 addr, byte val ) override;
 	virtual void WriteRAM( uint16 addr, byte val ) override;
-	virtual int DebugResolvePC(uint16 PC) override;
-
-	virtual void DebugDraw() override;
+	virtual int DebugResolvePC( uint16 PC ) override { return PC < 0x4000 ? PC : PC < 0x8000 ? PC - 0x4000 + romBank * 0x4000 : 0; }
+	virtual size_t ObjectSize() const override { return sizeof( *this ); }
+	virtual const byte * MapRead( uint16 regionStart ) override {
+		if ( regionStart < 0x8000 ) {
+			return MapROMBank( regionStart < 0x4000 ? 0 : romBank );
+		}
+		return MapRAMBankRead( ramBank );
+	}
+	virtual byte * MapWrite( uint16 regionStart ) override { return ramEnabled ? MapRAMBank( ramBank ) : nullptr; }
+	virtual void GetRegisters( CartridgeRegisters & registers ) override {
+		registers.romBank = romBank;
+		registers.romBanking = romBanking;
+		registers.ramBank = ramBank;
+		registers.ramEnabled = ramEnabled;
+	}
+	virtual void SetRegisters( const CartridgeRegisters & registers ) override {
+		romBank = registers.romBank;
+		romBanking = registers.romBanking;
+		ramBank = registers.ramBank;
+		ramEnabled = registers.ramEnabled;
+	}
 };
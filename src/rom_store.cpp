@@ -0,0 +1,227 @@
+#include <limits.h>
+#include <string.h>
+#include <mutex>
+#include "rom_store.h"
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Never destroyed, cartridges can be released by the destructors of other globals
+static std::mutex &				  s_romImagesMutex = *new std::mutex();
+static std::vector< ROMImage * > & s_romImages = *new std::vector< ROMImage * >();
+
+#if defined( _WIN32 )
+
+static void IdentityFromHandle( HANDLE file, ROMImage::FileIdentity & identity, bool & found ) {
+	BY_HANDLE_FILE_INFORMATION info;
+	found = GetFileInformationByHandle( file, &info ) != 0;
+	if ( found ) {
+		identity.device = info.dwVolumeSerialNumber;
+		identity.index = ( ( uint64 )info.nFileIndexHigh << 32 ) | info.nFileIndexLow;
+		// 100 ns ticks
+		identity.modifiedTime = ( ( int64 )info.ftLastWriteTime.dwHighDateTime << 32 ) | info.ftLastWriteTime.dwLowDateTime;
+		identity.size = ( ( int64 )info.nFileSizeHigh << 32 ) | info.nFileSizeLow;
+	}
+}
+
+static bool GetFileIdentity( const char * path, ROMImage::FileIdentity & identity ) {
+	HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+	bool found;
+	IdentityFromHandle( file, identity, found );
+	CloseHandle( file );
+	return found;
+}
+
+static const byte * LoadFile( const char * path, ROMImage::FileIdentity & identity ) {
+	HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return nullptr;
+	}
+	bool found;
+	IdentityFromHandle( file, identity, found );
+	byte * data = nullptr;
+	if ( found && identity.size > 0 && identity.size <= INT_MAX ) {
+		data = ( byte * )VirtualAlloc( nullptr, ( SIZE_T )identity.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+	}
+	int64 done = 0;
+	while ( data != nullptr && done < identity.size ) {
+		DWORD read = 0;
+		if ( !ReadFile( file, data + done, ( DWORD )( identity.size - done ), &read, nullptr ) || read == 0 ) {
+			break;
+		}
+		done += read;
+	}
+	ROMImage::FileIdentity after;
+	IdentityFromHandle( file, after, found );
+	CloseHandle( file );
+	DWORD oldProtection;
+	if ( data != nullptr && ( done != identity.size || !found || !( after == identity ) ||
+							  !VirtualProtect( data, ( SIZE_T )identity.size, PAGE_READONLY, &oldProtection ) ) ) {
+		VirtualFree( data, 0, MEM_RELEASE );
+		data = nullptr;
+	}
+	return data;
+}
+
+static void FreeImage( const byte * data, int size ) { VirtualFree( ( void * )data, 0, MEM_RELEASE ); }
+
+#else
+
+static void IdentityFromStat( const struct stat & info, ROMImage::FileIdentity & identity ) {
+	identity.device = info.st_dev;
+	identity.index = info.st_ino;
+	// In nanoseconds, a file rewritten within the same second is still told apart
+#if defined( __APPLE__ )
+	identity.modifiedTime = ( int64 )info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	identity.modifiedTime = ( int64 )info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	identity.size = info.st_size;
+}
+
+static bool GetFileIdentity( const char * path, ROMImage::FileIdentity & identity ) {
+	struct stat info;
+	if ( stat( path, &info ) != 0 ) {
+		return false;
+	}
+	IdentityFromStat( info, identity );
+	return true;
+}
+
+static const byte * LoadFile( const char * path, ROMImage::FileIdentity & identity ) {
+	int fd = open( path, O_RDONLY );
+	if ( fd < 0 ) {
+		return nullptr;
+	}
+	struct stat info;
+	void *		data = MAP_FAILED;
+	if ( fstat( fd, &info ) == 0 ) {
+		IdentityFromStat( info, identity );
+		if ( identity.size > 0 && identity.size <= INT_MAX ) {
+			data = mmap( nullptr, ( size_t )identity.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		}
+	}
+	int64 done = 0;
+	while ( data != MAP_FAILED && done < identity.size ) {
+		ssize_t count = read( fd, ( byte * )data + done, ( size_t )( identity.size - done ) );
+		if ( count <= 0 ) {
+			break;
+		}
+		done += count;
+	}
+	// A file written while it was read is torn, it is not loaded
+	ROMImage::FileIdentity after;
+	bool				   unchanged = fstat( fd, &info ) == 0;
+	if ( unchanged ) {
+		IdentityFromStat( info, after );
+		unchanged = after == identity;
+	}
+	close( fd );
+	if ( data != MAP_FAILED && ( done != identity.size || !unchanged || mprotect( data, ( size_t )identity.size, PROT_READ ) != 0 ) ) {
+		munmap( data, ( size_t )identity.size );
+		data = MAP_FAILED;
+	}
+	return data == MAP_FAILED ? nullptr : ( const byte * )data;
+}
+
+static void FreeImage( const byte * data, int size ) { munmap( ( void * )data, size ); }
+
+#endif
+
+// Caller holds s_romImagesMutex
+static ROMImage * FindImage( const ROMImage::FileIdentity & identity ) {
+	for ( ROMImage * image : s_romImages ) {
+		for ( const ROMImage::FileIdentity & file : image->files ) {
+			if ( file == identity ) {
+				return image;
+			}
+		}
+	}
+	return nullptr;
+}
+
+ROMImage * ROMImage::Acquire( const char * path ) {
+	FileIdentity identity;
+	if ( !GetFileIdentity( path, identity ) || identity.size <= 0 || identity.size > INT_MAX ) {
+		return nullptr;
+	}
+	{
+		std::lock_guard< std::mutex > lock( s_romImagesMutex );
+		ROMImage *					  image = FindImage( identity );
+		if ( image != nullptr ) {
+			image->refCount++;
+			return image;
+		}
+	}
+
+	// Reading and hashing run unlocked, other instances can load their own ROM meanwhile. The identity is the one of the
+	// file as it was read
+	const byte * data = LoadFile( path, identity );
+	if ( data == nullptr ) {
+		printf( "Could not read ROM file %s\n", path );
+		return nullptr;
+	}
+	int	   size = ( int )identity.size;
+	uint32 hash = fnvDefaultOffsetBasis;
+	for ( int i = 0; i < size; i++ ) {
+		hash = ( hash ^ data[ i ] ) * fnvPrime;
+	}
+
+	std::lock_guard< std::mutex > lock( s_romImagesMutex );
+	ROMImage *					  image = FindImage( identity );
+	if ( image == nullptr ) {
+		for ( ROMImage * candidate : s_romImages ) {
+			// The hash only narrows it down, two ROMs can share it
+			if ( candidate->hash == hash && candidate->size == size && memcmp( candidate->data, data, size ) == 0 ) {
+				// Same content from another file
+				candidate->files.push_back( identity );
+				image = candidate;
+				break;
+			}
+		}
+	}
+	if ( image != nullptr ) {
+		FreeImage( data, size );
+		image->refCount++;
+		return image;
+	}
+
+	image = new ROMImage();
+	image->data = data;
+	image->size = size;
+	image->hash = hash;
+	image->refCount = 1;
+	image->files.push_back( identity );
+	s_romImages.push_back( image );
+	return image;
+}
+
+void ROMImage::Retain( ROMImage * image ) {
+	std::lock_guard< std::mutex > lock( s_romImagesMutex );
+	image->refCount++;
+}
+
+void ROMImage::Release( ROMImage * image ) {
+	std::lock_guard< std::mutex > lock( s_romImagesMutex );
+	image->refCount--;
+	if ( image->refCount > 0 ) {
+		return;
+	}
+	for ( size_t i = 0; i < s_romImages.size(); i++ ) {
+		if ( s_romImages[ i ] == image ) {
+			s_romImages.erase( s_romImages.begin() + i );
+			break;
+		}
+	}
+	FreeImage( image->data, image->size );
+	delete image;
+}
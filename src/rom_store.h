@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include "gb_emu.h"
+
+// A ROM file read once into pages of its own, then made read-only, shared by every cartridge running the same image.
+// Instances loading the same content, from the same file or from a copy of it, share one physical copy. The image is a
+// copy and not a view of the file, so rebuilding or truncating the ROM on disk does not change or fault the running one.
+struct ROMImage {
+	// Identifies a file on disk as it was when it was read, a file written since then is a different image. The
+	// modification time is in nanoseconds on POSIX, in 100 ns ticks on Windows
+	struct FileIdentity {
+		uint64 device = 0;
+		uint64 index = 0;
+		int64  modifiedTime = 0;
+		int64  size = 0;
+
+		bool operator==( const FileIdentity & other ) const {
+			return device == other.device && index == other.index && modifiedTime == other.modifiedTime && size == other.size;
+		}
+	};
+
+	const byte * data = nullptr;
+	int			 size = 0;
+	// FNV hash of the whole image
+	uint32		 hash = 0;
+	int			 refCount = 0;
+	// Files known to hold this image, so loading one of them again does not read it to hash it
+	std::vector< FileIdentity > files;
+
+	// Returns the image with the content of the file at path, reading it if no cartridge uses it yet. nullptr if the file
+	// cannot be read, or changes while it is
+	static ROMImage * Acquire( const char * path );
+	// One more reference to an image already acquired, for what keys on it and may outlive the cartridge
+	static void		  Retain( ROMImage * image );
+	static void		  Release( ROMImage * image );
+};
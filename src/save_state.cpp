@@ -0,0 +1,406 @@
+#include "save_state.h"
+#include "gameboy.h"
+
+void SaveStateWriter::Bytes( const void * data, size_t count ) {
+	if ( buffer != nullptr ) {
+		buffer->insert( buffer->end(), ( const byte * )data, ( const byte * )data + count );
+		return;
+	}
+	if ( count >= 0x400 ) {
+		Flush();
+		failed = failed || fwrite( data, 1, count, file ) != count;
+		return;
+	}
+	staging.insert( staging.end(), ( const byte * )data, ( const byte * )data + count );
+	if ( staging.size() >= 0x1000 ) {
+		Flush();
+	}
+}
+
+void SaveStateWriter::Flush() {
+	if ( file != nullptr && !staging.empty() ) {
+		failed = failed || fwrite( staging.data(), 1, staging.size(), file ) != staging.size();
+		staging.clear();
+	}
+}
+
+// One function per chunk, writing with a SaveStateWriter and reading with a SaveStateReader, so both sides always agree.
+// A change in one of them needs a new version of its chunk
+
+template < typename Archive >
+static void VisitCpu( Archive & ar, Cpu & cpu ) {
+	// Flags are materialized before saving
+	ar( cpu.AF );
+	ar( cpu.BC.value );
+	ar( cpu.DE.value );
+	ar( cpu.HL.value );
+	ar( cpu.SP.value );
+	ar( cpu.PC );
+	ar( cpu.lastInstructionOpCode );
+	ar( cpu.cpuTime );
+	ar( cpu.speed );
+	ar( cpu.interuptsEnabled );
+	ar( cpu.interuptsOn );
+	ar( cpu.isOnHalt );
+	ar( cpu.speedSwitchRequested );
+	ar( cpu.IsCGB );
+}
+
+template < typename Archive >
+static void VisitTimer( Archive & ar, Cpu & cpu ) {
+	ar( cpu.divider );
+	ar( cpu.clockCounter );
+	ar( cpu.timerBaseTime );
+}
+
+template < typename Archive >
+static void VisitScheduler( Archive & ar, Scheduler & scheduler ) {
+	ar( scheduler.now );
+	for ( int i = 0; i < EVENT_COUNT; i++ ) {
+		ar( scheduler.deadlines[ i ] );
+	}
+}
+
+template < typename Archive >
+static void VisitPalette( Archive & ar, CGBPalette & palette ) {
+	ar.Bytes( palette.palette, sizeof( palette.palette ) );
+	ar( palette.index );
+	ar( palette.autoIncrementOnWrite );
+}
+
+template < typename Archive >
+static void VisitMemory( Archive & ar, Memory & mem ) {
+	ar.Bytes( mem.highRAM, sizeof( mem.highRAM ) );
+	ar.Bytes( mem.OAM, sizeof( mem.OAM ) );
+	ar( mem.workRAMBankIndex );
+	ar( mem.VRAMBankIndex );
+	ar( mem.inputMask );
+	ar( mem.hdmaLength );
+	ar( mem.hdmaActive );
+	VisitPalette( ar, mem.bgPalette );
+	VisitPalette( ar, mem.spritePalette );
+}
+
+template < typename Archive >
+static void VisitPpu( Archive & ar, Ppu & ppu ) {
+	ar( ppu.scanlineCounter );
+	ar( ppu.scanlineBaseTime );
+	ar( ppu.lcdRunning );
+}
+
+template < typename Archive >
+static void VisitCartridge( Archive & ar, Cartridge & cart, CartridgeRegisters & registers ) {
+	byte type = cart.type;
+	ar( type );
+	ar( registers.romBank );
+	ar( registers.ramBank );
+	ar( registers.romBanking );
+	ar( registers.ramEnabled );
+	ar( registers.latched );
+	ar.Bytes( registers.rtc, sizeof( registers.rtc ) );
+	ar.Bytes( registers.latchedRtc, sizeof( registers.latchedRtc ) );
+	ar.Bytes( cart.ram, cart.ramSize );
+}
+
+enum SaveStateChunk {
+	CHUNK_CPU,
+	CHUNK_TIMER,
+	CHUNK_SCHEDULER,
+	CHUNK_MEMORY,
+	CHUNK_VRAM,
+	CHUNK_WORK_RAM,
+	CHUNK_PPU,
+	CHUNK_APU,
+	CHUNK_CARTRIDGE,
+	CHUNK_COUNT,
+};
+
+static const char s_chunkTags[ CHUNK_COUNT ][ 5 ] = { "CPU ", "TIMR", "SCHD", "MEM ", "VRAM", "WRAM", "PPU ", "APU ", "CART" };
+static const uint32 s_chunkVersions[ CHUNK_COUNT ] = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+// Calls the visit function of chunk with ar
+template < typename Archive >
+static void VisitChunk( Archive & ar, SaveStateChunk chunk, Gameboy & gb, CartridgeRegisters & registers ) {
+	switch ( chunk ) {
+		case CHUNK_CPU:
+			VisitCpu( ar, gb.cpu );
+			break;
+		case CHUNK_TIMER:
+			VisitTimer( ar, gb.cpu );
+			break;
+		case CHUNK_SCHEDULER:
+			VisitScheduler( ar, gb.scheduler );
+			break;
+		case CHUNK_MEMORY:
+			VisitMemory( ar, gb.mem );
+			break;
+		case CHUNK_VRAM:
+			ar.Bytes( gb.mem.VRAM, gb.mem.VRAMSize );
+			break;
+		case CHUNK_WORK_RAM:
+			ar.Bytes( gb.mem.workRAM, gb.mem.workRAMSize );
+			break;
+		case CHUNK_PPU:
+			VisitPpu( ar, gb.ppu );
+			break;
+		case CHUNK_APU:
+			gb.apu.visit_state( ar );
+			break;
+		case CHUNK_CARTRIDGE:
+			VisitCartridge( ar, *gb.cart, registers );
+			break;
+		default:
+			break;
+	}
+}
+
+static uint32 ReadUint32( const byte * data ) {
+	return ( uint32 )data[ 0 ] | ( uint32 )data[ 1 ] << 8 | ( uint32 )data[ 2 ] << 16 | ( uint32 )data[ 3 ] << 24;
+}
+
+bool Gameboy::SaveState( SaveStateWriter & out ) {
+	if ( cart == nullptr ) {
+		return false;
+	}
+	cpu.MaterializeFlags();
+	CartridgeRegisters registers;
+	cart->GetRegisters( registers );
+
+	uint32 formatVersion = saveStateFormatVersion;
+	uint32 romHash = cart->romHash;
+	out.Bytes( "GBSS", 4 );
+	out( formatVersion );
+	out( romHash );
+	for ( int i = 0; i < CHUNK_COUNT; i++ ) {
+		SaveStateSizer sizer;
+		VisitChunk( sizer, ( SaveStateChunk )i, *this, registers );
+		uint32 version = s_chunkVersions[ i ];
+		uint32 size = ( uint32 )sizer.size;
+		out.Bytes( s_chunkTags[ i ], 4 );
+		out( version );
+		out( size );
+		VisitChunk( out, ( SaveStateChunk )i, *this, registers );
+	}
+	uint32 endVersion = 1;
+	uint32 endSize = 0;
+	out.Bytes( "END ", 4 );
+	out( endVersion );
+	out( endSize );
+	out.Flush();
+	return !out.failed;
+}
+
+bool Gameboy::LoadState( const byte * data, size_t size ) {
+	if ( cart == nullptr ) {
+		return false;
+	}
+	if ( size < 12 || memcmp( data, "GBSS", 4 ) != 0 ) {
+		printf( "Not a save state\n" );
+		return false;
+	}
+	if ( ReadUint32( data + 4 ) != saveStateFormatVersion ) {
+		printf( "Save state format version %u is not supported\n", ReadUint32( data + 4 ) );
+		return false;
+	}
+	if ( ReadUint32( data + 8 ) != cart->romHash ) {
+		printf( "Save state was made with another ROM\n" );
+		return false;
+	}
+
+	// Everything is checked before anything is restored, a state that does not fit leaves the machine as it was. Known
+	// chunks have to be the exact size their visit function takes with the memory sizes of this cartridge
+	CartridgeRegisters registers;
+	const byte *	   payloads[ CHUNK_COUNT ] = {};
+	size_t			   offset = 12;
+	bool			   ended = false;
+	while ( !ended ) {
+		if ( size - offset < 12 ) {
+			printf( "Save state is truncated\n" );
+			return false;
+		}
+		const byte * header = data + offset;
+		uint32		 version = ReadUint32( header + 4 );
+		uint32		 chunkSize = ReadUint32( header + 8 );
+		offset += 12;
+		if ( size - offset < chunkSize ) {
+			printf( "Save state is truncated\n" );
+			return false;
+		}
+		ended = memcmp( header, "END ", 4 ) == 0;
+		for ( int i = 0; i < CHUNK_COUNT; i++ ) {
+			if ( memcmp( header, s_chunkTags[ i ], 4 ) != 0 ) {
+				continue;
+			}
+			SaveStateSizer sizer;
+			VisitChunk( sizer, ( SaveStateChunk )i, *this, registers );
+			if ( version != s_chunkVersions[ i ] || chunkSize != sizer.size ) {
+				printf( "Save state chunk %s version %u of %u bytes cannot be loaded for this cartridge\n", s_chunkTags[ i ], version,
+						chunkSize );
+				return false;
+			}
+			payloads[ i ] = data + offset;
+		}
+		offset += chunkSize;
+	}
+	for ( int i = 0; i < CHUNK_COUNT; i++ ) {
+		if ( payloads[ i ] == nullptr ) {
+			printf( "Save state has no %s chunk\n", s_chunkTags[ i ] );
+			return false;
+		}
+	}
+	if ( payloads[ CHUNK_CARTRIDGE ][ 0 ] != cart->type ) {
+		printf( "Save state was made with another mapper\n" );
+		return false;
+	}
+
+	for ( int i = 0; i < CHUNK_COUNT; i++ ) {
+		SaveStateSizer sizer;
+		VisitChunk( sizer, ( SaveStateChunk )i, *this, registers );
+		SaveStateReader reader( payloads[ i ], sizer.size );
+		VisitChunk( reader, ( SaveStateChunk )i, *this, registers );
+	}
+	cart->SetRegisters( registers );
+	cpu.flagsOperation = FLAGS_NONE;
+	cpu.decodedOperands = nullptr;
+	// Recomputes the earliest deadline
+	scheduler.Schedule( EVENT_PPU_STATUS, scheduler.deadlines[ EVENT_PPU_STATUS ] );
+	blockCache.generation++;
+	blockCache.FlushRAM();
+	ppu.tiles.InvalidateAll();
+	ppu.linePaletteStale = true;
+	ppu.spriteListsStale = true;
+	UpdateMemoryMap();
+	return true;
+}
+
+bool Gameboy::SerializeSaveState( const char * path ) {
+	FILE * fh = fopen( path, "wb" );
+	if ( fh == nullptr ) {
+		printf( "Could not create save state file %s\n", path );
+		return false;
+	}
+	SaveStateWriter out( fh );
+	bool			saved = SaveState( out );
+	saved = fclose( fh ) == 0 && saved;
+	if ( !saved ) {
+		printf( "Could not write save state file %s\n", path );
+	}
+	return saved;
+}
+
+bool Gameboy::LoadSaveState( const char * path ) {
+	FILE * fh = fopen( path, "rb" );
+	if ( fh == nullptr ) {
+		printf( "Could not find save state file %s\n", path );
+		return false;
+	}
+	std::vector< byte > data;
+	if ( fseek( fh, 0, SEEK_END ) == 0 ) {
+		long size = ftell( fh );
+		if ( size > 0 && fseek( fh, 0, SEEK_SET ) == 0 ) {
+			data.resize( size );
+			data.resize( fread( data.data(), 1, size, fh ) );
+		}
+	}
+	fclose( fh );
+	return LoadState( data.data(), data.size() );
+}
+
+// Snapshots stay in memory on the host that took them, so unlike save states they hold the subsystems as the host lays
+// them out: MachineRegisters, the APU values packed one after the other, then a copy of the state arena
+struct MachineRegisters {
+	uint32			   romHash;
+	int				   stateArenaSize;
+	Cpu				   cpu;
+	Memory			   mem;
+	Scheduler		   scheduler;
+	int				   scanlineCounter;
+	uint64			   scanlineBaseTime;
+	bool			   lcdRunning;
+	CartridgeRegisters cart;
+};
+static_assert( std::is_trivially_copyable< MachineRegisters >::value, "snapshots copy the registers with memcpy" );
+
+struct SnapshotPacker {
+	byte * data;
+
+	template < typename T >
+	void operator()( T & value ) {
+		memcpy( data, &value, sizeof( T ) );
+		data += sizeof( T );
+	}
+};
+
+struct SnapshotUnpacker {
+	const byte * data;
+
+	template < typename T >
+	void operator()( T & value ) {
+		memcpy( &value, data, sizeof( T ) );
+		data += sizeof( T );
+	}
+};
+
+void Gameboy::TakeSnapshot( std::vector< byte > & snapshot ) {
+	SaveStateSizer apuSizer;
+	apu.visit_state( apuSizer );
+	snapshot.resize( sizeof( MachineRegisters ) + apuSizer.size + stateArenaSize );
+
+	MachineRegisters registers;
+	registers.romHash = cart != nullptr ? cart->romHash : 0;
+	registers.stateArenaSize = stateArenaSize;
+	registers.cpu = cpu;
+	registers.mem = mem;
+	registers.scheduler = scheduler;
+	registers.scanlineCounter = ppu.scanlineCounter;
+	registers.scanlineBaseTime = ppu.scanlineBaseTime;
+	registers.lcdRunning = ppu.lcdRunning;
+	if ( cart != nullptr ) {
+		cart->GetRegisters( registers.cart );
+	}
+	memcpy( snapshot.data(), &registers, sizeof( MachineRegisters ) );
+	SnapshotPacker apuPacker = { snapshot.data() + sizeof( MachineRegisters ) };
+	apu.visit_state( apuPacker );
+	memcpy( apuPacker.data, stateArena, stateArenaSize );
+}
+
+bool Gameboy::RestoreSnapshot( const std::vector< byte > & snapshot ) {
+	if ( cart == nullptr || snapshot.size() < sizeof( MachineRegisters ) ) {
+		return false;
+	}
+	MachineRegisters registers;
+	memcpy( &registers, snapshot.data(), sizeof( MachineRegisters ) );
+	SaveStateSizer apuSizer;
+	apu.visit_state( apuSizer );
+	if ( registers.romHash != cart->romHash || registers.stateArenaSize != stateArenaSize || registers.mem.VRAMSize != mem.VRAMSize ||
+		 snapshot.size() != sizeof( MachineRegisters ) + apuSizer.size + stateArenaSize ) {
+		return false;
+	}
+
+	// Host pointers and settings stay as they are
+	bool   useLazyFlags = cpu.useLazyFlags;
+	byte * VRAM = mem.VRAM;
+	byte * workRAM = mem.workRAM;
+	cpu = registers.cpu;
+	cpu.useLazyFlags = useLazyFlags;
+	cpu.decodedOperands = nullptr;
+	mem = registers.mem;
+	mem.VRAM = VRAM;
+	mem.workRAM = workRAM;
+	scheduler = registers.scheduler;
+	ppu.scanlineCounter = registers.scanlineCounter;
+	ppu.scanlineBaseTime = registers.scanlineBaseTime;
+	ppu.lcdRunning = registers.lcdRunning;
+	cart->SetRegisters( registers.cart );
+	SnapshotUnpacker apuUnpacker = { snapshot.data() + sizeof( MachineRegisters ) };
+	apu.visit_state( apuUnpacker );
+	memcpy( stateArena, apuUnpacker.data, stateArenaSize );
+
+	blockCache.generation++;
+	blockCache.FlushRAM();
+	ppu.tiles.InvalidateAll();
+	ppu.linePaletteStale = true;
+	ppu.spriteListsStale = true;
+	UpdateMemoryMap();
+	return true;
+}
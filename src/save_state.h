@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+#include "gb_emu.h"
+
+// Save state layout, every number is little endian whatever the host:
+//   header	"GBSS", format version (uint32), FNV hash of the ROM (uint32)
+//   chunks	tag (4 chars), chunk version (uint32), payload size (uint32), payload
+// and an "END " chunk closes the state. Each subsystem has its own chunk and version, so one of them can change without
+// the others. A loader skips the chunks it does not know and refuses a version it cannot read.
+// The payloads are written by the same functions that read them back, called with one of the archives below: each
+// value goes out as its own size in bytes, arrays as is.
+constexpr uint32 saveStateFormatVersion = 1;
+
+template < typename T >
+constexpr bool IsSaveStateValue() {
+	// long is 32 bits on Windows and 64 elsewhere
+	return std::is_integral< T >::value && !std::is_same< T, long >::value && !std::is_same< T, unsigned long >::value;
+}
+
+// Counts the bytes the values take, to write the payload size before the payload
+struct SaveStateSizer {
+	size_t size = 0;
+
+	template < typename T >
+	void operator()( T & value ) {
+		static_assert( IsSaveStateValue< T >(), "save states only hold fixed size integers" );
+		size += sizeof( T );
+	}
+	void Bytes( void * data, size_t count ) { size += count; }
+};
+
+// Writes the values as they come, to a file or at the end of a buffer. File writes are staged in small blocks, large
+// arrays go to the file directly
+struct SaveStateWriter {
+	FILE *				  file = nullptr;
+	std::vector< byte > * buffer = nullptr;
+	std::vector< byte >	  staging;
+	bool				  failed = false;
+
+	explicit SaveStateWriter( FILE * file ) : file( file ) {}
+	explicit SaveStateWriter( std::vector< byte > & buffer ) : buffer( &buffer ) {}
+	~SaveStateWriter() { Flush(); }
+
+	template < typename T >
+	void operator()( T & value ) {
+		static_assert( IsSaveStateValue< T >(), "save states only hold fixed size integers" );
+		byte   bytes[ sizeof( T ) ];
+		uint64 bits = ( uint64 )value;
+		for ( size_t i = 0; i < sizeof( T ); i++ ) {
+			bytes[ i ] = ( byte )( bits >> ( i * 8 ) );
+		}
+		Bytes( bytes, sizeof( T ) );
+	}
+	void Bytes( const void * data, size_t count );
+	void Flush();
+};
+
+// Reads the values back from a payload in memory. failed is set when it would go past the end
+struct SaveStateReader {
+	const byte * data = nullptr;
+	size_t		 size = 0;
+	size_t		 offset = 0;
+	bool		 failed = false;
+
+	SaveStateReader( const byte * data, size_t size ) : data( data ), size( size ) {}
+
+	template < typename T >
+	void operator()( T & value ) {
+		static_assert( IsSaveStateValue< T >(), "save states only hold fixed size integers" );
+		if ( failed || size - offset < sizeof( T ) ) {
+			failed = true;
+			return;
+		}
+		uint64 bits = 0;
+		for ( size_t i = 0; i < sizeof( T ); i++ ) {
+			bits |= ( uint64 )data[ offset + i ] << ( i * 8 );
+		}
+		value = ( T )bits;
+		offset += sizeof( T );
+	}
+	// Straight from the payload to where the bytes belong
+	void Bytes( void * destination, size_t count ) {
+		if ( failed || size - offset < count ) {
+			failed = true;
+			return;
+		}
+		memcpy( destination, data + offset, count );
+		offset += count;
+	}
+};
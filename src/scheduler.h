@@ -0,0 +1,46 @@
+#pragma once
+
+#include "gb_emu.h"
+
+enum ScheduledEvent {
+	// The PPU recomputes STAT: mode change, LYC compare, scanline drawing and HDMA. Compared with the start of
+	// the instruction, because the mode seen after an instruction is the one from before its clocks elapsed
+	EVENT_PPU_STATUS,
+	// LY moves to the next line, compared with the end of the instruction
+	EVENT_PPU_LINE,
+	// DIV or TIMA step, compared with the end of the instruction
+	EVENT_TIMER,
+	EVENT_COUNT,
+};
+
+// Deadlines of the subsystems that used to be ticked after every instruction. There are only a few event kinds and
+// each has at most one pending deadline, so they live in a fixed array with the earliest one cached: the CPU side only
+// compares the clock with nextDeadline after each instruction.
+// The APU already catches up on its own when its registers are accessed and at the end of a frame, and there is no link
+// cable to time serial transfers against, so neither needs an event here.
+struct Scheduler {
+	static constexpr uint64 never = ~0ull;
+
+	// Clocks given to FinishInstruction since the last reset, which does not include interrupt dispatch
+	uint64 now = 0;
+	uint64 nextDeadline = never;
+	uint64 deadlines[ EVENT_COUNT ] = { never, never, never };
+
+	void Reset() {
+		now = 0;
+		for ( int i = 0; i < EVENT_COUNT; i++ ) {
+			deadlines[ i ] = never;
+		}
+		nextDeadline = never;
+	}
+
+	void Schedule( ScheduledEvent event, uint64 time ) {
+		deadlines[ event ] = time;
+		nextDeadline = deadlines[ 0 ];
+		for ( int i = 1; i < EVENT_COUNT; i++ ) {
+			nextDeadline = MIN( nextDeadline, deadlines[ i ] );
+		}
+	}
+
+	void Cancel( ScheduledEvent event ) { Schedule( event, never ); }
+};
@@ -1,39 +1,121 @@
 #pragma once
-#include <GL/gl3w.h>
+#include <string.h>
+#include <new>
 #include "gb_emu.h"
 
+// How the pixels of a texture are stored
+enum PixelFormat {
+	// 32 bits, 0xffRRGGBB in the byte order of the host. GL_BGRA with GL_UNSIGNED_INT_8_8_8_8_REV
+	PIXEL_FORMAT_XRGB8888,
+	// R, G, B then 0xff in memory. GL_RGBA with GL_UNSIGNED_BYTE
+	PIXEL_FORMAT_RGBA8888,
+	// 16 bits, 5 of red, 6 of green and 5 of blue from the top, in the byte order of the host. GL_RGB with
+	// GL_UNSIGNED_SHORT_5_6_5
+	PIXEL_FORMAT_RGB565,
+	PIXEL_FORMAT_COUNT
+};
+
+inline int BytesPerPixel( PixelFormat format ) { return format == PIXEL_FORMAT_RGB565 ? 2 : 4; }
+
+// The value StorePixel writes for color
+inline uint32 PackPixel( PixelFormat format, const Pixel & color ) {
+	switch ( format ) {
+		case PIXEL_FORMAT_XRGB8888:
+			return 0xff000000u | color.R << 16 | color.G << 8 | color.B;
+		case PIXEL_FORMAT_RGBA8888: {
+			byte   bytes[ 4 ] = { color.R, color.G, color.B, 0xff };
+			uint32 value;
+			memcpy( &value, bytes, sizeof( value ) );
+			return value;
+		}
+		default:
+			return ( color.R >> 3 ) << 11 | ( color.G >> 2 ) << 5 | color.B >> 3;
+	}
+}
+
+inline void StorePixel( byte * destination, PixelFormat format, uint32 value ) {
+	if ( format == PIXEL_FORMAT_RGB565 ) {
+		uint16 value16 = ( uint16 )value;
+		memcpy( destination, &value16, sizeof( value16 ) );
+	} else {
+		memcpy( destination, &value, sizeof( value ) );
+	}
+}
+
+// CPU side image, the GL upload lives in gui/gl_texture.h so the core can run without a display. Rows start on 16 bytes
+// boundaries, pitch bytes apart, so they can be written and read 16 bytes at a time
 struct SimpleTexture {
-	Pixel * buffer = nullptr;
-	int		width = 0;
-	int		height = 0;
-	uint32	textureHandler = 0;
+	static constexpr size_t rowAlignment = 16;
 
-	void Allocate( int width, int height ) {
+	byte *		buffer = nullptr;
+	int			width = 0;
+	int			height = 0;
+	int			pitch = 0;
+	PixelFormat format = PIXEL_FORMAT_XRGB8888;
+
+	void Allocate( int width, int height, PixelFormat format = PIXEL_FORMAT_XRGB8888 ) {
 		this->width = width;
 		this->height = height;
-		buffer = new Pixel[ width * height ];
-		glGenTextures( 1, &textureHandler );
-		glBindTexture( GL_TEXTURE_2D, textureHandler );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		this->format = format;
+		pitch = ( int )( ( width * BytesPerPixel( format ) + rowAlignment - 1 ) & ~( rowAlignment - 1 ) );
+		buffer = static_cast< byte * >( ::operator new[]( ( size_t )pitch * height, std::align_val_t( rowAlignment ) ) );
 	}
 
-	void Destroy() { delete[] buffer; }
+	void Destroy() {
+		if ( buffer != nullptr ) {
+			::operator delete[]( buffer, std::align_val_t( rowAlignment ) );
+		}
+		buffer = nullptr;
+	}
 
-	void Bind() { glBindTexture( GL_TEXTURE_2D, textureHandler ); }
+	byte *		 Row( int y ) { return buffer + y * pitch; }
+	const byte * Row( int y ) const { return buffer + y * pitch; }
 
-	void Update() {
-		Bind();
-		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, buffer );
+	void SetPixel( const Pixel & pixel, int x, int y ) {
+		gbemu_debug_assert( x >= 0 && x < width );
+		gbemu_debug_assert( y >= 0 && y < height );
+		StorePixel( Row( y ) + x * BytesPerPixel( format ), format, PackPixel( format, pixel ) );
 	}
 
-	void SetPixel( const Pixel & pixel, int x, int y ) {
-		gbemu_assert( x < width );
-		gbemu_assert( y < height );
-		buffer[ x + y * width ] = pixel;
+	Pixel GetPixel( int x, int y ) const {
+		gbemu_debug_assert( x >= 0 && x < width );
+		gbemu_debug_assert( y >= 0 && y < height );
+		const byte * source = Row( y ) + x * BytesPerPixel( format );
+		switch ( format ) {
+			case PIXEL_FORMAT_XRGB8888: {
+				uint32 value;
+				memcpy( &value, source, sizeof( value ) );
+				return { ( byte )( value >> 16 ), ( byte )( value >> 8 ), ( byte )value };
+			}
+			case PIXEL_FORMAT_RGBA8888:
+				return { source[ 0 ], source[ 1 ], source[ 2 ] };
+			default: {
+				uint16 value;
+				memcpy( &value, source, sizeof( value ) );
+				byte R = value >> 11, G = ( value >> 5 ) & 0x3f, B = value & 0x1f;
+				return { ( byte )( R << 3 | R >> 2 ), ( byte )( G << 2 | G >> 4 ), ( byte )( B << 3 | B >> 2 ) };
+			}
+		}
 	}
 
-	void Clear() { memset( buffer, 0, width * height * sizeof( Pixel ) ); }
+	size_t AllocatedSize() const { return buffer != nullptr ? ( size_t )pitch * height : 0; }
+
+	// To black
+	void Clear() {
+		if ( buffer == nullptr ) {
+			return;
+		}
+		uint32 black = PackPixel( format, Pixel{ 0, 0, 0 } );
+		if ( black == 0 ) {
+			memset( buffer, 0, AllocatedSize() );
+			return;
+		}
+		// Only the 32 bit formats have bits set in black
+		for ( int y = 0; y < height; y++ ) {
+			uint32 * row = reinterpret_cast< uint32 * >( Row( y ) );
+			for ( int x = 0; x < width; x++ ) {
+				row[ x ] = black;
+			}
+		}
+	}
 };
@@ -54,6 +54,11 @@ public:
 	// to the center buffer.
 	bool end_frame( gb_time_t );
 	
+	// Pass every value of the emulated state to visit( value ), always in the same order,
+	// to save or restore it. Values are int, unsigned, bool, byte or 64-bit times.
+	template<class Visitor>
+	void visit_state( Visitor& visit );
+	
 private:
 	// noncopyable
 	Gb_Apu( const Gb_Apu& );
@@ -74,11 +79,82 @@ private:
 	Gb_Wave::Synth   other_synth;  // shared between wave and noise
 	
 	void run_until( gb_time_t );
+	template<class Visitor>
+	static void visit_env( Visitor&, Gb_Env& );
+	template<class Visitor>
+	static void visit_square( Visitor&, Gb_Square& );
 };
 
 inline void Gb_Apu::output( Blip_Buffer* b ) { output( b, NULL, NULL ); }
 	
 inline void Gb_Apu::osc_output( int i, Blip_Buffer* b ) { osc_output( i, b, NULL, NULL ); }
 
+template<class Visitor>
+void Gb_Apu::visit_env( Visitor& visit, Gb_Env& env )
+{
+	visit( env.env_period );
+	visit( env.env_dir );
+	visit( env.env_delay );
+	visit( env.new_volume );
+}
+
+template<class Visitor>
+void Gb_Apu::visit_square( Visitor& visit, Gb_Square& square )
+{
+	visit( square.phase );
+	visit( square.duty );
+	visit( square.sweep_period );
+	visit( square.sweep_delay );
+	visit( square.sweep_shift );
+	visit( square.sweep_dir );
+	visit( square.sweep_freq );
+}
+
+template<class Visitor>
+void Gb_Apu::visit_state( Visitor& visit )
+{
+	// gb_time_t is long, whose size depends on the platform
+	long long time = next_frame_time;
+	visit( time );
+	next_frame_time = (gb_time_t) time;
+	time = last_time;
+	visit( time );
+	last_time = (gb_time_t) time;
+	visit( frame_count );
+	visit( stereo_found );
+	for ( int i = 0; i < register_count; i++ )
+		visit( regs [i] );
+	
+	for ( int i = 0; i < osc_count; i++ )
+	{
+		Gb_Osc& osc = *oscs [i];
+		visit( osc.output_select );
+		visit( osc.delay );
+		visit( osc.last_amp );
+		visit( osc.period );
+		visit( osc.volume );
+		visit( osc.global_volume );
+		visit( osc.frequency );
+		visit( osc.length );
+		visit( osc.new_length );
+		visit( osc.enabled );
+		visit( osc.length_enabled );
+		// restored output_select
+		osc.output = osc.outputs [osc.output_select & 3];
+	}
+	visit_env( visit, square1 );
+	visit_env( visit, square2 );
+	visit_env( visit, noise );
+	visit_square( visit, square1 );
+	visit_square( visit, square2 );
+	visit( wave.volume_shift );
+	visit( wave.wave_pos );
+	visit( wave.new_enabled );
+	for ( int i = 0; i < Gb_Wave::wave_size; i++ )
+		visit( wave.wave [i] );
+	visit( noise.bits );
+	visit( noise.tap );
+}
+
 #endif
 
@@ -0,0 +1,35 @@
+#include "tile_cache.h"
+#include "render_kernels.h"
+
+void TileCache::Allocate( int VRAMSize ) {
+	int count = VRAMSize / 0x2000 * tilesPerBank;
+	if ( count != tileCount ) {
+		Destroy();
+		pixels = new byte[ count * 128 ];
+		dirty = new byte[ count ];
+		tileCount = count;
+	}
+	InvalidateAll();
+}
+
+void TileCache::Destroy() {
+	delete[] pixels;
+	delete[] dirty;
+	pixels = nullptr;
+	dirty = nullptr;
+	tileCount = 0;
+}
+
+void TileCache::DecodeRow( const byte * data, bool mirrored, byte * row ) {
+	for ( int column = 0; column < 8; column++ ) {
+		int colorBit = mirrored ? column : 7 - column;
+		row[ column ] = ( BIT_VALUE( data[ 1 ], colorBit ) << 1 ) | BIT_VALUE( data[ 0 ], colorBit );
+	}
+}
+
+void TileCache::Decode( const byte * VRAM, int tile ) {
+	const byte * data = VRAM + ( tile / tilesPerBank ) * 0x2000 + ( tile % tilesPerBank ) * 16;
+	byte *		 decoded = pixels + tile * 128;
+	renderKernels.decodeTile( data, decoded, decoded + 64 );
+	dirty[ tile ] = 0;
+}
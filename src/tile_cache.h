@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string.h>
+#include "gb_emu.h"
+
+// The 384 tiles of each VRAM bank decoded to one color index per pixel, as stored and mirrored horizontally, so the
+// renderers read a row of 8 indices instead of combining the 2 bit planes pixel by pixel. A tile is decoded again the
+// first time it is read after a write to its 16 bytes: every write to the tile data has to go through Invalidate, and a
+// VRAM replaced as a whole through InvalidateAll
+struct TileCache {
+	static constexpr int tilesPerBank = 384;
+	static constexpr int tileDataSize = tilesPerBank * 16;
+
+	// [tile][mirrored][row][column], bank 1 tiles after the bank 0 ones
+	byte * pixels = nullptr;
+	// One per tile, non zero when the tile has to be decoded again
+	byte * dirty = nullptr;
+	int	   tileCount = 0;
+	// Rows read outside of the tile data are decoded there
+	byte   outsideRow[ 8 ];
+
+	~TileCache() { Destroy(); }
+
+	// Sized for the banks of VRAMSize, everything stale
+	void Allocate( int VRAMSize );
+	void Destroy();
+	size_t AllocatedSize() const { return ( size_t )tileCount * ( 128 + 1 ); }
+
+	void InvalidateAll() {
+		if ( dirty != nullptr ) {
+			memset( dirty, 1, tileCount );
+		}
+	}
+	// offset in VRAM, bank 1 starting at 0x2000
+	void Invalidate( int offset ) {
+		int inBank = offset & 0x1fff;
+		if ( inBank < tileDataSize ) {
+			dirty[ ( offset >> 13 ) * tilesPerBank + inBank / 16 ] = 1;
+		}
+	}
+	void InvalidateRange( int offset, int length ) {
+		for ( int i = offset & ~0xf; i < offset + length; i += 16 ) {
+			Invalidate( i );
+		}
+	}
+
+	// The 8 color indices of the row whose 2 bytes start at offset in VRAM, left to right
+	const byte * Row( const byte * VRAM, int offset, bool mirrored ) {
+		int inBank = offset & 0x1fff;
+		if ( inBank >= tileDataSize ) {
+			DecodeRow( VRAM + offset, mirrored, outsideRow );
+			return outsideRow;
+		}
+		int tile = ( offset >> 13 ) * tilesPerBank + inBank / 16;
+		if ( dirty[ tile ] != 0 ) {
+			Decode( VRAM, tile );
+		}
+		return pixels + tile * 128 + ( mirrored ? 64 : 0 ) + ( inBank & 0xf ) / 2 * 8;
+	}
+
+	static void DecodeRow( const byte * data, bool mirrored, byte * row );
+	void		Decode( const byte * VRAM, int tile );
+};